@@ -0,0 +1,115 @@
+//-------------------------------------------------------------
+//! @brief	ヒープ確保の計測まわり
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//! @note	グローバルの operator new / delete を置き換えるため、
+//!			ベンチマーク用の実行ファイルにだけリンクすること
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>	// malloc, free
+#include <new>		// std::bad_alloc
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	std::atomic<unsigned long long>	g_allocCount(0);
+	std::atomic<size_t>				g_liveBytes(0);
+	std::atomic<size_t>				g_peakBytes(0);
+
+	// note: 解放時にサイズを知るため、確保したブロックの先頭にサイズを埋め込む
+	constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+	// @brief ピーク値の更新
+	//-------------------------------------------------------------
+	void UpdatePeak(size_t live)
+	{
+		size_t peak = g_peakBytes.load(std::memory_order_relaxed);
+		while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{}
+	}
+
+	// @brief 計測つき確保
+	//-------------------------------------------------------------
+	void* CountedAlloc(size_t size)
+	{
+		void* p = malloc(size + HEADER_SIZE);
+		if (p == nullptr)
+			return nullptr;
+
+		*static_cast<size_t*>(p) = size;
+		g_allocCount.fetch_add(1, std::memory_order_relaxed);
+		UpdatePeak(g_liveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+
+		return static_cast<char*>(p) + HEADER_SIZE;
+	}
+
+	// @brief 計測つき解放
+	//-------------------------------------------------------------
+	void CountedFree(void* p)
+	{
+		if (p == nullptr)
+			return;
+
+		void* block = static_cast<char*>(p) - HEADER_SIZE;
+		g_liveBytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+		free(block);
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 現在の計測値を取得
+//-------------------------------------------------------------
+Benchmark::AllocationCounter::Snapshot Benchmark::AllocationCounter::Get()
+{
+	Snapshot result;
+	result.allocCount = g_allocCount.load(std::memory_order_relaxed);
+	result.liveBytes  = g_liveBytes.load(std::memory_order_relaxed);
+	result.peakBytes  = g_peakBytes.load(std::memory_order_relaxed);
+	return result;
+}
+
+// @brief ピーク値を現在の確保量に戻す
+//-------------------------------------------------------------
+void Benchmark::AllocationCounter::ResetPeak()
+{
+	g_peakBytes.store(g_liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------
+// replace global operator new / delete
+//-------------------------------------------------------------
+void* operator new(size_t size)
+{
+	void* p = CountedAlloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+
+	return p;
+}
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size);
+}
+void operator delete(void* p) noexcept				{ CountedFree(p); }
+void operator delete[](void* p) noexcept			{ CountedFree(p); }
+void operator delete(void* p, size_t) noexcept		{ CountedFree(p); }
+void operator delete[](void* p, size_t) noexcept	{ CountedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept	{ CountedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept	{ CountedFree(p); }
@@ -0,0 +1,30 @@
+//-------------------------------------------------------------
+//! @brief	ヒープ確保の計測まわり
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <cstddef>	// size_t
+
+namespace Benchmark
+{
+namespace AllocationCounter
+{
+	// @struct 計測値
+	struct Snapshot
+	{
+		unsigned long long	allocCount	= 0;	//! operator new が呼ばれた回数
+		size_t				liveBytes	= 0;	//! 現在確保中のバイト数
+		size_t				peakBytes	= 0;	//! ResetPeak() 以降の最大確保バイト数
+	};
+
+	//! 現在の計測値を取得
+	Snapshot Get();
+
+	//! ピーク値を現在の確保量に戻す
+	void ResetPeak();
+}
+}// end namespace
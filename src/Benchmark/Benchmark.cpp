@@ -0,0 +1,813 @@
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムのベンチマーク
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>	// std::unique_ptr
+#include <cstdlib>	// strtoull
+
+#include "MyUtility/HistogramPipeline.h"
+#include "MyUtility/HuffmanCode.h"
+#include "MyUtility/InterleavedHuffman.h"
+#include "MyUtility/PackageMergeAlgorithm.h"
+#include "MyUtility/PackageMergeBatch.h"
+#include "MyUtility/PackageMergeCache.h"
+#include "MyUtility/StaticPackageMergeAlgorithm.h"
+#include "MyUtility/SymbolExtraction.h"
+#include "AllocationCounter.h"
+#include "Workload.h"
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace Benchmark;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	using EngineFunc = void(*)(const unsigned*, size_t, size_t, PackageMerge::Workspace&, std::vector<unsigned>&);
+
+	// @brief 結果を std::vector で返す版の呼び出し
+	//-------------------------------------------------------------
+	template<std::vector<unsigned>(*FUNC)(const unsigned*, size_t, size_t)>
+	void CallVectorAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& /*unused*/, std::vector<unsigned>& /*out*/result)
+	{
+		result = FUNC(symbolWeights, arraySize, codeLengthLimit);
+	}
+
+	// @brief 作業領域を使い回す版の呼び出し
+	//-------------------------------------------------------------
+	template<bool(*FUNC)(const unsigned*, size_t, size_t, PackageMerge::Workspace&, unsigned*)>
+	void CallWorkspaceAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, std::vector<unsigned>& /*out*/result)
+	{
+		FUNC(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+	}
+
+	// @brief 例外を送出しない版の呼び出し
+	//-------------------------------------------------------------
+	template<PackageMerge::Status(*FUNC)(const unsigned*, size_t, size_t, PackageMerge::Workspace&, unsigned*) noexcept>
+	void CallStatusAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, std::vector<unsigned>& /*out*/result)
+	{
+		FUNC(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+	}
+
+	// @brief 形を固定した版が用意されているか
+	//-------------------------------------------------------------
+	bool IsStaticShape(size_t arraySize, size_t codeLengthLimit)
+	{
+		return (arraySize == 286 && codeLengthLimit == 15) || (arraySize == 30 && codeLengthLimit == 15) || (arraySize == 19 && codeLengthLimit == 7) ||
+			   (arraySize == 256 && (codeLengthLimit == 11 || codeLengthLimit == 12));
+	}
+
+	// @brief 形を固定した版の呼び出し (IsStaticShape() の形のみ)
+	//-------------------------------------------------------------
+	void CallStaticAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, std::vector<unsigned>& /*out*/result)
+	{
+		using namespace PackageMerge;
+		if		(arraySize == 286)		 StaticBoundaryPM<286, 15>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+		else if (arraySize == 30)		 StaticBoundaryPM<30, 15>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+		else if (arraySize == 19)		 StaticBoundaryPM<19, 7>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+		else if (codeLengthLimit == 11)	 StaticBoundaryPM<256, 11>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+		else							 StaticBoundaryPM<256, 12>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, result.data());
+	}
+
+	// @struct 計測対象のエンジン
+	struct Engine
+	{
+		const char*				 name;
+		EngineFunc				 func;
+		size_t					 bytesPerSymbolStage;	//! 作業領域の概算 (シンボル数×ステージ数あたりのバイト数)。0 なら見積もらない
+		PackageMerge::EngineFunc batchFunc;				//! 一括計算に使う関数 (作業領域を使い回す版のみ)
+	};
+
+	// note: 見積もりは NaturalPM がステージごとに 最大 2n 個の 16byte ノード、
+	//       LazyPM が n×L 個の 40byte ノード、CountingPM がステージごとに 最大 n 組分の 4byte の計数を確保することから
+	const Engine ENGINES[] =
+	{
+		{ "natural",     CallVectorAPI<PackageMerge::NaturalPM>,				32, nullptr },
+		{ "pipelined",   CallVectorAPI<PackageMerge::PipelinedNaturalPM>,		32, nullptr },
+		{ "lazy",        CallVectorAPI<PackageMerge::LazyPM>,					40, nullptr },
+		{ "boundary",    CallVectorAPI<PackageMerge::BoundaryPM>,				0,  nullptr },
+		{ "compact",     CallVectorAPI<PackageMerge::CompactBoundaryPM>,		0,  nullptr },
+		{ "divide",      CallVectorAPI<PackageMerge::DivideAndConquerPM>,		0,  nullptr },
+		{ "counting",    CallVectorAPI<PackageMerge::CountingPM>,				4,  nullptr },
+		{ "hybrid",      CallVectorAPI<PackageMerge::HybridPM>,				0,  nullptr },
+		{ "heuristic",   CallVectorAPI<PackageMerge::HeuristicLimit>,			0,  nullptr },
+		{ "natural-ws",  CallWorkspaceAPI<PackageMerge::NaturalPM>,			32, PackageMerge::NaturalPM },
+		{ "pipelined-ws",CallWorkspaceAPI<PackageMerge::PipelinedNaturalPM>,	32, PackageMerge::PipelinedNaturalPM },
+		{ "lazy-ws",     CallWorkspaceAPI<PackageMerge::LazyPM>,				40, PackageMerge::LazyPM },
+		{ "boundary-ws", CallWorkspaceAPI<PackageMerge::BoundaryPM>,			0,  PackageMerge::BoundaryPM },
+		{ "compact-ws",  CallWorkspaceAPI<PackageMerge::CompactBoundaryPM>,	0,  PackageMerge::CompactBoundaryPM },
+		{ "divide-ws",   CallWorkspaceAPI<PackageMerge::DivideAndConquerPM>,	0,  PackageMerge::DivideAndConquerPM },
+		{ "counting-ws", CallWorkspaceAPI<PackageMerge::CountingPM>,			4,  PackageMerge::CountingPM },
+		{ "hybrid-ws",   CallWorkspaceAPI<PackageMerge::HybridPM>,				0,  PackageMerge::HybridPM },
+		{ "heuristic-ws",CallWorkspaceAPI<PackageMerge::HeuristicLimit>,		0,  PackageMerge::HeuristicLimit },
+		{ "natural-nx",  CallStatusAPI<PackageMerge::TryNaturalPM>,			32, nullptr },
+		{ "pipelined-nx",CallStatusAPI<PackageMerge::TryPipelinedNaturalPM>,	32, nullptr },
+		{ "lazy-nx",     CallStatusAPI<PackageMerge::TryLazyPM>,				40, nullptr },
+		{ "boundary-nx", CallStatusAPI<PackageMerge::TryBoundaryPM>,			0,  nullptr },
+		{ "compact-nx",  CallStatusAPI<PackageMerge::TryCompactBoundaryPM>,	0,  nullptr },
+		{ "divide-nx",   CallStatusAPI<PackageMerge::TryDivideAndConquerPM>,	0,  nullptr },
+		{ "counting-nx", CallStatusAPI<PackageMerge::TryCountingPM>,			4,  nullptr },
+		{ "hybrid-nx",   CallStatusAPI<PackageMerge::TryHybridPM>,				0,  nullptr },
+		{ "heuristic-nx",CallStatusAPI<PackageMerge::TryHeuristicLimit>,		0,  nullptr },
+		{ "boundary-static", CallStaticAPI,										0,  nullptr },
+	};
+
+	// @struct コマンドライン設定
+	struct Options
+	{
+		unsigned long long			seed		= 1;
+		std::vector<size_t>			alphabets	= { 19, 30, 286, 4096, 65536, 1048576 };
+		std::vector<size_t>			limits		= { 7, 9, 12, 15, 16, 20, 24, 32 };
+		std::vector<Distribution>	dists		= { Distribution::Uniform, Distribution::Zipf, Distribution::Geometric, Distribution::Sparse, Distribution::File };
+		std::vector<std::string>	engines;
+		std::string					filePath;
+		double						minTimeMs	= 50.0;
+		size_t						maxMegaBytes= 1024;
+		size_t						batchSize	= 0;	//! 0 以外なら一括計算を計測する
+		std::vector<size_t>			threads		= { 1 };
+		size_t						cacheMegaBytes = 0;	//! 0 以外なら一括計算を結果キャッシュ越しに計測する
+		size_t						distinct	= 0;	//! 一括計算で使う異なるヒストグラムの数 (0 なら --batch と同じ)
+		std::string					simd;				//! 空なら CPU に合わせる
+		std::vector<size_t>			decodeRootBits;		//! 空でなければ、エンジンの代わりに復号速度を計測する
+		size_t						messageSize	= 1 << 20;	//! 復号の計測に使うシンボル数
+		std::vector<size_t>			pipelineBlocks;		//! 空でなければ、エンジンの代わりにヒストグラムからの一括処理を計測する
+		bool						csv			= false;
+	};
+
+	// @struct 計測結果
+	struct Result
+	{
+		unsigned long long	calls		= 0;
+		double				nsPerCall	= 0.0;
+		size_t				peakBytes	= 0;
+		double				allocsPerCall = 0.0;
+		double				gapPercent	= -1.0;	//! 最適な符号長に対する総ビット数 Σw・l の増加率 (%)。負なら計測していない
+	};
+
+	// @brief カンマ区切りの数値リストを分解
+	//-------------------------------------------------------------
+	std::vector<size_t> ParseSizeList(const std::string& text)
+	{
+		std::vector<size_t> result;
+		std::stringstream ss(text);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (!item.empty())
+				result.push_back(static_cast<size_t>(strtoull(item.c_str(), nullptr, 0)));
+		}
+		return result;
+	}
+
+	// @brief カンマ区切りの文字列リストを分解
+	//-------------------------------------------------------------
+	std::vector<std::string> ParseNameList(const std::string& text)
+	{
+		std::vector<std::string> result;
+		std::stringstream ss(text);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (!item.empty())
+				result.push_back(item);
+		}
+		return result;
+	}
+
+	// @brief 使い方の表示
+	//-------------------------------------------------------------
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: benchmark [options]\n"
+			"  --seed=N          workload seed (default 1)\n"
+			"  --n=LIST          alphabet sizes (default 19,30,286,4096,65536,1048576)\n"
+			"  --L=LIST          code length limits (default 7,9,12,15,16,20,24,32)\n"
+			"  --dist=LIST       uniform,zipf,geometric,sparse,file\n"
+			"  --engine=LIST     natural,pipelined,lazy,boundary,compact,divide,counting,hybrid,heuristic, their -ws variants\n"
+			"                    and their -nx (noexcept, status code) variants,\n"
+			"                    boundary-static ((286,15) (30,15) (19,7) (256,11) (256,12) only) (default all)\n"
+			"  --file=PATH       input for the 'file' distribution\n"
+			"  --min-time=MS     minimum measuring time per case (default 50)\n"
+			"  --max-mb=MB       skip cases whose estimated working set exceeds MB (default 1024)\n"
+			"  --batch=COUNT     measure BatchExecutor over COUNT histograms per run (-ws engines only)\n"
+			"  --threads=LIST    thread counts for --batch (default 1)\n"
+			"  --cache=MB        route --batch through a CodeLengthCache of MB megabytes\n"
+			"  --distinct=COUNT  number of distinct histograms in a --batch run (default: the batch size)\n"
+			"  --simd=LEVEL      symbol extraction kernel: scalar,sse2,avx2 (default: best supported)\n"
+			"  --decode=LIST     measure TableDecoder with these root table bits instead of the engines (n <= 65536);\n"
+			"                    also measures the 4-stream coder when n <= 256 and L <= 16\n"
+			"  --message=COUNT   symbols per message for --decode (default 1048576)\n"
+			"  --pipeline=LIST   measure HistogramPipeline over --file with these block sizes in bytes instead of the engines\n"
+			"                    (n = 256 or 65536, -ws engines only, one row per --threads entry)\n"
+			"  --csv             print comma separated values\n";
+	}
+
+	// @brief コマンドライン解析
+	//-------------------------------------------------------------
+	bool ParseOptions(int argc, char* argv[], Options& /*out*/options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			std::string::size_type eq = arg.find('=');
+			std::string key   = arg.substr(0, eq);
+			std::string value = (eq == std::string::npos) ? std::string() : arg.substr(eq + 1);
+
+			if      (key == "--seed")		options.seed = strtoull(value.c_str(), nullptr, 0);
+			else if (key == "--n")			options.alphabets = ParseSizeList(value);
+			else if (key == "--L")			options.limits = ParseSizeList(value);
+			else if (key == "--engine")		options.engines = ParseNameList(value);
+			else if (key == "--file")		options.filePath = value;
+			else if (key == "--min-time")	options.minTimeMs = strtod(value.c_str(), nullptr);
+			else if (key == "--max-mb")		options.maxMegaBytes = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--batch")		options.batchSize = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--threads")	options.threads = ParseSizeList(value);
+			else if (key == "--cache")		options.cacheMegaBytes = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--distinct")	options.distinct = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--simd")		options.simd = value;
+			else if (key == "--decode")		options.decodeRootBits = ParseSizeList(value);
+			else if (key == "--message")	options.messageSize = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--pipeline")	options.pipelineBlocks = ParseSizeList(value);
+			else if (key == "--csv")		options.csv = true;
+			else if (key == "--dist")
+			{
+				options.dists.clear();
+				for (const std::string& name : ParseNameList(value))
+				{
+					Distribution dist;
+					if (!ParseDistribution(name, dist))
+					{
+						std::cerr << "unknown distribution: " << name << "\n";
+						return false;
+					}
+					options.dists.push_back(dist);
+				}
+			}
+			else
+			{
+				PrintUsage();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// @brief エンジンが選択されているか
+	//-------------------------------------------------------------
+	bool IsSelected(const Options& options, const Engine& engine)
+	{
+		if (options.engines.empty())
+			return true;
+
+		for (const std::string& name : options.engines)
+		{
+			if (name == engine.name)
+				return true;
+		}
+		return false;
+	}
+
+	// @brief 1ケースを計測
+	// @param optimalBits 最適な符号長での総ビット数 (結果の損失の基準)
+	//-------------------------------------------------------------
+	Result Measure(const Engine& engine, const std::vector<unsigned>& weights, size_t codeLengthLimit, unsigned long long optimalBits, double minTimeMs)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		PackageMerge::Workspace workspace;
+		std::vector<unsigned>	bitLengths(weights.size());
+
+		// ウォームアップを兼ねて、最適解との差を求める
+		engine.func(weights.data(), weights.size(), codeLengthLimit, workspace, bitLengths);
+		unsigned long long totalBits = PackageMerge::CalculateTotalBits(weights.data(), bitLengths.data(), weights.size());
+
+		AllocationCounter::ResetPeak();
+		AllocationCounter::Snapshot before = AllocationCounter::Get();
+
+		Result result;
+		Clock::time_point start = Clock::now();
+		double elapsedNs = 0.0;
+
+		// 最低計測時間を超えるまで呼び出し回数を倍々に増やす
+		for (unsigned long long batch = 1; ; batch *= 2)
+		{
+			for (unsigned long long i = 0; i < batch; ++i)
+				engine.func(weights.data(), weights.size(), codeLengthLimit, workspace, bitLengths);
+
+			result.calls += batch;
+			elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			if (elapsedNs >= minTimeMs * 1.0e6)
+				break;
+		}
+		AllocationCounter::Snapshot after = AllocationCounter::Get();
+
+		result.nsPerCall	 = elapsedNs / static_cast<double>(result.calls);
+		result.peakBytes	 = after.peakBytes - before.liveBytes;
+		result.allocsPerCall = static_cast<double>(after.allocCount - before.allocCount) / static_cast<double>(result.calls);
+		result.gapPercent	 = optimalBits ? 100.0 * (static_cast<double>(totalBits) / static_cast<double>(optimalBits) - 1.0) : 0.0;
+		return result;
+	}
+
+	// @brief 一括計算を計測
+	// @note  1回の Run() で numJob 件を処理する。結果は1件あたりに換算する。
+	//        cacheMegaBytes が 0 以外なら、ウォームアップで温めたキャッシュ越しに計測する
+	//-------------------------------------------------------------
+	Result MeasureBatch(const Engine& engine, const std::vector<std::vector<unsigned>>& weightsList, size_t codeLengthLimit, size_t numThread, size_t cacheMegaBytes, double minTimeMs)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		std::unique_ptr<PackageMerge::CodeLengthCache> pCache;
+		if (cacheMegaBytes)
+			pCache.reset(new PackageMerge::CodeLengthCache(engine.batchFunc, cacheMegaBytes << 20));
+
+		PackageMerge::BatchExecutor			   executor(numThread);
+		std::vector<std::vector<unsigned>>	   bitLengthsList(weightsList.size());
+		std::vector<PackageMerge::BatchJob>	   jobs(weightsList.size());
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			bitLengthsList[i].resize(weightsList[i].size());
+			jobs[i].symbolWeights	= weightsList[i].data();
+			jobs[i].arraySize		= weightsList[i].size();
+			jobs[i].codeLengthLimit	= codeLengthLimit;
+			jobs[i].pBitLengths		= bitLengthsList[i].data();
+		}
+
+		auto run = [&]()
+		{
+			if (pCache)
+				executor.Run(jobs.data(), jobs.size(), *pCache);
+			else
+				executor.Run(jobs.data(), jobs.size(), engine.batchFunc);
+		};
+
+		// ウォームアップ
+		run();
+
+		AllocationCounter::ResetPeak();
+		AllocationCounter::Snapshot before = AllocationCounter::Get();
+
+		Result			  result;
+		Clock::time_point start = Clock::now();
+		double			  elapsedNs = 0.0;
+		do
+		{
+			run();
+			result.calls += jobs.size();
+			elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		}
+		while (elapsedNs < minTimeMs * 1.0e6);
+
+		AllocationCounter::Snapshot after = AllocationCounter::Get();
+
+		result.nsPerCall	 = elapsedNs / static_cast<double>(result.calls);
+		result.peakBytes	 = after.peakBytes - before.liveBytes;
+		result.allocsPerCall = static_cast<double>(after.allocCount - before.allocCount) / static_cast<double>(result.calls);
+		return result;
+	}
+
+	// @struct 復号の計測結果
+	struct DecodeResult
+	{
+		double	megaBytesPerSec	= 0.0;	//! 復号した出力 (シンボルあたり 1 または 2byte) の速度
+		double	bitsPerSymbol	= 0.0;	//! 符号化後の平均ビット数
+		size_t	tableSize		= 0;	//! 復号表の要素数
+	};
+
+	// @brief 復号を計測
+	// @note  シンボル数が 256 以下なら 1byte、それ以外は 2byte のシンボルとして出力する
+	//-------------------------------------------------------------
+	template<class SYMBOL>
+	bool MeasureDecodeAs(const std::vector<unsigned>& bitLengths, const std::vector<unsigned short>& message, unsigned rootBits, double minTimeMs, DecodeResult& /*out*/result)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		std::vector<SYMBOL>		   symbols(message.begin(), message.end());
+		std::vector<unsigned char> encoded;
+
+		Huffman::CanonicalCode code;
+		Huffman::TableDecoder  decoder;
+		if (!code.Build(bitLengths.data(), bitLengths.size()) || !code.Encode(symbols.data(), symbols.size(), encoded) ||
+			!decoder.Build(bitLengths.data(), bitLengths.size(), rootBits))
+			return false;
+
+		// ウォームアップを兼ねて結果を確認
+		std::vector<SYMBOL> decoded(symbols.size());
+		if (!decoder.Decode(encoded.data(), encoded.size(), decoded.data(), decoded.size()) || decoded != symbols)
+			return false;
+
+		unsigned long long calls = 0;
+		Clock::time_point  start = Clock::now();
+		double			   elapsedNs = 0.0;
+		do
+		{
+			decoder.Decode(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+			++calls;
+			elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		}
+		while (elapsedNs < minTimeMs * 1.0e6);
+
+		double outputBytes		= static_cast<double>(symbols.size() * sizeof(SYMBOL)) * static_cast<double>(calls);
+		result.megaBytesPerSec	= outputBytes / (elapsedNs * 1.0e-9) / (1 << 20);
+		result.bitsPerSymbol	= symbols.empty() ? 0.0 : 8.0 * static_cast<double>(encoded.size()) / static_cast<double>(symbols.size());
+		result.tableSize		= decoder.GetTableSize();
+		return true;
+	}
+
+	// @brief 4本のビット列に分けた符号化・復号を計測
+	// @note  シンボル数が 256 以下、符号長が MAX_INTERLEAVED_BIT_LENGTH 以下の場合のみ
+	//-------------------------------------------------------------
+	bool MeasureInterleaved(const std::vector<unsigned>& bitLengths, const std::vector<unsigned short>& message, double minTimeMs, DecodeResult& /*out*/encodeResult, DecodeResult& /*out*/decodeResult)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		std::vector<unsigned char> symbols(message.begin(), message.end());
+		std::vector<unsigned char> encoded;
+
+		Huffman::InterleavedEncoder encoder;
+		Huffman::InterleavedDecoder decoder;
+		if (!encoder.Build(bitLengths.data(), bitLengths.size()) || !encoder.Encode(symbols.data(), symbols.size(), encoded) ||
+			!decoder.Build(bitLengths.data(), bitLengths.size()))
+			return false;
+
+		std::vector<unsigned char> decoded(symbols.size());
+		if (!decoder.Decode(encoded.data(), encoded.size(), decoded.data(), decoded.size()) || decoded != symbols)
+			return false;
+
+		// 符号化
+		std::vector<unsigned char> buffer;
+		unsigned long long calls = 0;
+		Clock::time_point  start = Clock::now();
+		double			   elapsedNs = 0.0;
+		do
+		{
+			buffer.clear();
+			encoder.Encode(symbols.data(), symbols.size(), buffer);
+			++calls;
+			elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		}
+		while (elapsedNs < minTimeMs * 1.0e6);
+		encodeResult.megaBytesPerSec = static_cast<double>(symbols.size()) * static_cast<double>(calls) / (elapsedNs * 1.0e-9) / (1 << 20);
+
+		// 復号
+		calls = 0;
+		start = Clock::now();
+		do
+		{
+			decoder.Decode(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+			++calls;
+			elapsedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		}
+		while (elapsedNs < minTimeMs * 1.0e6);
+		decodeResult.megaBytesPerSec = static_cast<double>(symbols.size()) * static_cast<double>(calls) / (elapsedNs * 1.0e-9) / (1 << 20);
+
+		encodeResult.bitsPerSymbol = decodeResult.bitsPerSymbol = symbols.empty() ? 0.0 : 8.0 * static_cast<double>(encoded.size()) / static_cast<double>(symbols.size());
+		encodeResult.tableSize	   = 0;
+		decodeResult.tableSize	   = decoder.GetTableSize();
+		return true;
+	}
+
+	// @brief 復号の計測結果の表示
+	//-------------------------------------------------------------
+	void PrintDecodeResult(const Options& options, const std::string& name, Distribution dist, size_t numAlphabet, size_t numSymbol, size_t codeLengthLimit, const DecodeResult& result)
+	{
+		if (options.csv)
+		{
+			std::cout << name << ',' << ToString(dist) << ',' << numAlphabet << ',' << numSymbol << ',' << codeLengthLimit << ','
+					  << std::fixed << std::setprecision(1) << result.megaBytesPerSec << ',' << std::setprecision(3) << result.bitsPerSymbol << ','
+					  << result.tableSize << '\n';
+			return;
+		}
+		std::cout << std::left  << std::setw(16) << name
+				  << std::setw(11) << ToString(dist)
+				  << std::right << std::setw(9)  << numAlphabet
+				  << std::setw(9)  << numSymbol
+				  << std::setw(4)  << codeLengthLimit
+				  << std::fixed << std::setprecision(1)
+				  << std::setw(16) << result.megaBytesPerSec
+				  << std::setprecision(3)
+				  << std::setw(14) << result.bitsPerSymbol
+				  << std::setw(14) << result.tableSize << '\n';
+	}
+
+	// @brief 結果の表示
+	//-------------------------------------------------------------
+	void PrintResult(const Options& options, const std::string& engineName, Distribution dist, size_t numAlphabet, size_t numSymbol, size_t codeLengthLimit, const Result& result)
+	{
+		double callsPerSec = 1.0e9 / result.nsPerCall;
+		if (options.csv)
+		{
+			std::cout << engineName << ',' << ToString(dist) << ',' << numAlphabet << ',' << numSymbol << ',' << codeLengthLimit << ','
+					  << std::fixed << std::setprecision(1) << result.nsPerCall << ',' << callsPerSec << ','
+					  << result.peakBytes << ',' << std::setprecision(2) << result.allocsPerCall << ',';
+			if (result.gapPercent >= 0.0)
+				std::cout << std::setprecision(4) << result.gapPercent;
+			std::cout << '\n';
+			return;
+		}
+		std::cout << std::left  << std::setw(16) << engineName
+				  << std::setw(11) << ToString(dist)
+				  << std::right << std::setw(9)  << numAlphabet
+				  << std::setw(9)  << numSymbol
+				  << std::setw(4)  << codeLengthLimit
+				  << std::fixed << std::setprecision(1)
+				  << std::setw(16) << result.nsPerCall
+				  << std::setw(14) << callsPerSec
+				  << std::setw(14) << result.peakBytes
+				  << std::setprecision(2)
+				  << std::setw(12) << result.allocsPerCall
+				  << std::setprecision(4)
+				  << std::setw(10);
+		if (result.gapPercent >= 0.0)
+			std::cout << result.gapPercent << '\n';
+		else
+			std::cout << '-' << '\n';
+	}
+
+	// @brief ヒストグラムからの一括処理の計測
+	// @note  ファイルの割り当てを含めて最低時間まで繰り返し、1回あたりの段ごとの時間を表示する
+	//-------------------------------------------------------------
+	int MeasurePipeline(const Options& options)
+	{
+		if (options.filePath.empty())
+		{
+			std::cerr << "--pipeline requires --file\n";
+			return 1;
+		}
+
+		if (options.csv)
+			std::cout << "pipeline,alphabet,L,block,blocks,mb_per_sec,map_ms,histogram_ms,code_length_ms,wall_ms\n";
+		else
+			std::cout << std::left  << std::setw(28) << "pipeline"
+					  << std::right << std::setw(9)  << "alphabet"
+					  << std::setw(4)  << "L"
+					  << std::setw(10) << "block"
+					  << std::setw(8)  << "blocks"
+					  << std::setw(10) << "MB/s"
+					  << std::setw(10) << "map ms"
+					  << std::setw(10) << "hist ms"
+					  << std::setw(10) << "code ms"
+					  << std::setw(10) << "wall ms" << '\n';
+
+		for (size_t numAlphabet : options.alphabets)
+		{
+			if (numAlphabet != 0x100 && numAlphabet != 0x10000)
+				continue;
+
+			for (size_t codeLengthLimit : options.limits)
+			for (size_t blockSize : options.pipelineBlocks)
+			for (const Engine& engine : ENGINES)
+			{
+				if (!IsSelected(options, engine) || engine.batchFunc == nullptr)
+					continue;
+
+				for (size_t numThread : options.threads)
+				{
+					PackageMerge::HistogramPipelineConfig config;
+					config.blockSize	   = blockSize;
+					config.symbolWidth	   = (numAlphabet == 0x100) ? PackageMerge::SYMBOL_WIDTH_8 : PackageMerge::SYMBOL_WIDTH_16;
+					config.codeLengthLimit = codeLengthLimit;
+					config.numThread	   = numThread;
+					config.engine		   = engine.batchFunc;
+
+					// 一度空回しして作業領域とページキャッシュを温める
+					PackageMerge::HistogramPipeline pipeline(config);
+					if (!pipeline.RunFile(options.filePath.c_str()))
+						continue;
+
+					PackageMerge::HistogramPipelineTiming total;
+					unsigned long long					  runs = 0;
+					while (runs == 0 || total.wallMs < options.minTimeMs)
+					{
+						pipeline.RunFile(options.filePath.c_str());
+
+						const PackageMerge::HistogramPipelineTiming& timing = pipeline.GetTiming();
+						total.mapMs		   += timing.mapMs;
+						total.histogramMs  += timing.histogramMs;
+						total.codeLengthMs += timing.codeLengthMs;
+						total.wallMs	   += timing.wallMs;
+						++runs;
+					}
+
+					double fileBytes = static_cast<double>(pipeline.GetInputSize());
+					double runCount	 = static_cast<double>(runs);
+					std::string name = std::string("pipeline/") + engine.name + "/t" + std::to_string(numThread);
+					double megaBytesPerSec = (total.wallMs > 0.0) ? fileBytes * runCount / (total.wallMs * 1.0e-3) / (1 << 20) : 0.0;
+
+					if (options.csv)
+					{
+						std::cout << name << ',' << numAlphabet << ',' << codeLengthLimit << ',' << pipeline.GetConfig().blockSize << ','
+								  << pipeline.GetBlockCount() << ',' << megaBytesPerSec << ','
+								  << total.mapMs / runCount << ',' << total.histogramMs / runCount << ','
+								  << total.codeLengthMs / runCount << ',' << total.wallMs / runCount << '\n';
+						continue;
+					}
+					std::cout << std::left  << std::setw(28) << name
+							  << std::right << std::setw(9)  << numAlphabet
+							  << std::setw(4)  << codeLengthLimit
+							  << std::setw(10) << pipeline.GetConfig().blockSize
+							  << std::setw(8)  << pipeline.GetBlockCount()
+							  << std::fixed << std::setprecision(1)
+							  << std::setw(10) << megaBytesPerSec
+							  << std::setprecision(3)
+							  << std::setw(10) << total.mapMs / runCount
+							  << std::setw(10) << total.histogramMs / runCount
+							  << std::setw(10) << total.codeLengthMs / runCount
+							  << std::setw(10) << total.wallMs / runCount << '\n';
+				}
+			}
+		}
+		return 0;
+	}
+
+	// @brief 見出しの表示
+	//-------------------------------------------------------------
+	void PrintHeader(const Options& options)
+	{
+		if (options.csv)
+		{
+			if (!options.decodeRootBits.empty())
+				std::cout << "decoder,dist,alphabet,symbols,L,mb_per_sec,bits_per_symbol,table_entries\n";
+			else
+				std::cout << "engine,dist,alphabet,symbols,L,ns_per_call,calls_per_sec,peak_bytes,allocs_per_call,gap_percent\n";
+			return;
+		}
+		std::cout << "seed: " << options.seed << "\n";
+		std::cout << "simd: " << PackageMerge::ToString(PackageMerge::GetSimdLevel()) << "\n";
+		if (!options.decodeRootBits.empty())
+		{
+			std::cout << std::left  << std::setw(16) << "decoder"
+					  << std::setw(11) << "dist"
+					  << std::right << std::setw(9)  << "alphabet"
+					  << std::setw(9)  << "symbols"
+					  << std::setw(4)  << "L"
+					  << std::setw(16) << "MB/s"
+					  << std::setw(14) << "bits/symbol"
+					  << std::setw(14) << "table" << '\n';
+			return;
+		}
+		std::cout << std::left  << std::setw(16) << "engine"
+				  << std::setw(11) << "dist"
+				  << std::right << std::setw(9)  << "alphabet"
+				  << std::setw(9)  << "symbols"
+				  << std::setw(4)  << "L"
+				  << std::setw(16) << "ns/call"
+				  << std::setw(14) << "calls/s"
+				  << std::setw(14) << "peak bytes"
+				  << std::setw(12) << "allocs/call"
+				  << std::setw(10) << "gap %" << '\n';
+	}
+}
+
+//! @brief main
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+		return 1;
+
+	if (!options.simd.empty())
+	{
+		PackageMerge::SimdLevel level;
+		if		(options.simd == "scalar")	level = PackageMerge::SIMD_SCALAR;
+		else if (options.simd == "sse2")	level = PackageMerge::SIMD_SSE2;
+		else if (options.simd == "avx2")	level = PackageMerge::SIMD_AVX2;
+		else
+		{
+			std::cerr << "unknown simd level: " << options.simd << "\n";
+			return 1;
+		}
+		PackageMerge::SetSimdLevel(level);
+	}
+
+	if (!options.pipelineBlocks.empty())
+		return MeasurePipeline(options);
+
+	std::vector<unsigned char> fileData;
+	if (!options.filePath.empty() && !LoadFile(options.filePath.c_str(), fileData))
+	{
+		std::cerr << "cannot open: " << options.filePath << "\n";
+		return 1;
+	}
+	PrintHeader(options);
+
+	for (Distribution dist : options.dists)
+	{
+		// 実ファイルの指定がなければ計測しない
+		if (dist == Distribution::File && fileData.empty())
+			continue;
+
+		for (size_t numAlphabet : options.alphabets)
+		{
+			std::vector<unsigned> weights = MakeWorkload(dist, numAlphabet, options.seed, fileData);
+
+			size_t numSymbol = 0;
+			for (unsigned w : weights)
+				numSymbol += (w != 0);
+
+			for (size_t codeLengthLimit : options.limits)
+			{
+				if (numSymbol < 2 || PackageMerge::IsImpossibleCoding(numSymbol, codeLengthLimit))
+					continue;
+
+				// 復号の計測: 境界パッケージマージで求めた符号長から表を作る
+				if (!options.decodeRootBits.empty())
+				{
+					if (numAlphabet > Huffman::MAX_SYMBOL_COUNT)
+						continue;
+
+					std::vector<unsigned>		bitLengths = PackageMerge::BoundaryPM(weights.data(), weights.size(), codeLengthLimit);
+					std::vector<unsigned short> message	   = MakeMessage(weights, options.messageSize, options.seed);
+					for (size_t rootBits : options.decodeRootBits)
+					{
+						DecodeResult result;
+						bool succeeded = (numAlphabet <= 0x100)
+							? MeasureDecodeAs<unsigned char>(bitLengths, message, static_cast<unsigned>(rootBits), options.minTimeMs, result)
+							: MeasureDecodeAs<unsigned short>(bitLengths, message, static_cast<unsigned>(rootBits), options.minTimeMs, result);
+						if (!succeeded)
+						{
+							std::cerr << "decode mismatch: " << ToString(dist) << " n=" << numAlphabet << " L=" << codeLengthLimit << "\n";
+							return 1;
+						}
+						PrintDecodeResult(options, "decode/r" + std::to_string(rootBits), dist, numAlphabet, numSymbol, codeLengthLimit, result);
+					}
+
+					// 4本のビット列に分けた場合
+					if (numAlphabet <= 0x100 && codeLengthLimit <= Huffman::MAX_INTERLEAVED_BIT_LENGTH)
+					{
+						DecodeResult encodeResult, decodeResult;
+						if (!MeasureInterleaved(bitLengths, message, options.minTimeMs, encodeResult, decodeResult))
+						{
+							std::cerr << "interleaved mismatch: " << ToString(dist) << " n=" << numAlphabet << " L=" << codeLengthLimit << "\n";
+							return 1;
+						}
+						PrintDecodeResult(options, "x4-encode", dist, numAlphabet, numSymbol, codeLengthLimit, encodeResult);
+						PrintDecodeResult(options, "x4-decode", dist, numAlphabet, numSymbol, codeLengthLimit, decodeResult);
+					}
+					continue;
+				}
+
+				// 最適な符号長での総ビット数 (経験的な方法の損失の基準)
+				unsigned long long optimalBits = 0;
+				if (options.batchSize == 0)
+				{
+					PackageMerge::Workspace workspace;
+					std::vector<unsigned>	bitLengths(weights.size());
+					PackageMerge::BoundaryPM(weights.data(), weights.size(), codeLengthLimit, workspace, bitLengths.data());
+					optimalBits = PackageMerge::CalculateTotalBits(weights.data(), bitLengths.data(), weights.size());
+				}
+
+				for (const Engine& engine : ENGINES)
+				{
+					if (!IsSelected(options, engine))
+						continue;
+
+					if (engine.func == CallStaticAPI && !IsStaticShape(numAlphabet, codeLengthLimit))
+						continue;
+
+					// 作業領域が大きすぎるケースは飛ばす
+					unsigned long long estimate = static_cast<unsigned long long>(engine.bytesPerSymbolStage) * numSymbol * codeLengthLimit;
+					if (estimate > (static_cast<unsigned long long>(options.maxMegaBytes) << 20))
+						continue;
+
+					if (options.batchSize == 0)
+					{
+						Result result = Measure(engine, weights, codeLengthLimit, optimalBits, options.minTimeMs);
+						PrintResult(options, engine.name, dist, numAlphabet, numSymbol, codeLengthLimit, result);
+						continue;
+					}
+					if (engine.batchFunc == nullptr)
+						continue;
+
+					// 一括計算: シードをずらした同じ形のヒストグラムを並べる (--distinct 件ごとに繰り返す)
+					size_t numDistinct = options.distinct ? options.distinct : options.batchSize;
+					std::vector<std::vector<unsigned>> weightsList(options.batchSize);
+					for (size_t i = 0; i < weightsList.size(); ++i)
+						weightsList[i] = MakeWorkload(dist, numAlphabet, options.seed + i % numDistinct, fileData);
+
+					std::string batchName = std::string(engine.name) + (options.cacheMegaBytes ? "+cache" : "");
+					for (size_t numThread : options.threads)
+					{
+						Result result = MeasureBatch(engine, weightsList, codeLengthLimit, numThread, options.cacheMegaBytes, options.minTimeMs);
+						PrintResult(options, batchName + "/t" + std::to_string(numThread), dist, numAlphabet, numSymbol, codeLengthLimit, result);
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+//-------------------------------------------------------------
+//! @brief	ベンチマーク用の重み表 (ヒストグラム) 生成
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "Workload.h"
+#include <random>	// std::mt19937_64
+#include <fstream>
+#include <iterator>	// std::istreambuf_iterator
+#include <algorithm>	// std::upper_bound
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// std::uniform_int_distribution 等の出力は処理系依存のため使わない。
+	// mt19937_64 の出力列は規格で定められているので、
+	// 生の出力と整数演算だけで重みを作ればどの環境でも同じ重み表が再現できる
+
+	// @brief シードの攪拌 (splitmix64)
+	//-------------------------------------------------------------
+	unsigned long long MixSeed(unsigned long long x)
+	{
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
+	// @brief 重み表をシャッフル (Fisher-Yates)
+	//-------------------------------------------------------------
+	void Shuffle(std::vector<unsigned>& /*ref*/weights, std::mt19937_64& rng)
+	{
+		for (size_t i = weights.size(); i > 1; --i)
+		{
+			size_t j = static_cast<size_t>(rng() % i);
+			std::swap(weights[i - 1], weights[j]);
+		}
+	}
+
+	// @brief 実ファイルからの集計
+	// @note  アルファベット数に応じて 1～3 バイトの窓で値を作り、剰余で畳み込む
+	//-------------------------------------------------------------
+	void CountFile(const std::vector<unsigned char>& fileData, std::vector<unsigned>& /*out*/weights)
+	{
+		size_t numAlphabet = weights.size();
+		size_t width = (numAlphabet <= 0x100) ? 1 : (numAlphabet <= 0x10000) ? 2 : 3;
+		if (fileData.size() < width)
+			return;
+
+		for (size_t i = 0; i + width <= fileData.size(); ++i)
+		{
+			size_t value = 0;
+			for (size_t b = 0; b < width; ++b)
+				value |= static_cast<size_t>(fileData[i + b]) << (8 * b);
+
+			weights[value % numAlphabet] += 1;
+		}
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 分布名
+//-------------------------------------------------------------
+const char* Benchmark::ToString(Distribution dist)
+{
+	switch (dist)
+	{
+	case Distribution::Uniform:		return "uniform";
+	case Distribution::Zipf:		return "zipf";
+	case Distribution::Geometric:	return "geometric";
+	case Distribution::Sparse:		return "sparse";
+	case Distribution::File:		return "file";
+	default:						return "unknown";
+	}
+}
+
+// @brief 分布名から変換
+//-------------------------------------------------------------
+bool Benchmark::ParseDistribution(const std::string& name, Distribution& /*out*/dist)
+{
+	for (int i = 0; i < static_cast<int>(Distribution::Count); ++i)
+	{
+		if (name == ToString(static_cast<Distribution>(i)))
+		{
+			dist = static_cast<Distribution>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// @brief ファイルを丸ごと読み込む
+//-------------------------------------------------------------
+bool Benchmark::LoadFile(const char* path, std::vector<unsigned char>& /*out*/data)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs)
+		return false;
+
+	data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// @brief シードから決定的に重み表を生成する
+//-------------------------------------------------------------
+std::vector<unsigned> Benchmark::MakeWorkload(Distribution dist, size_t numAlphabet, unsigned long long seed, const std::vector<unsigned char>& fileData)
+{
+	// 分布とアルファベット数ごとに別系列の乱数を使う
+	std::mt19937_64 rng(MixSeed(seed ^ MixSeed((static_cast<unsigned long long>(dist) << 32) ^ numAlphabet)));
+	std::vector<unsigned> weights(numAlphabet);
+
+	switch (dist)
+	{
+	case Distribution::Uniform:
+		for (unsigned& w : weights)
+			w = 1 + static_cast<unsigned>(rng() % 1024);
+		break;
+
+	case Distribution::Zipf:
+		for (size_t rank = 0; rank < numAlphabet; ++rank)
+			weights[rank] = static_cast<unsigned>((1ULL << 24) / (rank + 1));
+
+		Shuffle(weights, rng);
+		break;
+
+	case Distribution::Geometric:
+	{
+		// 2^30 から始めて 順位ごとに (1 - 1/d) 倍する。
+		// 末尾でおおよそ 1 になるよう d を決める (2^30 ≒ e^20.8)
+		unsigned long long d = numAlphabet / 21 + 2;
+		unsigned long long w = 1ULL << 30;
+		for (size_t rank = 0; rank < numAlphabet; ++rank)
+		{
+			weights[rank] = static_cast<unsigned>(w);
+			w -= w / d;
+			if (w == 0)
+				w = 1;
+		}
+		Shuffle(weights, rng);
+		break;
+	}
+	case Distribution::Sparse:
+	{
+		size_t numUsed = 0;
+		for (unsigned& w : weights)
+		{
+			unsigned long long r = rng();
+			if ((r & 0xF) == 0)
+			{
+				w = 1 + static_cast<unsigned>((r >> 4) % 1024);
+				++numUsed;
+			}
+		}
+		// 符号化対象が2つ未満にならないようにしておく
+		for (size_t i = 0; numUsed < 2 && i < numAlphabet; ++i)
+		{
+			if (weights[i] == 0)
+			{
+				weights[i] = 1;
+				++numUsed;
+			}
+		}
+		break;
+	}
+	case Distribution::File:
+		CountFile(fileData, /*out*/weights);
+		break;
+
+	default:
+		break;
+	}
+	return weights;
+}
+
+// @brief 重み表の比率に従うシンボル列を生成する
+//-------------------------------------------------------------
+std::vector<unsigned short> Benchmark::MakeMessage(const std::vector<unsigned>& weights, size_t numSymbol, unsigned long long seed)
+{
+	std::mt19937_64 rng(MixSeed(seed ^ 0x6D657373616765ULL));
+
+	// 累積和を二分探索してシンボルを選ぶ
+	std::vector<unsigned long long> cumulative(weights.size());
+	unsigned long long total = 0;
+	for (size_t i = 0; i < weights.size(); ++i)
+	{
+		total		 += weights[i];
+		cumulative[i] = total;
+	}
+
+	std::vector<unsigned short> message(total ? numSymbol : 0);
+	for (unsigned short& symbol : message)
+	{
+		unsigned long long r = rng() % total;
+		symbol = static_cast<unsigned short>(std::upper_bound(cumulative.begin(), cumulative.end(), r) - cumulative.begin());
+	}
+	return message;
+}
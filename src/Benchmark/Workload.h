@@ -0,0 +1,43 @@
+//-------------------------------------------------------------
+//! @brief	ベンチマーク用の重み表 (ヒストグラム) 生成
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <vector>
+#include <string>
+#include <cstddef>	// size_t
+
+namespace Benchmark
+{
+	// @enum 重みの分布
+	enum class Distribution
+	{
+		Uniform,	//! 一様 [1, 1024]
+		Zipf,		//! 順位に反比例 (シャッフル済み)
+		Geometric,	//! 順位ごとに指数的に減衰 (深い木になりやすい)
+		Sparse,		//! 1/16 程度のシンボルだけが出現
+		File,		//! 実ファイルのバイト列から集計
+
+		Count
+	};
+
+	//! 分布名
+	const char* ToString(Distribution dist);
+
+	//! 分布名から変換。失敗したら false
+	bool ParseDistribution(const std::string& name, Distribution& /*out*/dist);
+
+	//! ファイルを丸ごと読み込む。失敗したら false
+	bool LoadFile(const char* path, std::vector<unsigned char>& /*out*/data);
+
+	//! シードから決定的に重み表を生成する
+	//! @note File の場合は fileData を集計する (空なら空の配列を返す)
+	std::vector<unsigned> MakeWorkload(Distribution dist, size_t numAlphabet, unsigned long long seed, const std::vector<unsigned char>& fileData);
+
+	//! 重み表の比率に従うシンボル列をシードから決定的に生成する (復号の計測用。重み表は 65536 要素以下)
+	std::vector<unsigned short> MakeMessage(const std::vector<unsigned>& weights, size_t numSymbol, unsigned long long seed);
+}// end namespace
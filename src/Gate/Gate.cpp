@@ -0,0 +1,799 @@
+//-------------------------------------------------------------
+//! @brief	全アルゴリズムの結果の一致と速度の退行を調べるゲート
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>		// std::mt19937_64
+#include <algorithm>	// std::sort
+#include <exception>	// std::exception
+#include <stdexcept>	// std::runtime_error
+#include <cstdlib>		// strtoull
+
+#include "MyUtility/PackageMergeAlgorithm.h"
+#include "MyUtility/StaticPackageMergeAlgorithm.h"
+#include "Benchmark/Workload.h"
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// 基準は NaturalPM (元の実装) とし、各エンジンの結果を次の観点で比べる。
+	//   ・符号化できるかどうかが一致する
+	//   ・符号長が制限内で、重みゼロのシンボルだけが符号長ゼロになり、Kraft の不等式を満たす
+	//   ・Σ 重み × 符号長 が最適 (教科書どおりの素朴なパッケージマージと比べる)
+	//   ・isExact のエンジンは符号長が基準と完全に一致する (同じ重みの並べ方まで同じ)
+	// 乱数は mt19937_64 の生の出力だけを使うので、シードが同じならどの環境でも同じ入力になる
+
+	//! パイプライン版に渡すスレッド数 (ハードウェアによらず並列の経路を通す)
+	const size_t PIPELINE_THREAD = 4;
+
+	// @brief パイプライン版の呼び出し
+	//-------------------------------------------------------------
+	bool CallPipelined(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		return PackageMerge::PipelinedNaturalPM(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, PIPELINE_THREAD);
+	}
+
+	// @brief 形を固定した版の呼び出し (形が一致しなければ BoundaryPM)
+	//-------------------------------------------------------------
+	bool CallStatic(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		if		(arraySize == 286) return StaticBoundaryPM<286, 15>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+		else if (arraySize == 30)  return StaticBoundaryPM<30, 15>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+		else if (arraySize == 19)  return StaticBoundaryPM<19, 7>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+		else if (arraySize == 256 && codeLengthLimit == 11) return StaticBoundaryPM<256, 11>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+		else					   return StaticBoundaryPM<256, 12>::Engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+	}
+
+	// @brief 例外を送出しない版の呼び出し
+	// @note  32bit の重みではパッケージの重みが数えられる範囲を超えないため、STATUS_CAPACITY_EXCEEDED は誤りとして扱う
+	//-------------------------------------------------------------
+	bool ToSucceeded(PackageMerge::Status status)
+	{
+		if (status == PackageMerge::STATUS_CAPACITY_EXCEEDED)
+			throw std::runtime_error("unexpected STATUS_CAPACITY_EXCEEDED");
+
+		return status == PackageMerge::STATUS_SUCCESS;
+	}
+
+	template<PackageMerge::Status(*FUNC)(const unsigned*, size_t, size_t, PackageMerge::Workspace&, unsigned*) noexcept>
+	bool CallStatusAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		return ToSucceeded(FUNC(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+	}
+
+	// @brief 形を固定した版の呼び出し (例外を送出しない版。形が一致しなければ TryBoundaryPM)
+	//-------------------------------------------------------------
+	bool CallStaticStatus(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		if		(arraySize == 286) return ToSucceeded(StaticBoundaryPM<286, 15>::TryEngine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+		else if (arraySize == 30)  return ToSucceeded(StaticBoundaryPM<30, 15>::TryEngine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+		else if (arraySize == 19)  return ToSucceeded(StaticBoundaryPM<19, 7>::TryEngine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+		else if (arraySize == 256 && codeLengthLimit == 11) return ToSucceeded(StaticBoundaryPM<256, 11>::TryEngine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+		else					   return ToSucceeded(StaticBoundaryPM<256, 12>::TryEngine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+	}
+
+	// @brief 結果を std::vector で返す版の呼び出し
+	//-------------------------------------------------------------
+	template<std::vector<unsigned>(*FUNC)(const unsigned*, size_t, size_t)>
+	bool CallVectorAPI(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& /*unused*/, unsigned* pBitLengths)
+	{
+		std::vector<unsigned> result = FUNC(symbolWeights, arraySize, codeLengthLimit);
+		if (result.size() != arraySize)
+			return false;
+
+		std::copy(result.begin(), result.end(), pBitLengths);
+		return true;
+	}
+
+	// @struct 調べるエンジン
+	struct Engine
+	{
+		const char*				 name;
+		PackageMerge::EngineFunc func;
+		bool					 isExact;		//! 符号長が基準と完全に一致するはず
+		bool					 isOptimal;		//! 総ビット数が最適になるはず
+		bool					 isTimed;		//! 速度の退行を調べる
+	};
+
+	const Engine ENGINES[] =
+	{
+		{ "natural",	PackageMerge::NaturalPM,			true,  true,  true },
+		{ "natural-vec",CallVectorAPI<PackageMerge::NaturalPM>,	true,  true,  false },
+		{ "pipelined",	CallPipelined,						true,  true,  false },
+		{ "lazy",		PackageMerge::LazyPM,				true,  true,  true },
+		{ "lazy-vec",	CallVectorAPI<PackageMerge::LazyPM>,	true,  true,  false },
+		{ "boundary",	PackageMerge::BoundaryPM,			true,  true,  true },
+		{ "compact",	PackageMerge::CompactBoundaryPM,	true,  true,  true },
+		{ "static",		CallStatic,							true,  true,  false },
+		{ "divide",		PackageMerge::DivideAndConquerPM,	true,  true,  true },
+		{ "counting",	PackageMerge::CountingPM,			true,  true,  true },
+		{ "hybrid",		PackageMerge::HybridPM,				false, true,  true },
+		{ "heuristic",	PackageMerge::HeuristicLimit,		false, false, true },
+		{ "natural-try",	CallStatusAPI<PackageMerge::TryNaturalPM>,			true,  true,  false },
+		{ "lazy-try",		CallStatusAPI<PackageMerge::TryLazyPM>,				true,  true,  false },
+		{ "boundary-try",	CallStatusAPI<PackageMerge::TryBoundaryPM>,			true,  true,  false },
+		{ "compact-try",	CallStatusAPI<PackageMerge::TryCompactBoundaryPM>,	true,  true,  false },
+		{ "static-try",		CallStaticStatus,									true,  true,  false },
+		{ "divide-try",		CallStatusAPI<PackageMerge::TryDivideAndConquerPM>,	true,  true,  false },
+		{ "counting-try",	CallStatusAPI<PackageMerge::TryCountingPM>,			true,  true,  false },
+		{ "hybrid-try",		CallStatusAPI<PackageMerge::TryHybridPM>,			false, true,  false },
+		{ "heuristic-try",	CallStatusAPI<PackageMerge::TryHeuristicLimit>,		false, false, false },
+	};
+	const size_t NUM_ENGINE = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
+	// @struct コマンドライン設定
+	struct Options
+	{
+		unsigned long long	seed		  = 1;
+		size_t				count		  = 100000;	//! 乱数で作る小さなヒストグラムの数
+		bool				isQuick		  = false;	//! 大きなヒストグラムを省く
+		std::string			baselinePath;				//! 空でなければ速度の退行を調べる
+		double				tolerance	  = 0.25;		//! 基準からの遅れの許容量 (比率)
+		bool				updateBaseline = false;	//! 基準を測り直して書き込む
+		double				minTimeMs	  = 20.0;		//! 1回の計測の最短時間
+		size_t				maxFailure	  = 10;		//! 表示する不一致の数
+	};
+
+	// @struct 集計
+	struct Report
+	{
+		unsigned long long	numCase		= 0;
+		unsigned long long	numImpossible = 0;
+		size_t				numFailure	= 0;
+	};
+
+	// @brief 使い方の表示
+	//-------------------------------------------------------------
+	void PrintUsage()
+	{
+		std::cerr <<
+			"usage: gate [options]\n"
+			"  --seed=S            seed of the random histograms (default 1)\n"
+			"  --count=N           number of small random histograms (default 100000)\n"
+			"  --quick             skip the large histograms\n"
+			"  --baseline=PATH     compare the throughput with PATH (recorded on the first run)\n"
+			"  --tolerance=R       allowed slowdown ratio against the baseline (default 0.25)\n"
+			"  --update-baseline   measure again and overwrite PATH\n"
+			"  --min-time=MS       minimum time of one measurement (default 20)\n";
+	}
+
+	// @brief コマンドライン解析
+	//-------------------------------------------------------------
+	bool ParseOptions(int argc, char* argv[], Options& /*out*/options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			std::string::size_type eq = arg.find('=');
+			std::string key   = arg.substr(0, eq);
+			std::string value = (eq == std::string::npos) ? std::string() : arg.substr(eq + 1);
+
+			if		(key == "--seed")			options.seed = strtoull(value.c_str(), nullptr, 0);
+			else if (key == "--count")			options.count = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--quick")			options.isQuick = true;
+			else if (key == "--baseline")		options.baselinePath = value;
+			else if (key == "--tolerance")		options.tolerance = strtod(value.c_str(), nullptr);
+			else if (key == "--update-baseline") options.updateBaseline = true;
+			else if (key == "--min-time")		options.minTimeMs = strtod(value.c_str(), nullptr);
+			else
+			{
+				PrintUsage();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//-------------------------------------------------------------
+	// 検証
+	//-------------------------------------------------------------
+
+	// @brief 教科書どおりのパッケージマージによる最適な総ビット数
+	// @note  選ばれた項目の重みの和が そのまま Σ 重み × 符号長 になる。符号化できなければ false
+	//-------------------------------------------------------------
+	template<typename WEIGHT>
+	bool ReferenceTotalBits(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, unsigned long long& /*out*/totalBits)
+	{
+		std::vector<unsigned long long> leaves;
+		for (size_t i = 0; i < arraySize; ++i)
+		{
+			if (symbolWeights[i])
+				leaves.push_back(symbolWeights[i]);
+		}
+		std::sort(leaves.begin(), leaves.end());
+
+		totalBits = 0;
+		if (leaves.size() > (1ULL << codeLengthLimit))
+			return false;
+
+		// note: シンボルがひとつだけなら符号長 1 を割り当てる (各エンジンの約束)
+		if (leaves.size() < 2)
+		{
+			totalBits = leaves.empty() ? 0 : leaves[0];
+			return true;
+		}
+
+		std::vector<unsigned long long> items = leaves;
+		std::vector<unsigned long long> packages;
+		for (size_t stage = 1; stage < codeLengthLimit; ++stage)
+		{
+			packages.clear();
+			for (size_t i = 0; i + 1 < items.size(); i += 2)
+				packages.push_back(items[i] + items[i + 1]);
+
+			items.resize(leaves.size() + packages.size());
+			std::merge(leaves.begin(), leaves.end(), packages.begin(), packages.end(), items.begin());
+		}
+		for (size_t i = 0; i < 2 * leaves.size() - 2; ++i)
+			totalBits += items[i];
+
+		return true;
+	}
+
+	// @brief 総ビット数
+	//-------------------------------------------------------------
+	template<typename WEIGHT>
+	unsigned long long TotalBits(const WEIGHT* symbolWeights, const unsigned* pBitLengths, size_t arraySize)
+	{
+		unsigned long long totalBits = 0;
+		for (size_t i = 0; i < arraySize; ++i)
+			totalBits += static_cast<unsigned long long>(symbolWeights[i]) * pBitLengths[i];
+
+		return totalBits;
+	}
+
+	// @brief 符号長の表として正しいか (符号長の制限・重みゼロとの対応・Kraft の不等式)
+	// @return 正しくなければ理由
+	//-------------------------------------------------------------
+	template<typename WEIGHT>
+	const char* ValidateLengths(const WEIGHT* symbolWeights, const unsigned* pBitLengths, size_t arraySize, size_t codeLengthLimit)
+	{
+		size_t numSymbol = 0;
+		for (size_t i = 0; i < arraySize; ++i)
+			numSymbol += (symbolWeights[i] != 0);
+
+		// note: 2^-l の和を 2^-MAX_KRAFT_BITS 単位の整数で数える
+		const unsigned		MAX_KRAFT_BITS = 62;
+		unsigned long long	kraft		   = 0;
+		for (size_t i = 0; i < arraySize; ++i)
+		{
+			unsigned length = pBitLengths[i];
+			if (symbolWeights[i] == 0)
+			{
+				if (length != 0)
+					return "zero weight with a code";
+
+				continue;
+			}
+			if (length > codeLengthLimit || length > MAX_KRAFT_BITS)
+				return "length over the limit";
+
+			// シンボルがひとつだけなら符号長ゼロも許す
+			if (length == 0)
+			{
+				if (numSymbol > 1)
+					return "symbol without a code";
+
+				continue;
+			}
+			kraft += 1ULL << (MAX_KRAFT_BITS - length);
+			if (kraft > (1ULL << MAX_KRAFT_BITS))
+				return "Kraft inequality violated";
+		}
+		return nullptr;
+	}
+
+	// @class 1件ずつ全エンジンを比べる
+	class Checker
+	{
+	public:
+
+		Checker(const Options& options, Report& rReport)
+			: m_options(options)
+			, m_report(rReport)
+			, m_workspaces(NUM_ENGINE)
+			, m_results(NUM_ENGINE)
+		{
+		}
+
+		// @brief 32bit の重みを全エンジンで比べる
+		//-------------------------------------------------------------
+		void Check(const std::vector<unsigned>& weights, size_t codeLengthLimit, const std::string& label)
+		{
+			const size_t arraySize = weights.size();
+			m_report.numCase += 1;
+
+			unsigned long long referenceBits = 0;
+			bool			   isPossible	 = ReferenceTotalBits(weights.data(), arraySize, codeLengthLimit, referenceBits);
+
+			bool baseSucceeded = false;
+			for (size_t e = 0; e < NUM_ENGINE; ++e)
+			{
+				const Engine&		   engine = ENGINES[e];
+				std::vector<unsigned>& result = m_results[e];
+				result.assign(arraySize, 0xCCCCCCCCu);
+
+				bool succeeded = false;
+				try
+				{
+					succeeded = engine.func(weights.data(), arraySize, codeLengthLimit, m_workspaces[e], result.data());
+				}
+				catch (const std::exception& ex)
+				{
+					Fail(label, engine.name, std::string("exception: ") + ex.what(), weights, codeLengthLimit);
+					continue;
+				}
+
+				if (e == 0)
+					baseSucceeded = succeeded;
+
+				if (succeeded != isPossible)
+				{
+					Fail(label, engine.name, succeeded ? "coded an impossible input" : "failed to code", weights, codeLengthLimit);
+					continue;
+				}
+				if (!succeeded)
+					continue;
+
+				if (const char* pReason = ValidateLengths(weights.data(), result.data(), arraySize, codeLengthLimit))
+				{
+					Fail(label, engine.name, pReason, weights, codeLengthLimit);
+					continue;
+				}
+
+				unsigned long long totalBits = TotalBits(weights.data(), result.data(), arraySize);
+				if (engine.isOptimal ? (totalBits != referenceBits) : (totalBits < referenceBits))
+				{
+					std::ostringstream oss;
+					oss << "total bits " << totalBits << " (optimal " << referenceBits << ")";
+					Fail(label, engine.name, oss.str(), weights, codeLengthLimit);
+					continue;
+				}
+				if (engine.isExact && baseSucceeded && result != m_results[0])
+					Fail(label, engine.name, "lengths differ from natural", weights, codeLengthLimit);
+			}
+
+			if (!isPossible)
+				m_report.numImpossible += 1;
+		}
+
+		// @brief 16bit / 64bit の重みを受け付ける版を比べる
+		//-------------------------------------------------------------
+		template<typename WEIGHT>
+		void CheckWidth(const std::vector<WEIGHT>& weights, size_t codeLengthLimit, const std::string& label)
+		{
+			const size_t arraySize = weights.size();
+			m_report.numCase += 1;
+
+			unsigned long long referenceBits = 0;
+			bool			   isPossible	 = ReferenceTotalBits(weights.data(), arraySize, codeLengthLimit, referenceBits);
+
+			// note: 64bit の合計が溢れる入力は作らないため、符号化できるかどうかは素朴な実装と一致する
+			std::vector<unsigned> natural(arraySize), boundary(arraySize);
+			bool naturalSucceeded  = PackageMerge::NaturalPM(weights.data(), arraySize, codeLengthLimit, m_workspaces[0], natural.data());
+			bool boundarySucceeded = PackageMerge::BoundaryPM(weights.data(), arraySize, codeLengthLimit, m_workspaces[0], boundary.data());
+
+			// 例外を送出しない版も同じ結果になる
+			std::vector<unsigned> tryNatural(arraySize), tryBoundary(arraySize);
+			PackageMerge::Status naturalStatus	= PackageMerge::TryNaturalPM(weights.data(), arraySize, codeLengthLimit, m_workspaces[0], tryNatural.data());
+			PackageMerge::Status boundaryStatus	= PackageMerge::TryBoundaryPM(weights.data(), arraySize, codeLengthLimit, m_workspaces[0], tryBoundary.data());
+			PackageMerge::Status expectedStatus	= isPossible ? PackageMerge::STATUS_SUCCESS : PackageMerge::STATUS_IMPOSSIBLE_CODING;
+
+			std::vector<unsigned> dummy;
+			if (naturalSucceeded != isPossible || boundarySucceeded != isPossible)
+			{
+				Fail(label, "natural/boundary (wide)", "success differs from the reference", dummy, codeLengthLimit);
+				return;
+			}
+			if (naturalStatus != expectedStatus || boundaryStatus != expectedStatus)
+			{
+				Fail(label, "natural/boundary-try (wide)", "status differs from the reference", dummy, codeLengthLimit);
+				return;
+			}
+			if (!isPossible)
+			{
+				m_report.numImpossible += 1;
+				return;
+			}
+
+			const char* pReason = ValidateLengths(weights.data(), natural.data(), arraySize, codeLengthLimit);
+			if (pReason == nullptr && TotalBits(weights.data(), natural.data(), arraySize) != referenceBits)
+				pReason = "total bits not optimal";
+			if (pReason == nullptr && natural != boundary)
+				pReason = "natural and boundary differ";
+			if (pReason == nullptr && (natural != tryNatural || boundary != tryBoundary))
+				pReason = "status API differs";
+
+			if (pReason)
+				Fail(label, "natural/boundary (wide)", pReason, dummy, codeLengthLimit);
+		}
+
+	private:
+
+		// @brief 不一致の報告
+		//-------------------------------------------------------------
+		void Fail(const std::string& label, const char* engineName, const std::string& reason, const std::vector<unsigned>& weights, size_t codeLengthLimit)
+		{
+			m_report.numFailure += 1;
+			if (m_report.numFailure > m_options.maxFailure)
+				return;
+
+			std::cout << "FAIL [" << engineName << "] " << label << " L=" << codeLengthLimit << ": " << reason << "\n";
+			if (!weights.empty() && weights.size() <= 64)
+			{
+				std::cout << "  weights:";
+				for (unsigned w : weights)
+					std::cout << " " << w;
+				std::cout << "\n";
+			}
+		}
+
+		const Options&						m_options;
+		Report&								m_report;
+		std::vector<PackageMerge::Workspace> m_workspaces;	//! エンジンごと (使い回しによる汚染も調べる)
+		std::vector<std::vector<unsigned>>	m_results;		//! エンジンごと
+	};
+
+	//-------------------------------------------------------------
+	// 入力の生成
+	//-------------------------------------------------------------
+
+	// @brief 小さなヒストグラムをひとつ作る
+	// @note  同じ重みや重みゼロが多いもの、深い木になるもの、合計が 32bit を超えるものを混ぜる
+	//-------------------------------------------------------------
+	std::vector<unsigned> MakeSmallHistogram(std::mt19937_64& rng, size_t& /*out*/codeLengthLimit)
+	{
+		size_t				  arraySize = static_cast<size_t>(rng() % 41);
+		std::vector<unsigned> weights(arraySize);
+		codeLengthLimit = 1 + static_cast<size_t>(rng() % 16);
+
+		switch (rng() % 6)
+		{
+		case 0:	// 同じ重みとゼロが多い
+			for (unsigned& w : weights)
+				w = static_cast<unsigned>(rng() % 4);
+			break;
+
+		case 1:	// 一様
+			for (unsigned& w : weights)
+				w = 1 + static_cast<unsigned>(rng() % 1024);
+			break;
+
+		case 2:	// 指数的 (符号長の制限が効く)
+			for (unsigned& w : weights)
+				w = 1u << (rng() % 31);
+			break;
+
+		case 3:	// 32bit いっぱいの重み (合計は 64bit で数える)
+			for (unsigned& w : weights)
+				w = static_cast<unsigned>(0xFFFFFFFFu - rng() % 0x1000);
+			break;
+
+		case 4:	// 全部同じ
+		{
+			unsigned value = 1 + static_cast<unsigned>(rng() % 0xFFFFFFFFu);
+			for (unsigned& w : weights)
+				w = value;
+			break;
+		}
+		default: // フィボナッチ風 (最も深い木)
+		{
+			unsigned long long a = 1, b = 1;
+			for (unsigned& w : weights)
+			{
+				w = static_cast<unsigned>(a);
+				unsigned long long c = std::min<unsigned long long>(a + b, 0xFFFFFFFFu);
+				a = b;
+				b = c;
+			}
+			for (size_t i = weights.size(); i > 1; --i)
+				std::swap(weights[i - 1], weights[static_cast<size_t>(rng() % i)]);
+			break;
+		}
+		}
+		return weights;
+	}
+
+	// @brief 端のケース
+	//-------------------------------------------------------------
+	void CheckEdgeCases(Checker& rChecker, std::mt19937_64& rng)
+	{
+		// シンボル数 2 以下
+		for (size_t n = 0; n <= 2; ++n)
+		{
+			for (size_t limit = 1; limit <= 20; ++limit)
+			{
+				rChecker.Check(std::vector<unsigned>(n, 1), limit, "n<=2 ones");
+				rChecker.Check(std::vector<unsigned>(n, 0xFFFFFFFFu), limit, "n<=2 max");
+				rChecker.Check(std::vector<unsigned>(n, 0), limit, "n<=2 zeros");
+
+				std::vector<unsigned> padded(n + 5, 0);
+				for (size_t i = 0; i < n; ++i)
+					padded[(i * 3 + 1) % padded.size()] = 1 + static_cast<unsigned>(rng() % 100);
+				rChecker.Check(padded, limit, "n<=2 padded");
+			}
+		}
+
+		// n = 2^L ちょうど (すべて符号長 L になる) とひとつ多い場合 (符号化できない)
+		for (size_t limit = 1; limit <= 12; ++limit)
+		{
+			size_t n = size_t(1) << limit;
+			rChecker.Check(std::vector<unsigned>(n, 7), limit, "n=2^L equal");
+			rChecker.Check(std::vector<unsigned>(n + 1, 7), limit, "n=2^L+1 equal");
+
+			std::vector<unsigned> weights(n);
+			for (unsigned& w : weights)
+				w = 1 + static_cast<unsigned>(rng() % 0xFFFFFFFFu);
+			rChecker.Check(weights, limit, "n=2^L random");
+
+			weights.push_back(1);
+			rChecker.Check(weights, limit, "n=2^L+1 random");
+		}
+
+		// 全部同じ重み
+		for (size_t n : { 3, 5, 17, 100, 286, 1000, 4097 })
+		{
+			for (size_t limit : { 4, 7, 9, 12, 15, 24, 32 })
+			{
+				rChecker.Check(std::vector<unsigned>(n, 1), limit, "all equal 1");
+				rChecker.Check(std::vector<unsigned>(n, 0xFFFFFFFFu), limit, "all equal max");
+			}
+		}
+
+		// 合計が 32bit を大きく超える
+		for (size_t n : { 3, 40, 286, 4096 })
+		{
+			for (size_t limit : { 12, 15, 20, 32 })
+			{
+				std::vector<unsigned> weights(n);
+				for (unsigned& w : weights)
+					w = 0x80000000u + static_cast<unsigned>(rng() % 0x80000000u);
+				rChecker.Check(weights, limit, "huge weights");
+			}
+		}
+	}
+
+	// @brief 16bit / 64bit の重み
+	//-------------------------------------------------------------
+	void CheckWidthCases(Checker& rChecker, std::mt19937_64& rng, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t arraySize = 1 + static_cast<size_t>(rng() % 64);
+			size_t limit	 = 1 + static_cast<size_t>(rng() % 20);
+
+			std::vector<unsigned short> narrow(arraySize);
+			for (unsigned short& w : narrow)
+				w = static_cast<unsigned short>(rng() % 3 ? rng() : 0);
+			rChecker.CheckWidth(narrow, limit, "16bit weights");
+
+			// note: 2^44 までの重みなら 64 要素 × 20 ステージでも合計は 64bit に収まる
+			std::vector<unsigned long long> wide(arraySize);
+			for (unsigned long long& w : wide)
+				w = (rng() % 4) ? (rng() >> (20 + rng() % 40)) : 0;
+			rChecker.CheckWidth(wide, limit, "64bit weights");
+		}
+	}
+
+	// @brief ベンチマークと同じ分布の中・大きなヒストグラム
+	//-------------------------------------------------------------
+	void CheckWorkloads(Checker& rChecker, unsigned long long seed, bool isQuick)
+	{
+		using Benchmark::Distribution;
+		const std::vector<unsigned char> noFile;
+		const Distribution dists[] = { Distribution::Uniform, Distribution::Zipf, Distribution::Geometric, Distribution::Sparse };
+
+		for (Distribution dist : dists)
+		{
+			for (size_t n : { 19, 30, 256, 286, 4096 })
+			{
+				for (size_t limit : { 7, 9, 11, 12, 15, 16, 20, 24, 32 })
+				{
+					for (unsigned long long s = 0; s < 4; ++s)
+						rChecker.Check(Benchmark::MakeWorkload(dist, n, seed + s, noFile), limit, std::string("workload ") + Benchmark::ToString(dist) + " n=" + std::to_string(n));
+				}
+			}
+			if (isQuick)
+				continue;
+
+			// note: パイプライン版が並列の経路を通る大きさ
+			for (size_t n : { 20000, 65536 })
+			{
+				for (size_t limit : { 17, 20, 24 })
+					rChecker.Check(Benchmark::MakeWorkload(dist, n, seed, noFile), limit, std::string("workload ") + Benchmark::ToString(dist) + " n=" + std::to_string(n));
+			}
+		}
+	}
+
+	// @brief 結果の一致を調べる
+	// @return すべて一致したら true
+	//-------------------------------------------------------------
+	bool RunEquivalence(const Options& options)
+	{
+		auto	beginTime = std::chrono::steady_clock::now();
+		Report	report;
+		Checker	checker(options, report);
+		std::mt19937_64 rng(options.seed);
+
+		CheckEdgeCases(checker, rng);
+		CheckWidthCases(checker, rng, options.count / 10 + 1);
+		CheckWorkloads(checker, options.seed, options.isQuick);
+
+		for (size_t i = 0; i < options.count; ++i)
+		{
+			size_t				  limit;
+			std::vector<unsigned> weights = MakeSmallHistogram(rng, /*out*/limit);
+			checker.Check(weights, limit, "random #" + std::to_string(i));
+		}
+
+		double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+		std::cout << "equivalence: " << report.numCase << " histograms (" << report.numImpossible << " impossible), "
+				  << report.numFailure << " failures, " << std::fixed << std::setprecision(0) << elapsedMs << " ms\n";
+
+		return report.numFailure == 0;
+	}
+
+	//-------------------------------------------------------------
+	// 速度
+	//-------------------------------------------------------------
+
+	// @brief エンジンひとつの所要時間 (固定の入力一式を 1周する時間 [us]。何度か測った最小値)
+	//-------------------------------------------------------------
+	double MeasureEngine(const Engine& engine, const std::vector<std::pair<std::vector<unsigned>, size_t>>& inputs, double minTimeMs)
+	{
+		const size_t			NUM_ROUND = 5;
+		PackageMerge::Workspace	workspace;
+		std::vector<unsigned>	result;
+		double					bestUs = 0.0;
+
+		for (size_t round = 0; round < NUM_ROUND; ++round)
+		{
+			size_t numLoop	 = 0;
+			auto   beginTime = std::chrono::steady_clock::now();
+			double elapsedMs = 0.0;
+			do
+			{
+				for (const auto& input : inputs)
+				{
+					result.resize(input.first.size());
+					engine.func(input.first.data(), input.first.size(), input.second, workspace, result.data());
+				}
+				numLoop	 += 1;
+				elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+			} while (elapsedMs < minTimeMs);
+
+			double us = elapsedMs * 1000.0 / numLoop;
+			if (round == 0 || us < bestUs)
+				bestUs = us;
+		}
+		return bestUs;
+	}
+
+	// @brief 基準の読み込み
+	//-------------------------------------------------------------
+	bool LoadBaseline(const std::string& path, std::map<std::string, double>& /*out*/baseline)
+	{
+		std::ifstream ifs(path);
+		if (!ifs)
+			return false;
+
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			std::istringstream iss(line);
+			std::string		   name;
+			double			   us;
+			if (iss >> name >> us)
+				baseline[name] = us;
+		}
+		return true;
+	}
+
+	// @brief 基準の書き込み
+	//-------------------------------------------------------------
+	bool SaveBaseline(const std::string& path, const std::map<std::string, double>& baseline)
+	{
+		std::ofstream ofs(path);
+		ofs << "# gate throughput baseline: microseconds per round of the fixed inputs (smaller is faster)\n";
+		for (const auto& entry : baseline)
+			ofs << entry.first << " " << std::fixed << std::setprecision(3) << entry.second << "\n";
+
+		return static_cast<bool>(ofs);
+	}
+
+	// @brief 速度の退行を調べる
+	// @return 退行がなければ true
+	//-------------------------------------------------------------
+	bool RunPerformance(const Options& options)
+	{
+		using Benchmark::Distribution;
+		const std::vector<unsigned char> noFile;
+
+		// 固定の入力一式 (Deflate 相当の小さな表から大きな表まで)
+		std::vector<std::pair<std::vector<unsigned>, size_t>> inputs;
+		inputs.emplace_back(Benchmark::MakeWorkload(Distribution::Zipf,		 286,	1, noFile), 15);
+		inputs.emplace_back(Benchmark::MakeWorkload(Distribution::Uniform,	 30,	1, noFile), 15);
+		inputs.emplace_back(Benchmark::MakeWorkload(Distribution::Geometric, 256,	1, noFile), 12);
+		inputs.emplace_back(Benchmark::MakeWorkload(Distribution::Geometric, 4096,	1, noFile), 16);
+		inputs.emplace_back(Benchmark::MakeWorkload(Distribution::Sparse,	 65536, 1, noFile), 20);
+
+		std::map<std::string, double> baseline;
+		bool hasBaseline = !options.updateBaseline && LoadBaseline(options.baselinePath, baseline);
+
+		bool isOk	   = true;
+		bool isChanged = false;
+		for (const Engine& engine : ENGINES)
+		{
+			if (!engine.isTimed)
+				continue;
+
+			double us = MeasureEngine(engine, inputs, options.minTimeMs);
+			std::cout << "  " << std::left << std::setw(10) << engine.name << std::right << std::fixed << std::setprecision(1) << std::setw(10) << us << " us";
+
+			auto it = baseline.find(engine.name);
+			if (it == baseline.end())
+			{
+				// 基準にないエンジンは今回の値を基準にする
+				baseline[engine.name] = us;
+				isChanged = true;
+				std::cout << "  (recorded)\n";
+				continue;
+			}
+
+			double ratio = us / it->second;
+			bool   isSlow = ratio > 1.0 + options.tolerance;
+			std::cout << "  x" << std::setprecision(2) << ratio << (isSlow ? "  REGRESSION" : "") << "\n";
+			isOk = isOk && !isSlow;
+		}
+
+		if (isChanged && !SaveBaseline(options.baselinePath, baseline))
+		{
+			std::cout << "cannot write the baseline: " << options.baselinePath << "\n";
+			return false;
+		}
+		std::cout << "performance: " << (isOk ? "ok" : "regressed") << (hasBaseline ? "" : " (baseline recorded)")
+				  << " tolerance " << std::setprecision(0) << options.tolerance * 100.0 << "%\n";
+		return isOk;
+	}
+}
+
+//! @brief main
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+		return 1;
+
+	bool isOk = true;
+	if (options.count || options.baselinePath.empty())
+		isOk = RunEquivalence(options);
+
+	if (!options.baselinePath.empty())
+		isOk = RunPerformance(options) && isOk;
+
+	return isOk ? 0 : 1;
+}
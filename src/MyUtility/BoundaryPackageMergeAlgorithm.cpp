@@ -1,406 +1,554 @@
-﻿//-------------------------------------------------------------
-//! @brief	境界パッケージマージアルゴリズム
-//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
-//-------------------------------------------------------------
-
-//-------------------------------------------------------------
-// include
-//-------------------------------------------------------------
-#include "PackageMergeAlgorithm.h"
-#include <algorithm>	// std::sort
-#include <memory>
-
-//-------------------------------------------------------------
-// using
-//-------------------------------------------------------------
-using namespace MyUtility;
-
-//-------------------------------------------------------------
-// inner
-//-------------------------------------------------------------
-namespace
-{
-	// @struct シンボル単体情報
-	struct SingleSimbol
-	{
-		unsigned		   alphabet = 0;		//! シンボル識別子
-		unsigned		   weight   = 0;		//!	重み (出現回数)
-
-		SingleSimbol()
-		{}
-
-		SingleSimbol(unsigned	alp, unsigned wei)
-			: alphabet(alp)
-			, weight(wei)
-		{}
-	};
-
-	// @struct ノード情報(Boundary)
-	struct BoundaryPMNode
-	{
-	public:
-
-		unsigned long long	weight				= 0;			//!	重み (出現回数)
-		size_t				singleSimbleCount	= 0;			//! このノードの重み以下の重みを持つシンボル単体の数（このノードを含める）
-		BoundaryPMNode*		pNextChainNode		= nullptr;		//! ツリー右側のノードへのポインタ
-		bool				ref					= false;		//! 使用中(poolから貸し出されている場合)
-
-		BoundaryPMNode()
-		{}
-		BoundaryPMNode(unsigned wei, BoundaryPMNode* pChain, size_t numMinRank)
-			: weight(wei)
-			, singleSimbleCount(numMinRank)
-			, pNextChainNode(pChain)
-		{}
-		BoundaryPMNode(BoundaryPMNode* left, BoundaryPMNode* right, size_t numMinRank)
-			: weight(left->weight + right->weight)
-			, singleSimbleCount(numMinRank)
-			, pNextChainNode(right)
-		{}
-
-		void operator=(const BoundaryPMNode& base)
-		{
-			// ref を除く
-			weight			  = base.weight;
-			singleSimbleCount = base.singleSimbleCount;
-			pNextChainNode    = base.pNextChainNode;
-		}
-	};
-
-	// @class 超簡易ノードプール
-	class BoundaryPMNodePool
-	{
-	public:
-
-		// @brief 貸出
-		//---------------------------------------------------------
-		BoundaryPMNode* Borrow()
-		{
-			for (size_t i = 0; i < m_pool.size(); ++i, ++m_nextIdx)
-			{
-				if (m_nextIdx >= m_pool.size())
-					m_nextIdx = 0;
-
-				if (!m_pool[m_nextIdx].ref)
-				{
-					m_pool[m_nextIdx].ref = true;
-					return &m_pool[m_nextIdx++];
-				}
-			}
-			return nullptr;
-		}
-		// @brief 貸出 or 例外
-		//---------------------------------------------------------
-		BoundaryPMNode* BorrowOrException()
-		{
-			BoundaryPMNode* erem = Borrow();
-			if (erem == nullptr)
-				throw std::runtime_error("プールに空きがないっぽい");
-
-			return erem;
-		}
-
-		// @brief 返却
-		//---------------------------------------------------------
-		void Return(BoundaryPMNode* p)
-		{
-			p->ref = false;
-		}
-
-		// @brief すべての参照を開放
-		//---------------------------------------------------------
-		void AllReleaseRef()
-		{
-			for (size_t i = 0; i < m_pool.size(); ++i)
-				m_pool[i].ref = false;
-		}
-
-		BoundaryPMNodePool(size_t size)
-			:m_pool(size)
-		{}
-
-	private:
-		std::vector<BoundaryPMNode> m_pool;
-		unsigned					m_nextIdx = 0;
-	};
-	// using
-	using SingleSymbolList    = std::vector<SingleSimbol>;
-
-	// @struct 先読みチェーン
-	union LookAheadChain
-	{
-		union
-		{
-			struct Pair
-			{
-				BoundaryPMNode*	pFirst;
-				BoundaryPMNode*	pSecond;
-			};
-
-			Pair				pair;
-			BoundaryPMNode*		pElements[2];
-		};
-
-		// @brief  先読みチェーンの合計の重みを返す
-		//-------------------------------------------------------------
-		inline static unsigned long long GetWeight(const LookAheadChain& lookahead)
-		{
-			if (lookahead.pair.pFirst == nullptr || lookahead.pair.pSecond == nullptr)
-				throw std::runtime_error("nullが来るのはあり得ない");
-
-			return (lookahead.pair.pFirst->weight + lookahead.pair.pSecond->weight);
-		}
-	};
-
-	// @brief  該当の先読みチェーンがパッケージに利用されている
-	//-------------------------------------------------------------
-	inline bool IsUsedByPackage(const LookAheadChain& rLookaheadTree, const BoundaryPMNode& rPackageNode)
-	{
-		return (rLookaheadTree.pair.pSecond == rPackageNode.pNextChainNode);
-	}
-
-	// @brief 実際に使われているシンボルを抽出
-	//-------------------------------------------------------------
-	void ExtractSymbolList(const unsigned* symbolWeights, size_t arraySize, SingleSymbolList& /*out*/list)
-	{
-		// 重みがゼロであるシンボルは利用されていないとみなし、
-		// 重みのあるシンボルだけを抽出してリスト化する
-		for (unsigned i = 0; i < arraySize; ++i)
-		{
-			if (symbolWeights[i])
-				list.push_back(SingleSimbol(i, symbolWeights[i]));
-		}
-		// 重みの昇順にソート
-		std::sort(list.begin(), list.end(),
-			[](const SingleSimbol& left, const SingleSimbol& right)
-		{
-			if (left.weight != right.weight)
-				return left.weight < right.weight;
-
-			return left.alphabet < right.alphabet;
-		});
-	}
-
-	// @brief 長さテーブル構築
-	// @note  rSymbolList は 事前に重みの昇順にソートされているものとする
-	// @note  bitlengths  は 事前に resize() 等で必要な領域を割り当てておくこと
-	//-------------------------------------------------------------
-	void ExtractBitLengths(size_t singleSymbolCount, const SingleSymbolList& rSymbolList, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		for (size_t i = 0; i < singleSymbolCount; ++i)
-		{
-			unsigned alphabetIdx = rSymbolList.at(i).alphabet;
-			bitlengths[alphabetIdx] += 1;
-		}
-	}
-	//-------------------------------------------------------------
-	void ExtractBitLengths(const BoundaryPMNode* pNode, const SingleSymbolList& rSymbolList, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		if (pNode == nullptr)
-			throw std::runtime_error("nullが来るのはあり得ない");
-
-		if (pNode->pNextChainNode)
-		{
-			ExtractBitLengths(pNode->pNextChainNode, rSymbolList, /*out*/bitlengths);
-		}
-		// note: 
-		// このノードの置かれているステージ上で、
-		// このノードよりも重みの小さな(このシンボルよりも先に現れた)
-		// シンボル単体の符号長をインクリメントする
-		ExtractBitLengths(pNode->singleSimbleCount, rSymbolList, /*out*/ bitlengths);
-	}
-	//-------------------------------------------------------------
-	std::vector<unsigned> BuildBitLengthsArray(size_t singleSymbolCount, const SingleSymbolList& rSymbolList, size_t arraySize)
-	{
-		std::vector<unsigned> bitLengthsList(arraySize);
-		ExtractBitLengths(singleSymbolCount, rSymbolList, /*out*/bitLengthsList);
-		return bitLengthsList;
-	}
-	//-------------------------------------------------------------
-	std::vector<unsigned> BuildBitLengthsArray(const BoundaryPMNode* pNode, const SingleSymbolList& rSymbolList, size_t arraySize)
-	{
-		std::vector<unsigned> bitLengthsList(arraySize);
-		ExtractBitLengths(pNode, rSymbolList, /*out*/bitLengthsList);
-		return bitLengthsList;
-	}
-
-	// @brief シンボル単体のノードを作成
-	//-------------------------------------------------------------
-	BoundaryPMNode* CreateSymbolNode(const BoundaryPMNode& rSymbolNode, BoundaryPMNodePool& /*ref*/rPool)
-	{
-		BoundaryPMNode* pNode = rPool.BorrowOrException();
-		*pNode = rSymbolNode;
-
-		return pNode;
-	}
-
-	// @brief ステージ数だけの先読みチェーンリストを作成
-	//-------------------------------------------------------------
-	std::vector<LookAheadChain> CreateInitialLookAheadPairs(const SingleSimbol& firstSymbol, const SingleSimbol& secondSymbol, size_t numStage, BoundaryPMNodePool& /*ref*/rPool)
-	{
-		std::vector<LookAheadChain> result;
-		result.resize(numStage);
-
-		// すべてのステージの先読みチェーンは
-		// シンボルリスト中の一番目、二番目に小さな重みをもつシンボルで初期化される
-		for (size_t i = 0; i < numStage; ++i)
-		{
-			result[i].pair.pFirst  = CreateSymbolNode(BoundaryPMNode(firstSymbol.weight, nullptr, 1), rPool);
-			result[i].pair.pSecond = CreateSymbolNode(BoundaryPMNode(secondSymbol.weight,nullptr, 2), rPool);
-		}
-		return result;
-	}
-	// @brief 使用可能なノードを見つけて返す
-	//-------------------------------------------------------------
-	BoundaryPMNode* FindFreeNode(BoundaryPMNodePool& rPool, std::vector<LookAheadChain>& rCurrentUsingTreeList)
-	{
-		auto nextElem = rPool.Borrow();
-		if (nextElem != nullptr)
-			return nextElem;
-
-		// 空きがない -> ガーベジコレクション
-		rPool.AllReleaseRef();
-
-		for(LookAheadChain& lookaheadTree : rCurrentUsingTreeList)
-		{
-			for (auto node = lookaheadTree.pair.pFirst; node; node = node->pNextChainNode)
-				node->ref = true;
-
-			for (auto node = lookaheadTree.pair.pSecond; node; node = node->pNextChainNode)
-				node->ref = true;
-		}
-		return rPool.BorrowOrException();
-	}
-
-	// @brief 次のノード要素を選択して返す
-	//-------------------------------------------------------------
-	BoundaryPMNode ChooseNextNode(const SingleSymbolList& singleSymbolList, const LookAheadChain& lookaheadTree, const BoundaryPMNode& beforeNode)
-	{
-		size_t nextSymbolIndex = beforeNode.singleSimbleCount;
-
-		// note: SymbolListを読み切っているため、残りはすべてパッケージ
-		if (nextSymbolIndex >= singleSymbolList.size())
-			return BoundaryPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond, nextSymbolIndex);
-
-		// note:
-		// 重みの小さなノードが先に返る。
-		// 重みが等しい場合はパッケージが優先
-		unsigned long long nextSymbolWeight  = singleSymbolList[nextSymbolIndex].weight;
-		unsigned long long nextPackageWeight = LookAheadChain::GetWeight(lookaheadTree);
-
-		// note: シンボル単体が選ばれた場合は、直前のノードが持つチェインノードを引き継ぐ
-		if (nextSymbolWeight < nextPackageWeight)
-			return BoundaryPMNode(singleSymbolList[nextSymbolIndex].weight, beforeNode.pNextChainNode, nextSymbolIndex +1);
-		else
-			return BoundaryPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond, nextSymbolIndex);
-
-	}
-	// @brief 再帰的に先読みチェーンを再構築する
-	//-------------------------------------------------------------
-	void IncrementLookAheadTreeRecursive(std::vector<LookAheadChain>& rLookAheadTreeList, size_t stageIdx, const SingleSymbolList& symbolList, BoundaryPMNodePool& rPool)
-	{
-		auto *pBeforeNode = rLookAheadTreeList[stageIdx].pair.pSecond;
-
-		// 上にステージがないためシンボル単体を加えるだけ。
-		if (stageIdx == 0)
-		{
-			for (size_t i = 0; i < 2; ++i)
-			{
-				size_t nextSymbolIndex = pBeforeNode->singleSimbleCount;
-				if (nextSymbolIndex >= symbolList.size())
-					return;
-
-				// note: チェインで参照されていなければ 次のFindFreeNode()時に回収される
-				rLookAheadTreeList[0].pElements[i] = nullptr;
-
-				rLookAheadTreeList[0].pElements[i]  = FindFreeNode(rPool, rLookAheadTreeList);
-				*rLookAheadTreeList[0].pElements[i] = BoundaryPMNode(symbolList[nextSymbolIndex].weight, pBeforeNode->pNextChainNode, nextSymbolIndex + 1);
-
-				pBeforeNode = rLookAheadTreeList[0].pElements[i];
-			}
-			return;
-		}
-		// 上にステージがある場合は シンボル単体 または パッケージで再構築
-		for (size_t i = 0; i < 2; ++i)
-		{
-			rLookAheadTreeList[stageIdx].pElements[i] = nullptr;
-
-			auto   *pNextNode   = FindFreeNode(rPool, rLookAheadTreeList);
-			size_t prevStageIdx = stageIdx - 1;
-
-			*pNextNode = ChooseNextNode(/*single symbol*/ symbolList,
-										/*or package*/ rLookAheadTreeList[prevStageIdx],
-										/*with before node*/ *pBeforeNode);
-
-			rLookAheadTreeList[stageIdx].pElements[i] = pNextNode;
-
-			if (IsUsedByPackage(rLookAheadTreeList[prevStageIdx], *pNextNode))
-				IncrementLookAheadTreeRecursive(rLookAheadTreeList, prevStageIdx, symbolList, rPool);
-
-			pBeforeNode = pNextNode;
-		}
-	}
-}
-
-//-------------------------------------------------------------
-// function
-//-------------------------------------------------------------
-
-// @brief 境界パッケージマージアルゴリズム
-//-------------------------------------------------------------	
-std::vector<unsigned> PackageMerge::BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
-{
-	SingleSymbolList symbolList;
-	ExtractSymbolList(symbolWeights, arraySize, /*out*/symbolList);
-
-	if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
-		return std::vector<unsigned>();
-
-	if (symbolList.size() <= 1)
-		return BuildBitLengthsArray(symbolList.size(), symbolList, arraySize);
-
-	// 無駄を軽減
-	if (codeLengthLimit > symbolList.size())
-		codeLengthLimit = symbolList.size();
-
-	// 必要なプールの容量 = L(L+1) 
-	// 各ステージは先読みチェーン(look ahead chain)を保有する。
-	// ここで、一番上のステージにはシンボル単体のノードしかないため、参照するノード数は 自身のノードのみの「1」
-	// それより下のステージでは、チェインで上のステージのノードを参照するため、
-	// 上にあるステージの数だけ、最大で「2,3,4」だけのノード参照する
-	// ステージの数を L としたとき、ここまでのルールに従うならば同時に参照するノード数の最大は
-	// L + L-1 + ... + 1 
-	//	=(L+1) * L/2
-	//
-	// 先読みチェーンは各ステージにつき 2つのノードを保有するため、
-	// 
-	// (L+1) * L/2*2 
-	//	= L(L+1) がステージ数 L に対して必要とされるプールの容量になる
-	//
-	// 今回は処理の都合で最下段のステージを作らないため、必要になるプールの容量は
-	//  = L(L-1) になる
-	BoundaryPMNodePool pool(codeLengthLimit * (codeLengthLimit-1) );
-
-	// 処理の都合で、最下段のステージは作らない (codeLengthLimit - 1)
-	auto lookaheadStageList  = CreateInitialLookAheadPairs(symbolList[0], symbolList[1], codeLengthLimit-1, pool);
-
-	// 現状リスト最下段の一番右側にあるアクティブなチェインノード。以降のループ処理で順々にシフトする
-	BoundaryPMNode rightistChainNode( symbolList[1].weight, nullptr, 2);
-
-	// 最終的にでそろうノードの数は、ステージ数(制限符号長)にかかわらず、シンボル数を n としたとき 2n-2 の数だけとなる
-	// 直前の操作ですでに2つのノードを処理済みなので、i=2から始める
-	size_t numLastStageNode = (2 * symbolList.size()) - 2;
-	for (size_t i = 2; i < numLastStageNode; ++i)
-	{
-		rightistChainNode = ChooseNextNode(/*single symbol*/symbolList,
-										   /*or package*/*lookaheadStageList.rbegin(), 
-										   /*with before node*/rightistChainNode);
-
-		if (/*next continue?*/(i + 1) < numLastStageNode)
-		{
-			if(IsUsedByPackage(*lookaheadStageList.rbegin(),rightistChainNode))
-				IncrementLookAheadTreeRecursive(lookaheadStageList, lookaheadStageList.size() - 1, symbolList, pool);
-		}
-	}
-	return BuildBitLengthsArray(&rightistChainNode, symbolList, arraySize);
-}
+//-------------------------------------------------------------
+//! @brief	境界パッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill
+#include <cassert>
+#include <memory>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// 以下の型はパッケージの重みを数える型 SUM ごとに作る。
+	// 重みの合計 × 制限符号長 が 32bit に収まる場合は 32bit で数え、ノードが 24byte に縮む (64bit では 32byte)
+
+	// @struct シンボル単体情報
+	template<class SUM>
+	struct SingleSimbol
+	{
+		unsigned		   alphabet = 0;		//! シンボル識別子
+		SUM				   weight   = 0;		//!	重み (出現回数)
+
+		SingleSimbol()
+		{}
+
+		SingleSimbol(unsigned	alp, SUM wei)
+			: alphabet(alp)
+			, weight(wei)
+		{}
+	};
+
+	// @struct ノード情報(Boundary)
+	// @note  32bit の重みと参照カウントが 8byte に収まるよう、ポインタを先に並べる
+	template<class SUM>
+	struct BoundaryPMNode
+	{
+	public:
+
+		BoundaryPMNode*		pNextChainNode		= nullptr;		//! ツリー右側のノードへのポインタ (プールの空きリストでは次の空きノード)
+		size_t				singleSimbleCount	= 0;			//! このノードの重み以下の重みを持つシンボル単体の数（このノードを含める）
+		SUM					weight				= 0;			//!	重み (出現回数)
+		unsigned			refCount			= 0;			//! 参照カウント (先読みチェーンとチェインノードからの参照数)
+
+		BoundaryPMNode()
+		{}
+		BoundaryPMNode(SUM wei, BoundaryPMNode* pChain, size_t numMinRank)
+			: pNextChainNode(pChain)
+			, singleSimbleCount(numMinRank)
+			, weight(wei)
+		{}
+		BoundaryPMNode(BoundaryPMNode* left, BoundaryPMNode* right, size_t numMinRank)
+			: pNextChainNode(right)
+			, singleSimbleCount(numMinRank)
+			, weight(left->weight + right->weight)
+		{}
+
+		void operator=(const BoundaryPMNode& base)
+		{
+			// refCount を除く
+			weight			  = base.weight;
+			singleSimbleCount = base.singleSimbleCount;
+			pNextChainNode    = base.pNextChainNode;
+		}
+	};
+
+	// @class 超簡易ノードプール
+	// @note  空きノードは pNextChainNode でつないだ空きリストで管理し、
+	//        参照カウントがゼロになった時点で空きリストへ戻す。
+	//        貸出・返却ともに O(1) で、プール全体を走査するガーベジコレクションは行わない
+	template<class SUM>
+	class BoundaryPMNodePool
+	{
+	public:
+		using BoundaryPMNode = ::BoundaryPMNode<SUM>;
+
+		// @brief 貸出 (参照カウント 1 で返す)
+		//---------------------------------------------------------
+		BoundaryPMNode* Borrow(const BoundaryPMNode& value)
+		{
+			// note: 容量 L(L+1) は同時に参照するノード数の最大を上回るため、空きが尽きることはない (RunBoundaryPM を参照)
+			BoundaryPMNode* pNode = m_pFreeList;
+			assert(pNode != nullptr && "プールに空きがないっぽい");
+
+			m_pFreeList = pNode->pNextChainNode;
+
+			*pNode			= value;
+			pNode->refCount	= 1;
+			AddRef(pNode->pNextChainNode);
+			m_counters.OnBorrow();
+
+			++m_stats.borrowCount;
+			if (++m_numInUse > m_stats.peakInUse)
+				m_stats.peakInUse = m_numInUse;
+
+			return pNode;
+		}
+
+		// @brief 参照を追加
+		//---------------------------------------------------------
+		void AddRef(BoundaryPMNode* p)
+		{
+			if (p)
+				++p->refCount;
+		}
+
+		// @brief 参照を解放 (参照がなくなったノードはチェインをたどって順に返却)
+		//---------------------------------------------------------
+		void Release(BoundaryPMNode* p)
+		{
+			while (p && --p->refCount == 0)
+			{
+				BoundaryPMNode* pNext = p->pNextChainNode;
+
+				p->pNextChainNode = m_pFreeList;
+				m_pFreeList		  = p;
+				--m_numInUse;
+				m_counters.OnRelease();
+
+				p = pNext;
+			}
+		}
+
+		// @brief 必要な容量で初期化 (確保済みの領域は使い回す)
+		//---------------------------------------------------------
+		void Reset(size_t size)
+		{
+			m_pool.resize(size);
+
+			// すべてのノードを空きリストにつなぐ
+			m_pFreeList = nullptr;
+			for (size_t i = size; i > 0; --i)
+			{
+				m_pool[i - 1].refCount		 = 0;
+				m_pool[i - 1].pNextChainNode = m_pFreeList;
+				m_pFreeList					 = &m_pool[i - 1];
+			}
+			m_numInUse		 = 0;
+			m_stats			 = PackageMerge::BoundaryPMPoolStats();
+			m_stats.capacity = size;
+			m_counters.Reset();
+		}
+
+		// @brief 統計を取得
+		//---------------------------------------------------------
+		const PackageMerge::BoundaryPMPoolStats& GetStats() const
+		{
+			return m_stats;
+		}
+
+		//! 呼び出し1回分の計測 (先読みの再構築の深さもここに記録する)
+		PackageMerge::EngineCounters& GetCounters() { return m_counters; }
+
+		BoundaryPMNodePool()
+		{}
+
+	private:
+		std::vector<BoundaryPMNode>			m_pool;
+		BoundaryPMNode*						m_pFreeList = nullptr;
+		size_t								m_numInUse  = 0;
+		PackageMerge::BoundaryPMPoolStats	m_stats;
+		PackageMerge::EngineCounters		m_counters;	//! 統計を記録するビルドでのみ数える
+	};
+	// using
+	template<class SUM>
+	using SingleSymbolList    = std::vector<SingleSimbol<SUM>>;
+
+	// @struct 先読みチェーン
+	template<class SUM>
+	union LookAheadChain
+	{
+		using BoundaryPMNode = ::BoundaryPMNode<SUM>;
+
+		struct Pair
+		{
+			BoundaryPMNode*	pFirst;
+			BoundaryPMNode*	pSecond;
+		};
+		union
+		{
+			Pair				pair;
+			BoundaryPMNode*		pElements[2];
+		};
+
+		// @brief  先読みチェーンの合計の重みを返す
+		//-------------------------------------------------------------
+		inline static SUM GetWeight(const LookAheadChain& lookahead)
+		{
+			assert(lookahead.pair.pFirst != nullptr && lookahead.pair.pSecond != nullptr && "nullが来るのはあり得ない");
+
+			return (lookahead.pair.pFirst->weight + lookahead.pair.pSecond->weight);
+		}
+	};
+
+	// @struct パッケージの重みの型ごとの作業領域
+	template<class SUM>
+	struct BoundaryPMState
+	{
+		SingleSymbolList<SUM>				symbolList;
+		BoundaryPMNodePool<SUM>				pool;
+		std::vector<LookAheadChain<SUM>>	lookaheadStageList;
+	};
+
+	// @struct 作業バッファ
+	struct BoundaryPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		PackageMerge::SymbolSortBuffer		sortBuffer;
+		BoundaryPMState<unsigned>			narrow;				//! 重みの合計 × 制限符号長 が 32bit に収まる場合
+		BoundaryPMState<unsigned long long>	wide;
+		bool								isLastWide = false;	//! 直近の呼び出しが wide を使ったか (統計の取得先)
+	};
+
+	// @brief  該当の先読みチェーンがパッケージに利用されている
+	//-------------------------------------------------------------
+	template<class SUM>
+	inline bool IsUsedByPackage(const LookAheadChain<SUM>& rLookaheadTree, const BoundaryPMNode<SUM>& rPackageNode)
+	{
+		return (rLookaheadTree.pair.pSecond == rPackageNode.pNextChainNode);
+	}
+
+	// @brief 長さテーブル構築
+	// @note  rSymbolList は 事前に重みの昇順にソートされているものとする
+	// @note  bitlengths  は 事前にゼロで初期化しておくこと
+	//-------------------------------------------------------------
+	template<class SUM>
+	void ExtractBitLengths(size_t singleSymbolCount, const SingleSymbolList<SUM>& rSymbolList, unsigned* /*out*/bitlengths)
+	{
+		for (size_t i = 0; i < singleSymbolCount; ++i)
+		{
+			unsigned alphabetIdx = rSymbolList[i].alphabet;
+			bitlengths[alphabetIdx] += 1;
+		}
+	}
+	//-------------------------------------------------------------
+	template<class SUM>
+	void ExtractBitLengths(const BoundaryPMNode<SUM>* pNode, const SingleSymbolList<SUM>& rSymbolList, unsigned* /*out*/bitlengths)
+	{
+		assert(pNode != nullptr && "nullが来るのはあり得ない");
+
+		if (pNode->pNextChainNode)
+		{
+			ExtractBitLengths(pNode->pNextChainNode, rSymbolList, /*out*/bitlengths);
+		}
+		// note: 
+		// このノードの置かれているステージ上で、
+		// このノードよりも重みの小さな(このシンボルよりも先に現れた)
+		// シンボル単体の符号長をインクリメントする
+		ExtractBitLengths(pNode->singleSimbleCount, rSymbolList, /*out*/ bitlengths);
+	}
+	//-------------------------------------------------------------
+	template<class SUM>
+	void BuildBitLengthsArray(size_t singleSymbolCount, const SingleSymbolList<SUM>& rSymbolList, size_t arraySize, unsigned* /*out*/bitLengthsList)
+	{
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		ExtractBitLengths(singleSymbolCount, rSymbolList, /*out*/bitLengthsList);
+	}
+	//-------------------------------------------------------------
+	template<class SUM>
+	void BuildBitLengthsArray(const BoundaryPMNode<SUM>* pNode, const SingleSymbolList<SUM>& rSymbolList, size_t arraySize, unsigned* /*out*/bitLengthsList)
+	{
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		ExtractBitLengths(pNode, rSymbolList, /*out*/bitLengthsList);
+	}
+
+	// @brief ステージ数だけの先読みチェーンリストを作成
+	//-------------------------------------------------------------
+	template<class SUM>
+	void CreateInitialLookAheadPairs(const SingleSimbol<SUM>& firstSymbol, const SingleSimbol<SUM>& secondSymbol, size_t numStage, BoundaryPMNodePool<SUM>& /*ref*/rPool, std::vector<LookAheadChain<SUM>>& /*out*/result)
+	{
+		result.resize(numStage);
+
+		// すべてのステージの先読みチェーンは
+		// シンボルリスト中の一番目、二番目に小さな重みをもつシンボルで初期化される
+		for (size_t i = 0; i < numStage; ++i)
+		{
+			result[i].pair.pFirst  = rPool.Borrow(BoundaryPMNode<SUM>(firstSymbol.weight, nullptr, 1));
+			result[i].pair.pSecond = rPool.Borrow(BoundaryPMNode<SUM>(secondSymbol.weight,nullptr, 2));
+		}
+	}
+	// @brief 次のノード要素を選択して返す
+	//-------------------------------------------------------------
+	template<class SUM>
+	BoundaryPMNode<SUM> ChooseNextNode(const SingleSymbolList<SUM>& singleSymbolList, const LookAheadChain<SUM>& lookaheadTree, const BoundaryPMNode<SUM>& beforeNode)
+	{
+		using BoundaryPMNode = ::BoundaryPMNode<SUM>;
+
+		size_t nextSymbolIndex = beforeNode.singleSimbleCount;
+
+		// note: SymbolListを読み切っているため、残りはすべてパッケージ
+		if (nextSymbolIndex >= singleSymbolList.size())
+			return BoundaryPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond, nextSymbolIndex);
+
+		// note:
+		// 重みの小さなノードが先に返る。
+		// 重みが等しい場合はパッケージが優先
+		SUM nextSymbolWeight  = singleSymbolList[nextSymbolIndex].weight;
+		SUM nextPackageWeight = LookAheadChain<SUM>::GetWeight(lookaheadTree);
+
+		// note: シンボル単体が選ばれた場合は、直前のノードが持つチェインノードを引き継ぐ
+		if (nextSymbolWeight < nextPackageWeight)
+			return BoundaryPMNode(singleSymbolList[nextSymbolIndex].weight, beforeNode.pNextChainNode, nextSymbolIndex +1);
+		else
+			return BoundaryPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond, nextSymbolIndex);
+
+	}
+	// @brief 再帰的に先読みチェーンを再構築する
+	//-------------------------------------------------------------
+	template<class SUM>
+	void IncrementLookAheadTreeRecursive(std::vector<LookAheadChain<SUM>>& rLookAheadTreeList, size_t stageIdx, const SingleSymbolList<SUM>& symbolList, BoundaryPMNodePool<SUM>& rPool)
+	{
+		rPool.GetCounters().OnDepth(rLookAheadTreeList.size() - stageIdx);
+
+		auto *pBeforeNode = rLookAheadTreeList[stageIdx].pair.pSecond;
+
+		// 上にステージがないためシンボル単体を加えるだけ。
+		if (stageIdx == 0)
+		{
+			for (size_t i = 0; i < 2; ++i)
+			{
+				size_t nextSymbolIndex = pBeforeNode->singleSimbleCount;
+				if (nextSymbolIndex >= symbolList.size())
+					return;
+
+				// note: チェインで参照されていなければ、この時点でプールに返却される
+				rPool.Release(rLookAheadTreeList[0].pElements[i]);
+
+				rLookAheadTreeList[0].pElements[i] = rPool.Borrow(BoundaryPMNode<SUM>(symbolList[nextSymbolIndex].weight, pBeforeNode->pNextChainNode, nextSymbolIndex + 1));
+
+				pBeforeNode = rLookAheadTreeList[0].pElements[i];
+			}
+			return;
+		}
+		// 上にステージがある場合は シンボル単体 または パッケージで再構築
+		for (size_t i = 0; i < 2; ++i)
+		{
+			// note: pBeforeNode は常に保持中のもう一方の要素なので、先に解放してよい
+			rPool.Release(rLookAheadTreeList[stageIdx].pElements[i]);
+
+			size_t prevStageIdx = stageIdx - 1;
+			auto   *pNextNode   = rPool.Borrow(ChooseNextNode(/*single symbol*/ symbolList,
+															  /*or package*/ rLookAheadTreeList[prevStageIdx],
+															  /*with before node*/ *pBeforeNode));
+
+			rLookAheadTreeList[stageIdx].pElements[i] = pNextNode;
+
+			if (IsUsedByPackage(rLookAheadTreeList[prevStageIdx], *pNextNode))
+				IncrementLookAheadTreeRecursive(rLookAheadTreeList, prevStageIdx, symbolList, rPool);
+
+			pBeforeNode = pNextNode;
+		}
+	}
+
+	// @brief 境界パッケージマージアルゴリズム本体 (シンボルは並べ替え済み)
+	//-------------------------------------------------------------
+	template<class SUM, class WEIGHT>
+	PackageMerge::Status RunBoundaryPM(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, const PackageMerge::SymbolSortBuffer& sortBuffer, BoundaryPMState<SUM>& rState, unsigned* pBitLengths, PackageMerge::StatsScope& rStats)
+	{
+		using BoundaryPMNode = ::BoundaryPMNode<SUM>;
+
+		const SingleSymbolList<SUM>& symbolList = rState.symbolList;
+		PackageMerge::BuildSortedSymbolList(symbolWeights, sortBuffer, /*out*/rState.symbolList);
+
+		if (symbolList.size() <= 1)
+		{
+			BuildBitLengthsArray(symbolList.size(), symbolList, arraySize, /*out*/pBitLengths);
+			return PackageMerge::STATUS_SUCCESS;
+		}
+
+		// 無駄を軽減
+		if (codeLengthLimit > symbolList.size())
+			codeLengthLimit = symbolList.size();
+
+		// 必要なプールの容量 = L(L+1) 
+		// 各ステージは先読みチェーン(look ahead chain)を保有する。
+		// ここで、一番上のステージにはシンボル単体のノードしかないため、参照するノード数は 自身のノードのみの「1」
+		// それより下のステージでは、チェインで上のステージのノードを参照するため、
+		// 上にあるステージの数だけ、最大で「2,3,4」だけのノード参照する
+		// ステージの数を L としたとき、ここまでのルールに従うならば同時に参照するノード数の最大は
+		// L + L-1 + ... + 1 
+		//	=(L+1) * L/2
+		//
+		// 先読みチェーンは各ステージにつき 2つのノードを保有するため、
+		// 
+		// (L+1) * L/2*2 
+		//	= L(L+1) がステージ数 L に対して必要とされるプールの容量になる
+		//
+		// 今回は処理の都合で最下段のステージを作らないため、先読みチェーンが参照するノード数は
+		//  = L(L-1) になる
+		//
+		// これに加えて、最下段の一番右側のノード(rightistChainNode)のチェインが
+		// 最大で L-1 個のノードを参照し、再構築中のノードが 1 つ増えるため、
+		//  L(L-1) + (L-1) + 1 = L^2 <= L(L+1) の容量を確保する
+		BoundaryPMNodePool<SUM>& pool = rState.pool;
+		pool.Reset(codeLengthLimit * (codeLengthLimit+1));
+
+		// 処理の都合で、最下段のステージは作らない (codeLengthLimit - 1)
+		std::vector<LookAheadChain<SUM>>& lookaheadStageList = rState.lookaheadStageList;
+		CreateInitialLookAheadPairs(symbolList[0], symbolList[1], codeLengthLimit-1, pool, /*out*/lookaheadStageList);
+
+		// 現状リスト最下段の一番右側にあるアクティブなチェインノード。以降のループ処理で順々にシフトする
+		BoundaryPMNode rightistChainNode( symbolList[1].weight, nullptr, 2);
+
+		// 最終的にでそろうノードの数は、ステージ数(制限符号長)にかかわらず、シンボル数を n としたとき 2n-2 の数だけとなる
+		// 直前の操作ですでに2つのノードを処理済みなので、i=2から始める
+		size_t numLastStageNode = (2 * symbolList.size()) - 2;
+		for (size_t i = 2; i < numLastStageNode; ++i)
+		{
+			BoundaryPMNode nextNode = ChooseNextNode(/*single symbol*/symbolList,
+													 /*or package*/*lookaheadStageList.rbegin(), 
+													 /*with before node*/rightistChainNode);
+
+			// note: 同じチェインノードを引き継ぐ場合があるため、先に参照を追加してから古い参照を解放する
+			pool.AddRef(nextNode.pNextChainNode);
+			pool.Release(rightistChainNode.pNextChainNode);
+			rightistChainNode = nextNode;
+
+			if (/*next continue?*/(i + 1) < numLastStageNode)
+			{
+				if(IsUsedByPackage(*lookaheadStageList.rbegin(),rightistChainNode))
+					IncrementLookAheadTreeRecursive(lookaheadStageList, lookaheadStageList.size() - 1, symbolList, pool);
+			}
+		}
+		BuildBitLengthsArray(&rightistChainNode, symbolList, arraySize, /*out*/pBitLengths);
+
+		rStats.AddCounters(pool.GetCounters(), pool.GetStats().capacity);
+		rStats.AddSweeps(pool.GetStats().sweepCount);
+		return PackageMerge::STATUS_SUCCESS;
+	}
+
+	// @brief 境界パッケージマージアルゴリズム (重みの型ごとの共通部分)
+	// @note  パッケージの重みは 制限符号長 × 重みの合計 を超えないため、収まるなら 32bit で数える
+	//-------------------------------------------------------------
+	template<class WEIGHT>
+	PackageMerge::Status BoundaryPMImpl(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		BoundaryPMBuffer& buffer = rWorkspace.GetBuffer<BoundaryPMBuffer>(Workspace::SLOT_BOUNDARY);
+		StatsScope		  stats(rWorkspace, Workspace::SLOT_BOUNDARY);
+
+		SymbolSummary summary = SortSymbolKeys(symbolWeights, arraySize, buffer.sortBuffer);
+		stats.EndSort();
+
+		if (IsImpossibleCoding(summary.numSymbol, codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		buffer.isLastWide = !IsNarrowSumEnough(summary, codeLengthLimit);
+		if (!buffer.isLastWide)
+			return RunBoundaryPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.narrow, pBitLengths, stats);
+
+		if (IsWideSumEnough(summary, codeLengthLimit))
+			return RunBoundaryPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.wide, pBitLengths, stats);
+
+		// パッケージの重みが 64bit に収まらない
+		return STATUS_CAPACITY_EXCEEDED;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 境界パッケージマージアルゴリズム
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!BoundaryPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief 境界パッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------	
+bool PackageMerge::BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 境界パッケージマージアルゴリズム (16bit の重み)
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::BoundaryPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!BoundaryPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+bool PackageMerge::BoundaryPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 境界パッケージマージアルゴリズム (64bit の重み)
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::BoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!BoundaryPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+bool PackageMerge::BoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 境界パッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+PackageMerge::Status PackageMerge::TryBoundaryPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+PackageMerge::Status PackageMerge::TryBoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return BoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+// @brief 境界パッケージマージのノードプール統計を取得
+//-------------------------------------------------------------	
+PackageMerge::BoundaryPMPoolStats PackageMerge::GetBoundaryPMPoolStats(Workspace& rWorkspace)
+{
+	const BoundaryPMBuffer& buffer = rWorkspace.GetBuffer<BoundaryPMBuffer>(Workspace::SLOT_BOUNDARY);
+	return buffer.isLastWide ? buffer.wide.pool.GetStats() : buffer.narrow.pool.GetStats();
+}
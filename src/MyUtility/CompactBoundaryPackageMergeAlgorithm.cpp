@@ -0,0 +1,384 @@
+//-------------------------------------------------------------
+//! @brief	境界パッケージマージアルゴリズム (配列を分けた省メモリ版)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::fill, std::min
+#include <cassert>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// BoundaryPM と同じ手順だが、ノードを (重み / シンボル単体の数 / チェイン / 参照カウント) の配列に分け、
+	// 32bit の添字でつなぐ。シンボル単体は重みだけの配列で持つ (シンボル識別子はソート済みのキー列から引く)。
+	// L ≦ 32 ではノードの配列全体が 32bit の重みで 17KB 程度に収まる。
+	// 先読みチェーンの再構築はステージごとの再帰ではなく、ステージごとの進み具合を持ったループで行う
+
+	//! ノードがない
+	const unsigned NIL = 0xFFFFFFFFu;
+
+	// @struct 次に置くノード (プールに置く前の値)
+	template<class SUM>
+	struct NodeValue
+	{
+		SUM			weight;		//! 重み
+		unsigned	count;		//! このノードの重み以下の重みを持つシンボル単体の数 (このノードを含める)
+		unsigned	next;		//! ツリー右側のノード
+	};
+
+	// @class ノードプール (配列を分けて持つ)
+	// @note  空きノードは next でつないだ空きリストで管理し、参照カウントがゼロになった時点で戻す
+	template<class SUM>
+	class CompactNodePool
+	{
+	public:
+
+		// @brief 必要な容量で初期化 (確保済みの領域は使い回す)
+		//---------------------------------------------------------
+		void Reset(size_t size)
+		{
+			m_weights.resize(size);
+			m_counts.resize(size);
+			m_nexts.resize(size);
+			m_refCounts.resize(size);
+
+			for (size_t i = 0; i < size; ++i)
+				m_nexts[i] = static_cast<unsigned>(i + 1 < size ? i + 1 : NIL);
+
+			m_freeList = (size > 0) ? 0 : NIL;
+			m_counters.Reset();
+		}
+
+		// @brief 貸出 (参照カウント 1 で返す)
+		//---------------------------------------------------------
+		unsigned Borrow(const NodeValue<SUM>& value)
+		{
+			// note: 容量は BoundaryPM と同じ L(L+1) で、空きが尽きることはない
+			unsigned index = m_freeList;
+			assert(index != NIL && "プールに空きがないっぽい");
+
+			m_freeList			= m_nexts[index];
+			m_weights[index]	= value.weight;
+			m_counts[index]		= value.count;
+			m_nexts[index]		= value.next;
+			m_refCounts[index]	= 1;
+			AddRef(value.next);
+			m_counters.OnBorrow();
+			return index;
+		}
+
+		// @brief 参照を追加
+		//---------------------------------------------------------
+		void AddRef(unsigned index)
+		{
+			if (index != NIL)
+				++m_refCounts[index];
+		}
+
+		// @brief 参照を解放 (参照がなくなったノードはチェインをたどって順に返却)
+		//---------------------------------------------------------
+		void Release(unsigned index)
+		{
+			while (index != NIL && --m_refCounts[index] == 0)
+			{
+				unsigned next	= m_nexts[index];
+				m_nexts[index]	= m_freeList;
+				m_freeList		= index;
+				index			= next;
+				m_counters.OnRelease();
+			}
+		}
+
+		SUM		 GetWeight(unsigned index) const { return m_weights[index]; }
+		unsigned GetCount(unsigned index)  const { return m_counts[index]; }
+		unsigned GetNext(unsigned index)   const { return m_nexts[index]; }
+		size_t	 GetCapacity()			   const { return m_nexts.size(); }
+
+		//! 呼び出し1回分の計測 (先読みの再構築の深さもここに記録する)
+		PackageMerge::EngineCounters& GetCounters() { return m_counters; }
+
+	private:
+		std::vector<SUM>		m_weights;
+		std::vector<unsigned>	m_counts;
+		std::vector<unsigned>	m_nexts;		//! ツリー右側のノード (空きリストでは次の空きノード)
+		std::vector<unsigned>	m_refCounts;
+		unsigned				m_freeList = NIL;
+		PackageMerge::EngineCounters m_counters;	//! 統計を記録するビルドでのみ数える
+	};
+
+	// @struct 先読みチェーン (ステージごとの 2ノード)
+	struct LookAheadPair
+	{
+		unsigned elements[2];
+	};
+
+	// @struct パッケージの重みの型ごとの作業領域
+	template<class SUM>
+	struct CompactBoundaryPMState
+	{
+		std::vector<SUM>			symbolWeights;	//! シンボル単体の重み (昇順)
+		CompactNodePool<SUM>		pool;
+		std::vector<LookAheadPair>	lookaheads;		//! 最下段を除くステージの先読みチェーン
+		std::vector<unsigned char>	steps;			//! 再構築中のステージで、先読みチェーンの何番目まで作り直したか
+		std::vector<unsigned>		diffs;			//! 符号長の差分
+	};
+
+	// @struct 作業バッファ
+	struct CompactBoundaryPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		PackageMerge::SymbolSortBuffer				sortBuffer;
+		CompactBoundaryPMState<unsigned>			narrow;	//! 重みの合計 × 制限符号長 が 32bit に収まる場合
+		CompactBoundaryPMState<unsigned long long>	wide;
+	};
+
+	// @class 境界パッケージマージアルゴリズムの本体
+	template<class SUM>
+	class CompactBoundaryPMRunner
+	{
+	public:
+
+		CompactBoundaryPMRunner(CompactBoundaryPMState<SUM>& rState)
+			: m_symbolWeights(rState.symbolWeights)
+			, m_numSymbol(static_cast<unsigned>(rState.symbolWeights.size()))
+			, m_pool(rState.pool)
+			, m_lookaheads(rState.lookaheads)
+			, m_steps(rState.steps)
+		{}
+
+		// @brief 次のノード要素を選ぶ (重みが等しい場合はパッケージが優先)
+		// @note  シンボル単体が選ばれた場合は、直前のノードが持つチェインノードを引き継ぐ
+		//---------------------------------------------------------
+		NodeValue<SUM> ChooseNextNode(const LookAheadPair& lookahead, unsigned beforeCount, unsigned beforeNext) const
+		{
+			SUM packageWeight = m_pool.GetWeight(lookahead.elements[0]) + m_pool.GetWeight(lookahead.elements[1]);
+
+			if (beforeCount < m_numSymbol && m_symbolWeights[beforeCount] < packageWeight)
+				return NodeValue<SUM>{ m_symbolWeights[beforeCount], beforeCount + 1, beforeNext };
+
+			return NodeValue<SUM>{ packageWeight, beforeCount, lookahead.elements[1] };
+		}
+
+		// @brief 先読みチェーンを再構築する
+		// @note  ステージ s の作り直しで上のステージのパッケージを使い切ったら、上のステージを先に作り直してから続きに戻る。
+		//        どこまで作り直したかをステージごとに持つことで、再帰をループに置き換える
+		//---------------------------------------------------------
+		void IncrementLookAhead(size_t topStage)
+		{
+			size_t stage	  = topStage;
+			m_steps[topStage] = 0;
+			m_pool.GetCounters().OnDepth(1);
+
+			for (;;)
+			{
+				// このステージは作り直し終わった
+				if (m_steps[stage] >= 2)
+				{
+					if (stage == topStage)
+						return;
+
+					++stage;
+					continue;
+				}
+
+				unsigned		i		 = m_steps[stage]++;
+				LookAheadPair&	rPair	 = m_lookaheads[stage];
+				unsigned		before	 = rPair.elements[1 - i];
+				unsigned		count	 = m_pool.GetCount(before);
+
+				if (stage == 0)
+				{
+					// 上にステージがないためシンボル単体を加えるだけ
+					if (count >= m_numSymbol)
+					{
+						m_steps[0] = 2;
+						continue;
+					}
+					unsigned next = m_pool.GetNext(before);
+					m_pool.Release(rPair.elements[i]);
+					rPair.elements[i] = m_pool.Borrow(NodeValue<SUM>{ m_symbolWeights[count], count + 1, next });
+					continue;
+				}
+
+				// note: before は常に保持中のもう一方の要素なので、先に解放してよい
+				m_pool.Release(rPair.elements[i]);
+
+				NodeValue<SUM> node = ChooseNextNode(m_lookaheads[stage - 1], count, m_pool.GetNext(before));
+				rPair.elements[i]	= m_pool.Borrow(node);
+
+				if (m_lookaheads[stage - 1].elements[1] == node.next)
+				{
+					--stage;
+					m_steps[stage] = 0;
+					m_pool.GetCounters().OnDepth(topStage - stage + 1);
+				}
+			}
+		}
+
+		// @brief 最下段の一番右側にあるチェインノードを求める
+		//---------------------------------------------------------
+		NodeValue<SUM> Run(size_t numStage)
+		{
+			// すべてのステージの先読みチェーンは、一番目・二番目に小さな重みを持つシンボルで初期化される
+			m_lookaheads.resize(numStage - 1);
+			m_steps.resize(numStage - 1);
+			for (LookAheadPair& rPair : m_lookaheads)
+			{
+				rPair.elements[0] = m_pool.Borrow(NodeValue<SUM>{ m_symbolWeights[0], 1, NIL });
+				rPair.elements[1] = m_pool.Borrow(NodeValue<SUM>{ m_symbolWeights[1], 2, NIL });
+			}
+
+			// 最下段の一番右側にあるチェインノード (プールの外に置く)
+			NodeValue<SUM> rightistChainNode{ m_symbolWeights[1], 2, NIL };
+
+			// note: ステージが 1つ (シンボルが 2つ) の場合はループに入らない
+			const size_t numLastStageNode = 2 * static_cast<size_t>(m_numSymbol) - 2;
+			for (size_t i = 2; i < numLastStageNode; ++i)
+			{
+				const LookAheadPair& lastPair = m_lookaheads.back();
+				NodeValue<SUM> nextNode = ChooseNextNode(lastPair, rightistChainNode.count, rightistChainNode.next);
+
+				// note: 同じチェインノードを引き継ぐ場合があるため、先に参照を追加してから古い参照を解放する
+				m_pool.AddRef(nextNode.next);
+				m_pool.Release(rightistChainNode.next);
+				rightistChainNode = nextNode;
+
+				if ((i + 1) < numLastStageNode && lastPair.elements[1] == rightistChainNode.next)
+					IncrementLookAhead(m_lookaheads.size() - 1);
+			}
+			return rightistChainNode;
+		}
+
+	private:
+		const std::vector<SUM>&		m_symbolWeights;
+		unsigned					m_numSymbol;
+		CompactNodePool<SUM>&		m_pool;
+		std::vector<LookAheadPair>&	m_lookaheads;
+		std::vector<unsigned char>&	m_steps;
+	};
+
+	// @brief 境界パッケージマージアルゴリズム本体 (シンボルは並べ替え済み)
+	//-------------------------------------------------------------
+	template<class SUM>
+	PackageMerge::Status RunCompactBoundaryPM(size_t arraySize, size_t codeLengthLimit, const PackageMerge::SymbolSortBuffer& sortBuffer, CompactBoundaryPMState<SUM>& rState, unsigned* pBitLengths, PackageMerge::StatsScope& rStats)
+	{
+		const std::vector<unsigned long long>& keys = sortBuffer.keys;
+		const size_t numSymbol = keys.size();
+
+		std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+		if (numSymbol <= 1)
+		{
+			if (numSymbol == 1)
+				pBitLengths[static_cast<unsigned>(keys[0])] = 1;
+
+			return PackageMerge::STATUS_SUCCESS;
+		}
+
+		// シンボル単体は重みだけを持つ
+		rState.symbolWeights.resize(numSymbol);
+		for (size_t i = 0; i < numSymbol; ++i)
+			rState.symbolWeights[i] = static_cast<SUM>(keys[i] >> 32);
+
+		// 無駄を軽減
+		size_t numStage = std::min(codeLengthLimit, numSymbol);
+
+		// 必要なプールの容量は BoundaryPM と同じ L(L+1)
+		rState.pool.Reset(numStage * (numStage + 1));
+
+		CompactBoundaryPMRunner<SUM> runner(rState);
+		NodeValue<SUM> rightistChainNode = runner.Run(numStage);
+
+		// チェインの各ノードは、自身のステージで重みの小さい方から count 個のシンボルの符号長を 1 増やす。
+		// 差分を積んでから累積する
+		std::vector<unsigned>& diffs = rState.diffs;
+		diffs.assign(numSymbol + 1, 0u);
+		diffs[rightistChainNode.count] -= 1;
+		unsigned numChainNode = 1;
+		for (unsigned index = rightistChainNode.next; index != NIL; index = rState.pool.GetNext(index))
+		{
+			diffs[rState.pool.GetCount(index)] -= 1;
+			++numChainNode;
+		}
+
+		unsigned length = numChainNode;
+		for (size_t i = 0; i < numSymbol; ++i)
+		{
+			pBitLengths[static_cast<unsigned>(keys[i])] = length;
+			length += diffs[i + 1];
+		}
+		rStats.AddCounters(rState.pool.GetCounters(), rState.pool.GetCapacity());
+		return PackageMerge::STATUS_SUCCESS;
+	}
+
+	// @brief 境界パッケージマージアルゴリズム (配列を分けた省メモリ版) の本体
+	//-------------------------------------------------------------
+	PackageMerge::Status CompactBoundaryPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		CompactBoundaryPMBuffer& buffer = rWorkspace.GetBuffer<CompactBoundaryPMBuffer>(Workspace::SLOT_COMPACT_BOUNDARY);
+		StatsScope				 stats(rWorkspace, Workspace::SLOT_COMPACT_BOUNDARY);
+
+		SymbolSummary summary = SortSymbolKeys(symbolWeights, arraySize, buffer.sortBuffer);
+		stats.EndSort();
+
+		if (IsImpossibleCoding(summary.numSymbol, codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		// ノードの添字は 32bit
+		if (summary.numSymbol >= NIL)
+			return STATUS_CAPACITY_EXCEEDED;
+
+		if (IsNarrowSumEnough(summary, codeLengthLimit))
+			return RunCompactBoundaryPM(arraySize, codeLengthLimit, buffer.sortBuffer, buffer.narrow, pBitLengths, stats);
+
+		if (IsWideSumEnough(summary, codeLengthLimit))
+			return RunCompactBoundaryPM(arraySize, codeLengthLimit, buffer.sortBuffer, buffer.wide, pBitLengths, stats);
+
+		// パッケージの重みが 64bit に収まらない
+		return STATUS_CAPACITY_EXCEEDED;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 境界パッケージマージアルゴリズム (配列を分けた省メモリ版)
+//-------------------------------------------------------------
+std::vector<unsigned> PackageMerge::CompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!CompactBoundaryPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief 境界パッケージマージアルゴリズム (配列を分けた省メモリ版、作業領域を使い回す版)
+//-------------------------------------------------------------
+bool PackageMerge::CompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return CompactBoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 境界パッケージマージアルゴリズム (配列を分けた省メモリ版、例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryCompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return CompactBoundaryPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
@@ -0,0 +1,222 @@
+//-------------------------------------------------------------
+//! @brief	計数パッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill
+#include <cassert>
+#include <utility>		// std::swap
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// 純粋なパッケージマージと同じ順にステージを作るが、ノードに子の参照を持たせない。
+// 各ステージで採用されるのは常に先頭からの連続した区間 (プレフィックス) であり、
+// その長さは必ず偶数になるため、ステージごとに
+// 「先頭から m 組 (2m 個) の中にパッケージがいくつあるか」だけを記録しておけば、
+// 最下段から上に向かって採用区間の長さとシンボル単体の数 c_i を順に求められる。
+// 重みの昇順で j 番目のシンボルの符号長は c_i > j となるステージの数に等しい。
+//
+// ステージの重みは直前のステージの分だけあればよいので、2本のバッファを交互に使う。
+// 保持するのはステージごとに 1組あたり 4byte の計数だけになる。
+//
+namespace
+{
+	// @struct シンボル単体情報
+	struct SingleSymbol
+	{
+		unsigned		   alphabet = 0;		//! シンボル識別子
+		unsigned		   weight   = 0;		//!	重み (出現回数)
+
+		SingleSymbol()
+		{}
+
+		SingleSymbol(unsigned	alp, unsigned wei)
+			: alphabet(alp)
+			, weight(wei)
+		{}
+	};
+
+	// using
+	using SingleSymbolList = std::vector<SingleSymbol>;
+	using WeightList       = std::vector<unsigned long long>;
+	using PackageCountList = std::vector<unsigned>;
+
+	// @struct 作業バッファ
+	struct CountingPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		SingleSymbolList				symbolList;
+		PackageMerge::SymbolSortBuffer	sortBuffer;
+		WeightList						weights[2];			//! 直前のステージと構築中のステージの重み
+		std::vector<PackageCountList>	packageCounts;		//! [ステージ][m] = 先頭から m+1 組の中にあるパッケージの数
+		std::vector<size_t>				symbolCounts;		//! ステージごとに採用されるシンボル単体の数
+		std::vector<unsigned>			numStageBySymbol;	//! 長さテーブル構築用
+	};
+
+	// @brief 次のステージを構築し、組ごとのパッケージ数を記録する
+	// @note  重みが等しい場合はパッケージが優先 (純粋なパッケージマージと同じ並び)
+	//-------------------------------------------------------------
+	void MergeStage(const SingleSymbolList& symbolList, const WeightList& prevStage,
+					WeightList& /*out*/nextStage, PackageCountList& /*out*/packageCounts)
+	{
+		size_t numPackage = prevStage.size() / 2;
+		nextStage.clear();
+		packageCounts.clear();
+
+		size_t symbol_i  = 0;
+		size_t package_i = 0;
+		while (symbol_i < symbolList.size() || package_i < numPackage)
+		{
+			unsigned long long weight = 0;
+			if (package_i < numPackage &&
+				(symbol_i >= symbolList.size() || prevStage[package_i * 2] + prevStage[package_i * 2 + 1] <= symbolList[symbol_i].weight))
+			{
+				weight = prevStage[package_i * 2] + prevStage[package_i * 2 + 1];
+				++package_i;
+			}
+			else
+			{
+				weight = symbolList[symbol_i++].weight;
+			}
+			nextStage.push_back(weight);
+
+			// 1組そろうごとに、ここまでのパッケージ数を記録
+			if ((nextStage.size() & 0x1) == 0)
+				packageCounts.push_back(static_cast<unsigned>(package_i));
+		}
+		// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
+		if (nextStage.size() & 0x1)
+			nextStage.pop_back();
+	}
+
+	// @brief 長さテーブル構築
+	// @note  重みの昇順で j 番目のシンボルの符号長は、採用シンボル数が j を超えるステージの数
+	//-------------------------------------------------------------
+	void BuildBitLengthsArray(const std::vector<size_t>& symbolCounts, const SingleSymbolList& rSymbolList, size_t arraySize,
+							  std::vector<unsigned>& /*work*/numStageBySymbol, unsigned* /*out*/bitLengthsList)
+	{
+		numStageBySymbol.assign(rSymbolList.size() + 1, 0);
+		for (size_t count : symbolCounts)
+			numStageBySymbol[count] += 1;
+
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		unsigned bitLength = static_cast<unsigned>(symbolCounts.size());
+		for (size_t i = 0; i < rSymbolList.size(); ++i)
+		{
+			bitLength -= numStageBySymbol[i];
+			bitLengthsList[rSymbolList[i].alphabet] = bitLength;
+		}
+	}
+
+	// @brief 計数パッケージマージアルゴリズム本体
+	//-------------------------------------------------------------
+	PackageMerge::Status CountingPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		CountingPMBuffer& buffer = rWorkspace.GetBuffer<CountingPMBuffer>(Workspace::SLOT_COUNTING);
+		StatsScope	stats(rWorkspace, Workspace::SLOT_COUNTING);
+
+		const SingleSymbolList& symbolList = buffer.symbolList;
+		ExtractSortedSymbolList(symbolWeights, arraySize, buffer.sortBuffer, /*out*/buffer.symbolList);
+		stats.EndSort();
+
+		if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		std::vector<size_t>& symbolCounts = buffer.symbolCounts;
+		if (symbolList.size() <= 1)
+		{
+			symbolCounts.assign(1, symbolList.size());
+			BuildBitLengthsArray(symbolCounts, symbolList, arraySize, buffer.numStageBySymbol, /*out*/pBitLengths);
+			return STATUS_SUCCESS;
+		}
+
+		// 無駄を軽減
+		if (codeLengthLimit > symbolList.size())
+			codeLengthLimit = symbolList.size();
+
+		// ステージ数は呼び出しごとに変わるため、縮めずに使い回す
+		std::vector<PackageCountList>& packageCounts = buffer.packageCounts;
+		if (packageCounts.size() < codeLengthLimit)
+			packageCounts.resize(codeLengthLimit);
+
+		// 一番上のステージはシンボル単体のみ
+		WeightList* pPrevStage = &buffer.weights[0];
+		WeightList* pNextStage = &buffer.weights[1];
+		pPrevStage->resize(symbolList.size() & ~static_cast<size_t>(1));
+		for (size_t i = 0; i < pPrevStage->size(); ++i)
+			(*pPrevStage)[i] = symbolList[i].weight;
+
+		// note: 各ステージの要素数は 2n 未満に収まる
+		pNextStage->reserve(2 * symbolList.size());
+
+		// 上から下に向かって順番にマージする
+		for (size_t stage_i = 1; stage_i < codeLengthLimit; ++stage_i)
+		{
+			MergeStage(symbolList, *pPrevStage, /*out*/*pNextStage, /*out*/packageCounts[stage_i]);
+			std::swap(pPrevStage, pNextStage);
+		}
+
+		// 最下段から上に向かって、各ステージの採用区間の長さとシンボル単体の数を求める
+		symbolCounts.assign(codeLengthLimit, 0);
+		size_t numActive = pPrevStage->size();
+		for (size_t stage_i = codeLengthLimit - 1; stage_i > 0; --stage_i)
+		{
+			size_t numPackage = (numActive == 0) ? 0 : packageCounts[stage_i][numActive / 2 - 1];
+
+			symbolCounts[stage_i] = numActive - numPackage;
+			numActive			  = numPackage * 2;
+		}
+		symbolCounts[0] = numActive;
+
+		assert(symbolCounts[0] <= symbolList.size() && "一番上のステージでシンボルの数を超えるのはあり得ない");
+
+		// 結果を生成する
+		BuildBitLengthsArray(symbolCounts, symbolList, arraySize, buffer.numStageBySymbol, /*out*/pBitLengths);
+		return STATUS_SUCCESS;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 計数パッケージマージアルゴリズム
+//-------------------------------------------------------------
+std::vector<unsigned> PackageMerge::CountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!CountingPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief 計数パッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------
+bool PackageMerge::CountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return CountingPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 計数パッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryCountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return CountingPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
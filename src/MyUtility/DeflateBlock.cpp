@@ -0,0 +1,433 @@
+//-------------------------------------------------------------
+//! @brief	DEFLATE の動的ハフマンブロックの書き込み
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "DeflateBlock.h"
+#include "HuffmanCode.h"
+#include <algorithm>	// std::copy, std::max, std::min
+#include <iterator>	// std::size
+#include <cstring>		// std::memcpy
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::Deflate;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	//! 長さのシンボル (257～285) の基準値と追加ビット数
+	const unsigned short LENGTH_BASE[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const unsigned char	 LENGTH_EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+	//! 距離のシンボル (0～29) の基準値と追加ビット数
+	const unsigned short DISTANCE_BASE[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const unsigned char	 DISTANCE_EXTRA[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	//! 符号長アルファベットの符号長を書き込む順番
+	const unsigned char CODE_LENGTH_ORDER[NUM_CODE_LENGTH_SYMBOL] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	//! 一致長・距離の上限
+	const unsigned MAX_MATCH_LENGTH = 258;
+	const unsigned MAX_DISTANCE		= 32768;
+
+	//! ヘッダーの最大バイト数 (17bit + 19 * 3bit + 316 * (7 + 7)bit より大きく取る)
+	const size_t MAX_HEADER_BYTES = 1024;
+
+	//! トークン 1 つの最大バイト数 (15 + 5 + 15 + 13 bit)
+	const size_t MAX_TOKEN_BYTES = 6;
+
+	// @struct 一致長・距離からシンボルを引く表
+	struct SymbolTable
+	{
+		unsigned char	lengthSymbol[MAX_MATCH_LENGTH + 1];	//! 一致長 → 長さのシンボル - 257
+		unsigned char	distanceSymbolLow[256];				//! (距離 - 1) < 256 → 距離のシンボル
+		unsigned char	distanceSymbolHigh[256];			//! (距離 - 1) >> 7 → 距離のシンボル
+
+		SymbolTable()
+		{
+			for (unsigned symbol = 0; symbol < std::size(LENGTH_BASE); ++symbol)
+			{
+				for (unsigned i = 0; i < (1u << LENGTH_EXTRA[symbol]) && LENGTH_BASE[symbol] + i <= MAX_MATCH_LENGTH; ++i)
+					lengthSymbol[LENGTH_BASE[symbol] + i] = static_cast<unsigned char>(symbol);
+			}
+			for (unsigned symbol = 0; symbol < std::size(DISTANCE_BASE); ++symbol)
+			{
+				for (unsigned i = 0; i < (1u << DISTANCE_EXTRA[symbol]); ++i)
+				{
+					unsigned x = DISTANCE_BASE[symbol] - 1 + i;
+					if (x < 256)
+						distanceSymbolLow[x] = static_cast<unsigned char>(symbol);
+					else
+						distanceSymbolHigh[x >> 7] = static_cast<unsigned char>(symbol);
+				}
+			}
+		}
+
+		// @brief 長さのシンボル - 257
+		//-------------------------------------------------------------
+		unsigned GetLengthSymbol(unsigned length) const { return lengthSymbol[length]; }
+
+		// @brief 距離のシンボル
+		//-------------------------------------------------------------
+		unsigned GetDistanceSymbol(unsigned distance) const
+		{
+			unsigned x = distance - 1;
+			return (x < 256) ? distanceSymbolLow[x] : distanceSymbolHigh[x >> 7];
+		}
+	};
+
+	// @brief シンボル表
+	//-------------------------------------------------------------
+	const SymbolTable& GetSymbolTable()
+	{
+		static const SymbolTable table;
+		return table;
+	}
+
+	// @brief トークンの範囲チェック
+	//-------------------------------------------------------------
+	inline bool IsValidToken(const Token& token)
+	{
+		if (token.length == 0)
+			return token.value <= 0xff;
+
+		return token.length >= 3 && token.length <= MAX_MATCH_LENGTH && token.value >= 1 && token.value <= MAX_DISTANCE;
+	}
+}
+
+//-------------------------------------------------------------
+// Deflate
+//-------------------------------------------------------------
+
+// @brief トークン列のシンボルを数える
+//-------------------------------------------------------------
+bool Deflate::CountSymbols(const Token* tokens, size_t numToken, unsigned* /*inout*/literalLengthCounts, unsigned* /*inout*/distanceCounts)
+{
+	const SymbolTable& table = GetSymbolTable();
+	for (size_t i = 0; i < numToken; ++i)
+	{
+		const Token& token = tokens[i];
+		if (!IsValidToken(token))
+			return false;
+
+		if (token.length == 0)
+		{
+			++literalLengthCounts[token.value];
+		}
+		else
+		{
+			++literalLengthCounts[END_OF_BLOCK + 1 + table.GetLengthSymbol(token.length)];
+			++distanceCounts[table.GetDistanceSymbol(token.value)];
+		}
+	}
+	return true;
+}
+
+//-------------------------------------------------------------
+// BlockWriter::Impl
+//-------------------------------------------------------------
+struct BlockWriter::Impl
+{
+	PackageMerge::EngineFunc	engine;
+	PackageMerge::Workspace		workspace;		//! 3 回の符号長計算で使い回す
+
+	std::vector<unsigned char>	out;
+	unsigned char*				pWrite	 = nullptr;	//! 書き込み中のみ有効
+	unsigned long long			bitBuffer = 0;		//! 1 バイトにそろっていない端数のビット
+	unsigned					bitCount  = 0;
+
+	unsigned	weights[NUM_LITERAL_LENGTH_SYMBOL];		//! 作業用: 符号長計算に渡す重み
+	unsigned	literalLengthBitLengths[NUM_LITERAL_LENGTH_SYMBOL] = {};
+	unsigned	distanceBitLengths[NUM_DISTANCE_SYMBOL]			   = {};
+	unsigned	codeLengthBitLengths[NUM_CODE_LENGTH_SYMBOL]	   = {};
+
+	Huffman::CanonicalCode	literalLengthCode;
+	Huffman::CanonicalCode	distanceCode;
+	Huffman::CanonicalCode	codeLengthCode;
+
+	// 符号長列のランレングス表現 (シンボル 0～18 と追加ビットの値)
+	unsigned char	runSymbols[NUM_LITERAL_LENGTH_SYMBOL + NUM_DISTANCE_SYMBOL];
+	unsigned char	runExtras[NUM_LITERAL_LENGTH_SYMBOL + NUM_DISTANCE_SYMBOL];
+	size_t			numRun = 0;
+
+	// @brief ビットを詰める (1 回に 57bit 以下になるように呼ぶ)
+	//-------------------------------------------------------------
+	void PutBits(unsigned long long bits, unsigned numBit)
+	{
+		bitBuffer |= bits << bitCount;
+		bitCount  += numBit;
+	}
+
+	// @brief そろったバイトを書き出す (8byte 書き込むが、進めるのはそろったバイト数だけ)
+	//-------------------------------------------------------------
+	void FlushBits()
+	{
+		std::memcpy(pWrite, &bitBuffer, sizeof(bitBuffer));
+		pWrite	   += bitCount >> 3;
+		bitBuffer >>= bitCount & ~7u;
+		bitCount   &= 7;
+	}
+
+	// @brief 符号語を詰める
+	//-------------------------------------------------------------
+	void PutSymbol(const Huffman::CanonicalCode& code, size_t symbol)
+	{
+		PutBits(code.GetReversedCode(symbol), code.GetBitLength(symbol));
+	}
+
+	// @brief 符号長を求める
+	// @note  有効なシンボルが 2 つ未満なら重み 1 のシンボルを足して、完全な符号にする (zlib と同じ)
+	//-------------------------------------------------------------
+	bool ComputeBitLengths(const unsigned* counts, size_t arraySize, unsigned codeLengthLimit, unsigned* pBitLengths)
+	{
+		std::copy(counts, counts + arraySize, weights);
+		size_t numSymbol = 0;
+		for (size_t i = 0; i < arraySize; ++i)
+			numSymbol += (weights[i] != 0);
+
+		for (size_t i = 0; numSymbol < 2 && i < arraySize; ++i)
+		{
+			if (weights[i] == 0)
+			{
+				weights[i] = 1;
+				++numSymbol;
+			}
+		}
+		return engine(weights, arraySize, codeLengthLimit, workspace, pBitLengths);
+	}
+
+	// @brief 符号長列をランレングス表現にする
+	// @note  リテラル/長さと距離の符号長は 1 続きの列として扱う (連続がまたがってもよい)
+	//-------------------------------------------------------------
+	void BuildRuns(const unsigned* bitLengths, size_t numBitLength)
+	{
+		numRun = 0;
+		auto addRun = [this](unsigned symbol, unsigned extra)
+		{
+			runSymbols[numRun] = static_cast<unsigned char>(symbol);
+			runExtras[numRun]  = static_cast<unsigned char>(extra);
+			++numRun;
+		};
+
+		size_t i = 0;
+		while (i < numBitLength)
+		{
+			unsigned length = bitLengths[i];
+			size_t	 count	= 1;
+			while (i + count < numBitLength && bitLengths[i + count] == length)
+				++count;
+			i += count;
+
+			if (length == 0)
+			{
+				// 18: 0 を 11～138 回, 17: 0 を 3～10 回
+				for (; count >= 11; count -= std::min<size_t>(count, 138))
+					addRun(18, static_cast<unsigned>(std::min<size_t>(count, 138) - 11));
+				if (count >= 3)
+				{
+					addRun(17, static_cast<unsigned>(count - 3));
+					count = 0;
+				}
+			}
+			else
+			{
+				// 16: 直前の符号長を 3～6 回
+				addRun(length, 0);
+				for (--count; count >= 3; count -= std::min<size_t>(count, 6))
+					addRun(16, static_cast<unsigned>(std::min<size_t>(count, 6) - 3));
+			}
+			for (; count > 0; --count)
+				addRun(length, 0);
+		}
+	}
+};
+
+//-------------------------------------------------------------
+// BlockWriter
+//-------------------------------------------------------------
+
+// @brief コンストラクタ
+//-------------------------------------------------------------
+BlockWriter::BlockWriter(PackageMerge::EngineFunc engine)
+	: m_pImpl(new Impl())
+{
+	m_pImpl->engine = engine;
+}
+
+// @brief デストラクタ
+//-------------------------------------------------------------
+BlockWriter::~BlockWriter() = default;
+
+// @brief 動的ハフマンブロックを 1 つ書き込む
+//-------------------------------------------------------------
+bool BlockWriter::WriteDynamicBlock(const Token* tokens, size_t numToken, const unsigned* literalLengthCounts, const unsigned* distanceCounts, bool isFinal)
+{
+	Impl& impl = *m_pImpl;
+
+	// 符号長を求める (ブロック終端は必ず 1 回出現する)
+	unsigned counts[NUM_LITERAL_LENGTH_SYMBOL];
+	std::copy(literalLengthCounts, literalLengthCounts + NUM_LITERAL_LENGTH_SYMBOL, counts);
+	counts[END_OF_BLOCK] = std::max(counts[END_OF_BLOCK], 1u);
+	if (!impl.ComputeBitLengths(counts, NUM_LITERAL_LENGTH_SYMBOL, MAX_BIT_LENGTH, impl.literalLengthBitLengths) ||
+		!impl.ComputeBitLengths(distanceCounts, NUM_DISTANCE_SYMBOL, MAX_BIT_LENGTH, impl.distanceBitLengths))
+		return false;
+
+	// 末尾の使われないシンボルを省く
+	size_t numLiteralLength = NUM_LITERAL_LENGTH_SYMBOL;
+	while (numLiteralLength > END_OF_BLOCK + 1 && impl.literalLengthBitLengths[numLiteralLength - 1] == 0)
+		--numLiteralLength;
+	size_t numDistance = NUM_DISTANCE_SYMBOL;
+	while (numDistance > 1 && impl.distanceBitLengths[numDistance - 1] == 0)
+		--numDistance;
+
+	unsigned bitLengths[NUM_LITERAL_LENGTH_SYMBOL + NUM_DISTANCE_SYMBOL];
+	std::copy(impl.literalLengthBitLengths, impl.literalLengthBitLengths + numLiteralLength, bitLengths);
+	std::copy(impl.distanceBitLengths, impl.distanceBitLengths + numDistance, bitLengths + numLiteralLength);
+	impl.BuildRuns(bitLengths, numLiteralLength + numDistance);
+
+	// 符号長アルファベットの符号長
+	unsigned runCounts[NUM_CODE_LENGTH_SYMBOL] = {};
+	for (size_t i = 0; i < impl.numRun; ++i)
+		++runCounts[impl.runSymbols[i]];
+	if (!impl.ComputeBitLengths(runCounts, NUM_CODE_LENGTH_SYMBOL, MAX_CODE_LENGTH_BIT_LENGTH, impl.codeLengthBitLengths))
+		return false;
+
+	size_t numCodeLength = NUM_CODE_LENGTH_SYMBOL;
+	while (numCodeLength > 4 && impl.codeLengthBitLengths[CODE_LENGTH_ORDER[numCodeLength - 1]] == 0)
+		--numCodeLength;
+
+	if (!impl.literalLengthCode.Build(impl.literalLengthBitLengths, NUM_LITERAL_LENGTH_SYMBOL) ||
+		!impl.distanceCode.Build(impl.distanceBitLengths, NUM_DISTANCE_SYMBOL) ||
+		!impl.codeLengthCode.Build(impl.codeLengthBitLengths, NUM_CODE_LENGTH_SYMBOL))
+		return false;
+
+	// 失敗したら書き込む前の状態に戻す
+	const size_t			 savedSize		= impl.out.size();
+	const unsigned long long savedBitBuffer = impl.bitBuffer;
+	const unsigned			 savedBitCount	= impl.bitCount;
+	impl.out.resize(savedSize + MAX_HEADER_BYTES + MAX_TOKEN_BYTES * numToken + 2 * sizeof(unsigned long long));
+	impl.pWrite = impl.out.data() + savedSize;
+
+	// ヘッダー
+	impl.PutBits(isFinal ? 1 : 0, 1);
+	impl.PutBits(2, 2);
+	impl.PutBits(numLiteralLength - (END_OF_BLOCK + 1), 5);
+	impl.PutBits(numDistance - 1, 5);
+	impl.PutBits(numCodeLength - 4, 4);
+	impl.FlushBits();
+	for (size_t i = 0; i < numCodeLength; ++i)
+	{
+		impl.PutBits(impl.codeLengthBitLengths[CODE_LENGTH_ORDER[i]], 3);
+		impl.FlushBits();
+	}
+	for (size_t i = 0; i < impl.numRun; ++i)
+	{
+		static const unsigned char RUN_EXTRA_BITS[3] = { 2, 3, 7 };
+		unsigned symbol = impl.runSymbols[i];
+		impl.PutSymbol(impl.codeLengthCode, symbol);
+		if (symbol >= 16)
+			impl.PutBits(impl.runExtras[i], RUN_EXTRA_BITS[symbol - 16]);
+		impl.FlushBits();
+	}
+
+	// データ
+	const SymbolTable& table	 = GetSymbolTable();
+	bool			   succeeded = true;
+	for (size_t i = 0; i < numToken; ++i)
+	{
+		const Token& token = tokens[i];
+		if (!IsValidToken(token))
+		{
+			succeeded = false;
+			break;
+		}
+
+		if (token.length == 0)
+		{
+			succeeded &= (impl.literalLengthCode.GetBitLength(token.value) != 0);
+			impl.PutSymbol(impl.literalLengthCode, token.value);
+		}
+		else
+		{
+			unsigned lengthSymbol	= table.GetLengthSymbol(token.length);
+			unsigned distanceSymbol = table.GetDistanceSymbol(token.value);
+			succeeded &= (impl.literalLengthCode.GetBitLength(END_OF_BLOCK + 1 + lengthSymbol) != 0) && (impl.distanceCode.GetBitLength(distanceSymbol) != 0);
+
+			impl.PutSymbol(impl.literalLengthCode, END_OF_BLOCK + 1 + lengthSymbol);
+			impl.PutBits(token.length - LENGTH_BASE[lengthSymbol], LENGTH_EXTRA[lengthSymbol]);
+			impl.PutSymbol(impl.distanceCode, distanceSymbol);
+			impl.PutBits(token.value - DISTANCE_BASE[distanceSymbol], DISTANCE_EXTRA[distanceSymbol]);
+		}
+		impl.FlushBits();
+	}
+	impl.PutSymbol(impl.literalLengthCode, END_OF_BLOCK);
+	impl.FlushBits();
+
+	if (!succeeded)
+	{
+		impl.out.resize(savedSize);
+		impl.bitBuffer = savedBitBuffer;
+		impl.bitCount  = savedBitCount;
+		return false;
+	}
+
+	// 端数のビットは bitBuffer に残し、次のブロックに続ける
+	impl.out.resize(static_cast<size_t>(impl.pWrite - impl.out.data()));
+	impl.pWrite = nullptr;
+	return true;
+}
+
+// @brief 最後のバイトの余りをゼロで埋める
+//-------------------------------------------------------------
+void BlockWriter::Flush()
+{
+	Impl& impl = *m_pImpl;
+	if (impl.bitCount > 0)
+		impl.out.push_back(static_cast<unsigned char>(impl.bitBuffer));
+
+	impl.bitBuffer = 0;
+	impl.bitCount  = 0;
+}
+
+// @brief 書き込んだバイト列
+//-------------------------------------------------------------
+const std::vector<unsigned char>& BlockWriter::GetOutput() const
+{
+	return m_pImpl->out;
+}
+
+// @brief 端数のビットを書き出してから、書き込んだバイト列を取り出す
+//-------------------------------------------------------------
+std::vector<unsigned char> BlockWriter::TakeOutput()
+{
+	Flush();
+
+	std::vector<unsigned char> result;
+	result.swap(m_pImpl->out);
+	return result;
+}
+
+// @brief 直近のブロックの符号長
+//-------------------------------------------------------------
+const unsigned* BlockWriter::GetLiteralLengthBitLengths() const
+{
+	return m_pImpl->literalLengthBitLengths;
+}
+
+const unsigned* BlockWriter::GetDistanceBitLengths() const
+{
+	return m_pImpl->distanceBitLengths;
+}
+
+const unsigned* BlockWriter::GetCodeLengthBitLengths() const
+{
+	return m_pImpl->codeLengthBitLengths;
+}
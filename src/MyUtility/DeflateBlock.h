@@ -0,0 +1,100 @@
+//-------------------------------------------------------------
+//! @brief	DEFLATE の動的ハフマンブロックの書き込み
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <vector>
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace Deflate
+{
+	// note:
+	// RFC 1951 の動的ハフマンブロック (BTYPE = 2) を書き込む。
+	// リテラル/長さ (286) と距離 (30) の符号長は制限符号長 15、符号長アルファベット (19) は制限符号長 7 で、
+	// zlib のような経験的な切り詰めではなくパッケージマージで最適に求める
+
+	//! リテラル/長さのシンボル数 (0～255: リテラル, 256: ブロック終端, 257～285: 長さ)
+	const size_t NUM_LITERAL_LENGTH_SYMBOL = 286;
+
+	//! 距離のシンボル数
+	const size_t NUM_DISTANCE_SYMBOL = 30;
+
+	//! 符号長アルファベットのシンボル数
+	const size_t NUM_CODE_LENGTH_SYMBOL = 19;
+
+	//! ブロック終端のシンボル
+	const unsigned END_OF_BLOCK = 256;
+
+	//! リテラル/長さ・距離の制限符号長
+	const unsigned MAX_BIT_LENGTH = 15;
+
+	//! 符号長アルファベットの制限符号長
+	const unsigned MAX_CODE_LENGTH_BIT_LENGTH = 7;
+
+	// @struct LZ77 のトークン
+	struct Token
+	{
+		unsigned short	length;		//! 一致長 (3～258)。0 ならリテラル
+		unsigned short	value;		//! リテラル (0～255)、または距離 (1～32768)
+
+		//! リテラル
+		static Token Literal(unsigned char literal) { return Token{ 0, literal }; }
+
+		//! 一致
+		static Token Match(unsigned length, unsigned distance) { return Token{ static_cast<unsigned short>(length), static_cast<unsigned short>(distance) }; }
+	};
+
+	//! トークン列のシンボルを数えて加算する (ブロック終端は数えない)
+	//! @return 一致長・距離が範囲外のトークンを含む場合は false
+	bool CountSymbols(const Token* tokens, size_t numToken, unsigned* /*inout*/literalLengthCounts, unsigned* /*inout*/distanceCounts);
+
+	// @class 動的ハフマンブロックの書き込み
+	// @note  ブロックはバイト境界にそろわないため、ビット列の状態をブロックをまたいで保持する。
+	//        3 回の符号長計算は同じ作業領域を使い回す
+	class BlockWriter
+	{
+	public:
+
+		//! @param engine 符号長を求めるアルゴリズム。
+		//!               既定はハフマン符号が制限符号長に収まればそれを使い、収まらなければ境界パッケージマージを使う (どちらも最適)
+		explicit BlockWriter(PackageMerge::EngineFunc engine = PackageMerge::HybridPM);
+		~BlockWriter();
+
+		BlockWriter(const BlockWriter&)				= delete;
+		BlockWriter& operator=(const BlockWriter&)	= delete;
+
+		//! 動的ハフマンブロックを 1 つ書き込む
+		//! @param literalLengthCounts リテラル/長さの出現数 (NUM_LITERAL_LENGTH_SYMBOL 要素)。ブロック終端は 1 回以上として扱う
+		//! @param distanceCounts      距離の出現数 (NUM_DISTANCE_SYMBOL 要素)
+		//! @param isFinal             最後のブロックか (BFINAL)
+		//! @return 出現数 0 のシンボルを使うトークンや範囲外のトークンを含む場合は false (何も書き込まない)
+		bool WriteDynamicBlock(const Token* tokens, size_t numToken, const unsigned* literalLengthCounts, const unsigned* distanceCounts, bool isFinal);
+
+		//! 最後のバイトの余りをゼロで埋める
+		void Flush();
+
+		//! 書き込んだバイト列 (Flush() していない端数のビットは含まない)
+		const std::vector<unsigned char>& GetOutput() const;
+
+		//! Flush() してから書き込んだバイト列を取り出し、空の状態に戻す
+		std::vector<unsigned char> TakeOutput();
+
+		//! 直近のブロックの符号長
+		const unsigned* GetLiteralLengthBitLengths() const;
+		const unsigned* GetDistanceBitLengths() const;
+		const unsigned* GetCodeLengthBitLengths() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pImpl;
+	};
+}
+}// end namespace
@@ -0,0 +1,313 @@
+//-------------------------------------------------------------
+//! @brief	分割統治パッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill
+#include <cassert>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// 純粋なパッケージマージは全ステージを保持したまま最後に木をたどるため O(nL) の領域が必要になる。
+// ここではステージの「重み」だけを2本のバッファで順に作り直し、ステージを保持しない。
+//
+// 最下段で採用される 2n-2 個のノードを上にたどっていくと、各ステージで採用されるのは
+// 常にステージの先頭からの連続した区間 (プレフィックス) になる。
+// そのプレフィックスに含まれるシンボル単体の数 c_i さえわかれば、
+// 重みの昇順で j 番目のシンボルの符号長は c_i > j となるステージの数に等しい。
+//
+// c_i を求めるために、ステージ区間 [lo, hi] の中間ステージ mid に対して
+// 「hi のプレフィックスを作るのに mid の要素が先頭から何個必要か」を順方向の計算のついでに追跡し、
+// 区間を二分して再帰的に解く (Larmore-Hirschberg 方式)。
+// 再帰の各段で保持するのは中間ステージの重み1本だけなので、
+// 作業領域は O(n log L)、すなわち L に対してほとんど増えない。
+//
+namespace
+{
+	// @struct シンボル単体情報
+	struct SingleSymbol
+	{
+		unsigned		   alphabet = 0;		//! シンボル識別子
+		unsigned		   weight   = 0;		//!	重み (出現回数)
+
+		SingleSymbol()
+		{}
+
+		SingleSymbol(unsigned	alp, unsigned wei)
+			: alphabet(alp)
+			, weight(wei)
+		{}
+	};
+
+	// using
+	using SingleSymbolList = std::vector<SingleSymbol>;
+	using WeightList       = std::vector<unsigned long long>;
+	using SupportList      = std::vector<unsigned>;
+
+	// @struct 順方向の計算に使う作業バッファ
+	struct StageBuffer
+	{
+		WeightList	weights;	//! ステージ上のノードの重み (昇順)
+		SupportList	supports;	//! 先頭からこのノードまでを作るのに必要な、中間ステージの要素数
+	};
+
+	// @struct 作業バッファ
+	struct DivideAndConquerPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		SingleSymbolList		symbolList;
+		PackageMerge::SymbolSortBuffer	sortBuffer;
+		WeightList				topStage;
+		StageBuffer				work[2];
+		std::vector<WeightList>	midStages;			//! 再帰の深さごとに控える中間ステージの重み
+		std::vector<size_t>		symbolCounts;		//! ステージごとの採用シンボル数
+		std::vector<unsigned>	numStageBySymbol;
+	};
+
+	// @brief 次のステージの重みを構築
+	// @note  pPrevSupports が null でなければ、中間ステージの要素数の追跡も行う
+	//-------------------------------------------------------------
+	void MergeStage(const SingleSymbolList& symbolList, const WeightList& prevWeights, const SupportList* pPrevSupports, StageBuffer& /*out*/next)
+	{
+		size_t numPackage = prevWeights.size() / 2;
+		next.weights.clear();
+		next.supports.clear();
+
+		size_t	 symbol_i    = 0;
+		size_t	 package_i   = 0;
+		unsigned lastSupport = 0;
+		while (symbol_i < symbolList.size() || package_i < numPackage)
+		{
+			if (package_i < numPackage)
+			{
+				size_t			   rightIndex    = package_i * 2 + 1;
+				unsigned long long packageWeight = prevWeights[rightIndex - 1] + prevWeights[rightIndex];
+
+				// 重みが等しい場合はパッケージが優先
+				if (symbol_i >= symbolList.size() || packageWeight <= symbolList[symbol_i].weight)
+				{
+					next.weights.push_back(packageWeight);
+					if (pPrevSupports)
+					{
+						lastSupport = (*pPrevSupports)[rightIndex];
+						next.supports.push_back(lastSupport);
+					}
+					++package_i;
+					continue;
+				}
+			}
+			// note: シンボル単体は上のステージを参照しないため、直前のノードの値を引き継ぐ
+			next.weights.push_back(symbolList[symbol_i++].weight);
+			if (pPrevSupports)
+				next.supports.push_back(lastSupport);
+		}
+
+		// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
+		if (next.weights.size() & 0x1)
+		{
+			next.weights.pop_back();
+			if (pPrevSupports)
+				next.supports.pop_back();
+		}
+	}
+
+	// @brief ステージ区間 (lo, hi] の採用シンボル数を求める
+	// @param rStageLo  ステージ lo の重み
+	// @param activeHi  ステージ hi で採用されるプレフィックスの長さ
+	// @return ステージ lo で採用されるプレフィックスの長さ
+	//-------------------------------------------------------------
+	size_t SolveStageRange(const WeightList& rStageLo, size_t lo, size_t hi, size_t activeHi, size_t depth, DivideAndConquerPMBuffer& /*ref*/buffer)
+	{
+		const SingleSymbolList& symbolList   = buffer.symbolList;
+		std::vector<size_t>&	symbolCounts = buffer.symbolCounts;
+		StageBuffer (&work)[2]				 = buffer.work;
+
+		// 何も採用されないなら、上のステージでも何も採用されない
+		if (activeHi == 0)
+		{
+			for (size_t stage_i = lo + 1; stage_i <= hi; ++stage_i)
+				symbolCounts[stage_i] = 0;
+
+			return 0;
+		}
+
+		// 隣り合うステージ: マージ順をなぞってプレフィックス中のシンボル単体を数える
+		if (hi == lo + 1)
+		{
+			size_t numPackage = rStageLo.size() / 2;
+			size_t symbol_i   = 0;
+			size_t package_i  = 0;
+			for (size_t i = 0; i < activeHi; ++i)
+			{
+				if (package_i < numPackage &&
+					(symbol_i >= symbolList.size() || rStageLo[package_i * 2] + rStageLo[package_i * 2 + 1] <= symbolList[symbol_i].weight))
+					++package_i;
+				else
+					++symbol_i;
+			}
+			symbolCounts[hi] = symbol_i;
+			return package_i * 2;
+		}
+
+		// lo から hi まで順に作りながら、中間ステージの重みを控えておく
+		size_t		mid		 = (lo + hi) / 2;
+		assert(depth < buffer.midStages.size() && "中間ステージの控えが足りないのはあり得ない");
+		WeightList& midStage = buffer.midStages[depth];
+
+		MergeStage(symbolList, rStageLo, nullptr, /*out*/work[0]);
+		for (size_t stage_i = lo + 1; stage_i < hi; ++stage_i)
+		{
+			StageBuffer& prev = work[(stage_i - lo - 1) & 0x1];
+			StageBuffer& next = work[(stage_i - lo) & 0x1];
+
+			if (stage_i == mid)
+			{
+				midStage.assign(prev.weights.begin(), prev.weights.end());
+
+				// 中間ステージでは 自身の位置 +1 がそのまま必要な要素数
+				prev.supports.resize(prev.weights.size());
+				for (size_t i = 0; i < prev.supports.size(); ++i)
+					prev.supports[i] = static_cast<unsigned>(i + 1);
+			}
+			MergeStage(symbolList, prev.weights, (stage_i >= mid) ? &prev.supports : nullptr, /*out*/next);
+		}
+		const StageBuffer& stageHi = work[(hi - lo - 1) & 0x1];
+		assert(activeHi <= stageHi.supports.size() && "採用数がステージの要素数を超えるのはあり得ない");
+
+		size_t activeMid = stageHi.supports[activeHi - 1];
+
+		// 下半分を解いてから上半分を解く
+		// note: 下半分は控えた中間ステージから始めるので、上半分の計算を繰り返さずに済む
+		size_t solvedMid = SolveStageRange(midStage, mid, hi, activeHi, depth + 1, buffer);
+		assert(solvedMid == activeMid && "中間ステージの採用数が一致しないのはあり得ない");
+		(void)solvedMid;
+
+		return SolveStageRange(rStageLo, lo, mid, activeMid, depth + 1, buffer);
+	}
+
+	// @brief 長さテーブル構築
+	// @note  重みの昇順で j 番目のシンボルの符号長は、採用シンボル数が j を超えるステージの数
+	//-------------------------------------------------------------
+	void BuildBitLengthsArray(const std::vector<size_t>& symbolCounts, const SingleSymbolList& rSymbolList, size_t arraySize,
+							  std::vector<unsigned>& /*work*/numStageBySymbol, unsigned* /*out*/bitLengthsList)
+	{
+		numStageBySymbol.assign(rSymbolList.size() + 1, 0);
+		for (size_t count : symbolCounts)
+			numStageBySymbol[count] += 1;
+
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		unsigned bitLength = static_cast<unsigned>(symbolCounts.size());
+		for (size_t i = 0; i < rSymbolList.size(); ++i)
+		{
+			bitLength -= numStageBySymbol[i];
+			bitLengthsList[rSymbolList[i].alphabet] = bitLength;
+		}
+	}
+
+	// @brief 分割統治パッケージマージアルゴリズム本体
+	//-------------------------------------------------------------
+	PackageMerge::Status DivideAndConquerPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		DivideAndConquerPMBuffer& buffer = rWorkspace.GetBuffer<DivideAndConquerPMBuffer>(Workspace::SLOT_DIVIDE_AND_CONQUER);
+		StatsScope	stats(rWorkspace, Workspace::SLOT_DIVIDE_AND_CONQUER);
+
+		const SingleSymbolList& symbolList = buffer.symbolList;
+		ExtractSortedSymbolList(symbolWeights, arraySize, buffer.sortBuffer, /*out*/buffer.symbolList);
+		stats.EndSort();
+
+		if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		std::vector<size_t>& symbolCounts = buffer.symbolCounts;
+		if (symbolList.size() <= 1)
+		{
+			symbolCounts.assign(1, symbolList.size());
+			BuildBitLengthsArray(symbolCounts, symbolList, arraySize, buffer.numStageBySymbol, /*out*/pBitLengths);
+			return STATUS_SUCCESS;
+		}
+
+		// 無駄を軽減
+		if (codeLengthLimit > symbolList.size())
+			codeLengthLimit = symbolList.size();
+
+		// 一番上のステージはシンボル単体のみ
+		WeightList& topStage = buffer.topStage;
+		topStage.resize(symbolList.size() & ~static_cast<size_t>(1));
+		for (size_t i = 0; i < topStage.size(); ++i)
+			topStage[i] = symbolList[i].weight;
+
+		// 最下段で採用されるノードの数は、シンボル数を n としたとき 2n-2
+		symbolCounts.assign(codeLengthLimit, 0);
+		size_t numLastStageNode = (2 * symbolList.size()) - 2;
+
+		if (codeLengthLimit == 1)
+		{
+			symbolCounts[0] = numLastStageNode;
+		}
+		else
+		{
+			// note: 各ステージの要素数は 2n 未満に収まる
+			for (StageBuffer& work : buffer.work)
+			{
+				work.weights.reserve(2 * symbolList.size());
+				work.supports.reserve(2 * symbolList.size());
+			}
+			// note: 控えた中間ステージを参照したまま再帰するため、ここで深さの分だけ用意しておく
+			size_t maxDepth = 1;
+			for (size_t range = codeLengthLimit - 1; range > 1; range = (range + 1) / 2)
+				++maxDepth;
+
+			if (buffer.midStages.size() < maxDepth)
+				buffer.midStages.resize(maxDepth);
+
+			symbolCounts[0] = SolveStageRange(topStage, 0, codeLengthLimit - 1, numLastStageNode, 0, /*ref*/buffer);
+		}
+		BuildBitLengthsArray(symbolCounts, symbolList, arraySize, buffer.numStageBySymbol, /*out*/pBitLengths);
+		return STATUS_SUCCESS;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 分割統治パッケージマージアルゴリズム
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::DivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!DivideAndConquerPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief 分割統治パッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------	
+bool PackageMerge::DivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return DivideAndConquerPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 分割統治パッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryDivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return DivideAndConquerPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
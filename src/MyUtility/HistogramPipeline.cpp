@@ -0,0 +1,444 @@
+//-------------------------------------------------------------
+//! @brief	ヒストグラムの集計から符号長までの一括処理
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "HistogramPipeline.h"
+#include <algorithm>	// std::fill, std::min, std::max
+#include <atomic>
+#include <chrono>
+#include <cstring>		// std::memcpy
+#include <exception>	// std::exception_ptr
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>		// open
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#include <unistd.h>		// close
+#endif
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::PackageMerge;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// 1byte ごとの集計で使う表の数
+	// note: 同じ値が続くと同じカウンタへの読み書きが連なって待たされるため、連続するバイトを別の表に振り分ける
+	const size_t NUM_TABLE_8 = 4;
+
+	// ブロックの最大バイト数 (ヒストグラムが 32bit であふれない)
+	const size_t MAX_BLOCK_SIZE = 0xFFFFFFFFu;
+
+	// @brief 経過時間 (ms)
+	//-------------------------------------------------------------
+	double ElapsedMs(Clock::time_point begin, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	// @class 読み込み専用でメモリに割り当てたファイル
+	class MappedFile
+	{
+	public:
+
+		MappedFile()
+		{}
+
+		~MappedFile()
+		{
+			Close();
+		}
+
+		MappedFile(const MappedFile&)				= delete;
+		MappedFile& operator=(const MappedFile&)	= delete;
+
+		// @brief 開く (空のファイルは割り当てずに成功とする)
+		//---------------------------------------------------------
+		bool Open(const char* path)
+		{
+			Close();
+#if defined(_WIN32)
+			m_hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (m_hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_hFile, &size))
+				return false;
+
+			m_size = static_cast<size_t>(size.QuadPart);
+			if (m_size == 0)
+				return true;
+
+			m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_hMapping == nullptr)
+				return false;
+
+			m_pData = static_cast<const unsigned char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+			return m_pData != nullptr;
+#else
+			m_fd = open(path, O_RDONLY);
+			if (m_fd < 0)
+				return false;
+
+			struct stat st;
+			if (fstat(m_fd, &st) != 0)
+				return false;
+
+			m_size = static_cast<size_t>(st.st_size);
+			if (m_size == 0)
+				return true;
+
+			void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+			if (p == MAP_FAILED)
+				return false;
+
+			// 先頭から順に読むことを伝えて先読みさせる
+			madvise(p, m_size, MADV_SEQUENTIAL);
+			m_pData = static_cast<const unsigned char*>(p);
+			return true;
+#endif
+		}
+
+		// @brief 閉じる
+		//---------------------------------------------------------
+		void Close()
+		{
+#if defined(_WIN32)
+			if (m_pData)
+				UnmapViewOfFile(m_pData);
+			if (m_hMapping)
+				CloseHandle(m_hMapping);
+			if (m_hFile != INVALID_HANDLE_VALUE)
+				CloseHandle(m_hFile);
+
+			m_hMapping	= nullptr;
+			m_hFile		= INVALID_HANDLE_VALUE;
+#else
+			if (m_pData)
+				munmap(const_cast<unsigned char*>(m_pData), m_size);
+			if (m_fd >= 0)
+				close(m_fd);
+
+			m_fd = -1;
+#endif
+			m_pData = nullptr;
+			m_size	= 0;
+		}
+
+		const unsigned char* GetData() const { return m_pData; }
+		size_t				 GetSize() const { return m_size; }
+
+	private:
+#if defined(_WIN32)
+		HANDLE				 m_hFile	= INVALID_HANDLE_VALUE;
+		HANDLE				 m_hMapping	= nullptr;
+#else
+		int					 m_fd		= -1;
+#endif
+		const unsigned char* m_pData	= nullptr;
+		size_t				 m_size		= 0;
+	};
+
+	// @struct スレッドごとの作業領域
+	struct Worker
+	{
+		Workspace	workspace;
+		double		histogramMs	 = 0.0;
+		double		codeLengthMs = 0.0;
+	};
+}
+
+//-------------------------------------------------------------
+// HistogramPipeline::Impl
+//-------------------------------------------------------------
+struct HistogramPipeline::Impl
+{
+	HistogramPipelineConfig		config;
+	std::vector<Worker>			workers;		//! スレッドごと (0 は呼び出し元)
+
+	// 直近の Run() の結果
+	size_t						numBlock	= 0;
+	size_t						alphabetSize = 0;
+	std::vector<unsigned>		histograms;		//! ブロック数 × アルファベット数
+	std::vector<unsigned>		bitLengths;		//! ブロック数 × アルファベット数
+	std::vector<unsigned char>	succeeded;		//! ブロックごと
+	HistogramPipelineTiming		timing;
+
+	// 実行中の Run() の内容
+	const unsigned char*		pData		= nullptr;
+	size_t						size		= 0;
+	size_t						blockSize	= 0;
+	std::atomic<size_t>			nextBlock{ 0 };
+	std::mutex					errorMutex;
+	std::exception_ptr			error;
+
+	// @brief ブロックをひとつ処理する
+	//-------------------------------------------------------------
+	void ProcessBlock(size_t blockIdx, Worker& rWorker)
+	{
+		const size_t		 begin		= blockIdx * blockSize;
+		const size_t		 blockBytes	= std::min(blockSize, size - begin);
+		unsigned*			 pHistogram	= histograms.data() + blockIdx * alphabetSize;
+		unsigned*			 pBitLengths = bitLengths.data() + blockIdx * alphabetSize;
+
+		Clock::time_point t0 = Clock::now();
+		std::fill(pHistogram, pHistogram + alphabetSize, 0u);
+		if (config.symbolWidth == SYMBOL_WIDTH_16)
+			CountHistogram16(pData + begin, blockBytes, pHistogram);
+		else
+			CountHistogram8(pData + begin, blockBytes, pHistogram);
+
+		Clock::time_point t1 = Clock::now();
+		try
+		{
+			succeeded[blockIdx] = config.engine(pHistogram, alphabetSize, config.codeLengthLimit, rWorker.workspace, pBitLengths);
+		}
+		catch (...)
+		{
+			succeeded[blockIdx] = false;
+
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+		Clock::time_point t2 = Clock::now();
+
+		rWorker.histogramMs	 += ElapsedMs(t0, t1);
+		rWorker.codeLengthMs += ElapsedMs(t1, t2);
+	}
+
+	// @brief すべてのブロックを処理する
+	// @param begin 経過時間の起点
+	//-------------------------------------------------------------
+	bool Execute(const unsigned char* data, size_t dataSize, Clock::time_point begin)
+	{
+		pData		 = data;
+		size		 = dataSize;
+		blockSize	 = config.blockSize;
+		numBlock	 = (size + blockSize - 1) / blockSize;
+		alphabetSize = (config.symbolWidth == SYMBOL_WIDTH_16) ? 0x10000 : 0x100;
+		histograms.resize(numBlock * alphabetSize);
+		bitLengths.resize(numBlock * alphabetSize);
+		succeeded.assign(numBlock, 0);
+		nextBlock.store(0, std::memory_order_relaxed);
+		error = nullptr;
+
+		for (Worker& rWorker : workers)
+			rWorker.histogramMs = rWorker.codeLengthMs = 0.0;
+
+		// ブロックより多くのスレッドは立てない (0 番は呼び出し元のスレッド自身)
+		size_t numWorker = std::min(workers.size(), std::max<size_t>(numBlock, 1));
+
+		std::vector<std::thread> threads;
+		threads.reserve(numWorker - 1);
+		for (size_t i = 1; i < numWorker; ++i)
+			threads.emplace_back(&Impl::WorkerMain, this, i);
+
+		WorkerMain(0);
+		for (std::thread& thread : threads)
+			thread.join();
+
+		timing.histogramMs	= 0.0;
+		timing.codeLengthMs	= 0.0;
+		for (const Worker& rWorker : workers)
+		{
+			timing.histogramMs	+= rWorker.histogramMs;
+			timing.codeLengthMs	+= rWorker.codeLengthMs;
+		}
+		timing.wallMs = ElapsedMs(begin, Clock::now());
+
+		if (error)
+			std::rethrow_exception(error);
+
+		return std::find(succeeded.begin(), succeeded.end(), 0) == succeeded.end();
+	}
+
+	// @brief ブロックがなくなるまで取り出して処理する
+	//-------------------------------------------------------------
+	void WorkerMain(size_t workerIdx)
+	{
+		Worker& rWorker = workers[workerIdx];
+		for (;;)
+		{
+			size_t blockIdx = nextBlock.fetch_add(1, std::memory_order_relaxed);
+			if (blockIdx >= numBlock)
+				return;
+
+			ProcessBlock(blockIdx, rWorker);
+		}
+	}
+};
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 1byte ごとのヒストグラム
+// @note  8byte ずつ読み、連続するバイトを NUM_TABLE_8 個の表に振り分けて数えてから合計する
+//-------------------------------------------------------------
+void PackageMerge::CountHistogram8(const unsigned char* data, size_t size, unsigned* /*inout*/counts)
+{
+	unsigned tables[NUM_TABLE_8][256];
+	std::fill(&tables[0][0], &tables[0][0] + NUM_TABLE_8 * 256, 0u);
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		unsigned long long word;
+		std::memcpy(&word, data + i, sizeof(word));
+
+		tables[0][word		   & 0xFF] += 1;
+		tables[1][(word >> 8)  & 0xFF] += 1;
+		tables[2][(word >> 16) & 0xFF] += 1;
+		tables[3][(word >> 24) & 0xFF] += 1;
+		tables[0][(word >> 32) & 0xFF] += 1;
+		tables[1][(word >> 40) & 0xFF] += 1;
+		tables[2][(word >> 48) & 0xFF] += 1;
+		tables[3][(word >> 56)		 ] += 1;
+	}
+	for (; i < size; ++i)
+		tables[0][data[i]] += 1;
+
+	for (size_t v = 0; v < 256; ++v)
+		counts[v] += tables[0][v] + tables[1][v] + tables[2][v] + tables[3][v];
+}
+
+// @brief 2byte ごとのヒストグラム
+// @note  表が 256KB と大きく、複数に分けるとキャッシュからあふれて遅くなるため 1つの表に数える
+//-------------------------------------------------------------
+void PackageMerge::CountHistogram16(const unsigned char* data, size_t size, unsigned* /*inout*/counts)
+{
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		unsigned long long word;
+		std::memcpy(&word, data + i, sizeof(word));
+
+		counts[word			& 0xFFFF] += 1;
+		counts[(word >> 16) & 0xFFFF] += 1;
+		counts[(word >> 32) & 0xFFFF] += 1;
+		counts[(word >> 48)			] += 1;
+	}
+	for (; i + 2 <= size; i += 2)
+		counts[data[i] | (data[i + 1] << 8)] += 1;
+}
+
+// @brief コンストラクタ
+//-------------------------------------------------------------
+HistogramPipeline::HistogramPipeline(const HistogramPipelineConfig& config)
+	: m_pImpl(new Impl())
+{
+	m_pImpl->config = config;
+	if (m_pImpl->config.numThread == 0)
+		m_pImpl->config.numThread = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+	// ブロックはシンボルの幅の倍数にする
+	size_t width	  = static_cast<size_t>(m_pImpl->config.symbolWidth);
+	size_t blockSize  = std::min(std::max(m_pImpl->config.blockSize, width), MAX_BLOCK_SIZE - 1);
+	m_pImpl->config.blockSize = (blockSize + width - 1) / width * width;
+
+	m_pImpl->workers.resize(m_pImpl->config.numThread);
+}
+
+// @brief デストラクタ
+//-------------------------------------------------------------
+HistogramPipeline::~HistogramPipeline()
+{}
+
+// @brief メモリ上の入力を処理する
+//-------------------------------------------------------------
+bool HistogramPipeline::Run(const unsigned char* data, size_t size)
+{
+	m_pImpl->timing.mapMs = 0.0;
+	return m_pImpl->Execute(data, size, Clock::now());
+}
+
+// @brief ファイルをメモリに割り当てて処理する
+//-------------------------------------------------------------
+bool HistogramPipeline::RunFile(const char* path)
+{
+	Clock::time_point begin = Clock::now();
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	m_pImpl->timing.mapMs = ElapsedMs(begin, Clock::now());
+	return m_pImpl->Execute(file.GetData(), file.GetSize(), begin);
+}
+
+// @brief 設定
+//-------------------------------------------------------------
+const HistogramPipelineConfig& HistogramPipeline::GetConfig() const
+{
+	return m_pImpl->config;
+}
+
+// @brief 入力のバイト数
+//-------------------------------------------------------------
+size_t HistogramPipeline::GetInputSize() const
+{
+	return m_pImpl->size;
+}
+
+// @brief ブロック数
+//-------------------------------------------------------------
+size_t HistogramPipeline::GetBlockCount() const
+{
+	return m_pImpl->numBlock;
+}
+
+// @brief アルファベット数
+//-------------------------------------------------------------
+size_t HistogramPipeline::GetAlphabetSize() const
+{
+	return m_pImpl->alphabetSize;
+}
+
+// @brief ブロックのヒストグラム
+//-------------------------------------------------------------
+const unsigned* HistogramPipeline::GetHistogram(size_t blockIdx) const
+{
+	return m_pImpl->histograms.data() + blockIdx * m_pImpl->alphabetSize;
+}
+
+// @brief ブロックの符号長
+//-------------------------------------------------------------
+const unsigned* HistogramPipeline::GetBitLengths(size_t blockIdx) const
+{
+	return m_pImpl->bitLengths.data() + blockIdx * m_pImpl->alphabetSize;
+}
+
+// @brief ブロックを符号化できたか
+//-------------------------------------------------------------
+bool HistogramPipeline::IsSucceeded(size_t blockIdx) const
+{
+	return m_pImpl->succeeded[blockIdx] != 0;
+}
+
+// @brief 段ごとの所要時間
+//-------------------------------------------------------------
+const HistogramPipelineTiming& HistogramPipeline::GetTiming() const
+{
+	return m_pImpl->timing;
+}
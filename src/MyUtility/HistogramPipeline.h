@@ -0,0 +1,103 @@
+//-------------------------------------------------------------
+//! @brief	ヒストグラムの集計から符号長までの一括処理
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @enum シンボルの幅
+	enum SymbolWidth
+	{
+		SYMBOL_WIDTH_8	= 1,	//! 1byte ごと (256 種類)
+		SYMBOL_WIDTH_16	= 2,	//! 2byte ごと、リトルエンディアン (65536 種類)
+	};
+
+	//! 1byte ごとのヒストグラムを counts (256 要素) に加算する
+	void CountHistogram8(const unsigned char* data, size_t size, unsigned* /*inout*/counts);
+
+	//! 2byte ごとのヒストグラムを counts (65536 要素) に加算する (端数の 1byte は数えない)
+	void CountHistogram16(const unsigned char* data, size_t size, unsigned* /*inout*/counts);
+
+	// @struct 一括処理の設定
+	struct HistogramPipelineConfig
+	{
+		size_t		blockSize		= 1 << 16;			//! ブロックのバイト数 (シンボルの幅の倍数に切り上げる)
+		SymbolWidth	symbolWidth		= SYMBOL_WIDTH_8;
+		size_t		codeLengthLimit	= 15;				//! 制限符号長
+		size_t		numThread		= 0;				//! 使うスレッド数 (呼び出し元のスレッドを含む)。0 ならハードウェアのスレッド数
+		EngineFunc	engine			= BoundaryPM;		//! 符号長を求めるアルゴリズム
+	};
+
+	// @struct 段ごとの所要時間 (直近の Run() 分)
+	// @note  ヒストグラムと符号長は全スレッドの合計なので、スレッドが多いと経過時間を超える
+	struct HistogramPipelineTiming
+	{
+		double	mapMs			= 0.0;	//! 入力の準備 (ファイルの割り当て)
+		double	histogramMs		= 0.0;	//! ヒストグラムの集計
+		double	codeLengthMs	= 0.0;	//! 符号長の計算
+		double	wallMs			= 0.0;	//! 全体の経過時間
+	};
+
+	// @class ヒストグラムの集計から符号長までの一括処理
+	// @note  入力をブロックに分け、各スレッドがブロックごとに ヒストグラム → 符号長 の順で処理する。
+	//        ブロックのヒストグラムはそのままアルゴリズムの入力になり、コピーしない。
+	//        結果は次の Run() まで保持する
+	class HistogramPipeline
+	{
+	public:
+
+		explicit HistogramPipeline(const HistogramPipelineConfig& config = HistogramPipelineConfig());
+		~HistogramPipeline();
+
+		HistogramPipeline(const HistogramPipeline&)				= delete;
+		HistogramPipeline& operator=(const HistogramPipeline&)	= delete;
+
+		//! メモリ上の入力を処理する
+		//! @return すべてのブロックを符号化できたら true
+		//! @note   途中でアルゴリズムが例外を投げた場合は、全ブロックの終了後に最初の例外を投げ直す
+		bool Run(const unsigned char* data, size_t size);
+
+		//! ファイルをメモリに割り当てて処理する
+		//! @return ファイルを開けなかったか、符号化できないブロックがあれば false
+		bool RunFile(const char* path);
+
+		//! 設定
+		const HistogramPipelineConfig& GetConfig() const;
+
+		//! 入力のバイト数
+		size_t GetInputSize() const;
+
+		//! ブロック数
+		size_t GetBlockCount() const;
+
+		//! アルファベット数 (ヒストグラムと符号長の要素数)
+		size_t GetAlphabetSize() const;
+
+		//! ブロックのヒストグラム
+		const unsigned* GetHistogram(size_t blockIdx) const;
+
+		//! ブロックの符号長
+		const unsigned* GetBitLengths(size_t blockIdx) const;
+
+		//! ブロックを符号化できたか
+		bool IsSucceeded(size_t blockIdx) const;
+
+		//! 段ごとの所要時間
+		const HistogramPipelineTiming& GetTiming() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pImpl;
+	};
+}
+}// end namespace
@@ -0,0 +1,446 @@
+//-------------------------------------------------------------
+//! @brief	正準ハフマン符号とテーブル復号
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "HuffmanCode.h"
+#include <algorithm>	// std::min, std::max
+#include <cstring>		// std::memcpy
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::Huffman;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// 表の要素は 64bit で、次の形をとる。
+//   [ 0.. 7] 消費するビット数 (次の段への参照なら、次の段の表のビット数)
+//   [ 8..15] シンボル数 (1 ～ 3)。0 なら次の段への参照、ビット数も 0 なら使われていない符号語
+//   [16..63] シンボル識別子 16bit × 3 (次の段への参照なら [32..63] が次の段の位置)
+//
+// 正準符号では、符号語を上位ビットから読んだ値の順と (符号長, シンボル識別子) の順が一致する。
+// そのため、同じ接頭辞を持つ符号語は正準順で連続し、次の段の表はその区間だけから作れる。
+//
+namespace
+{
+	// 最初の段の表でまとめるシンボル数の上限
+	const unsigned MAX_PACKED_SYMBOL = 3;
+
+	// 高速な復号ループで、1回の補充のあとに消費してよいビット数 (補充後は常に 56bit 以上ある)
+	const unsigned MIN_REFILLED_BITS = 56;
+
+	// @brief 下位 bitLength ビットを反転
+	//-------------------------------------------------------------
+	inline unsigned ReverseBits(unsigned code, unsigned bitLength)
+	{
+		unsigned result = 0;
+		for (unsigned i = 0; i < bitLength; ++i)
+		{
+			result = (result << 1) | (code & 1);
+			code >>= 1;
+		}
+		return result;
+	}
+
+	// @brief シンボルの要素を作る
+	//-------------------------------------------------------------
+	inline unsigned long long MakeSymbolEntry(unsigned symbol, unsigned bitLength)
+	{
+		return bitLength | (1ull << 8) | (static_cast<unsigned long long>(symbol) << 16);
+	}
+
+	// @brief 次の段への参照の要素を作る
+	//-------------------------------------------------------------
+	inline unsigned long long MakeLinkEntry(size_t offset, unsigned indexBits)
+	{
+		return indexBits | (static_cast<unsigned long long>(offset) << 32);
+	}
+
+	inline unsigned GetEntryBits(unsigned long long entry)		{ return static_cast<unsigned>(entry & 0xFF); }
+	inline unsigned GetEntryCount(unsigned long long entry)		{ return static_cast<unsigned>((entry >> 8) & 0xFF); }
+	inline unsigned GetEntrySymbol(unsigned long long entry, unsigned i) { return static_cast<unsigned>((entry >> (16 + 16 * i)) & 0xFFFF); }
+	inline size_t	GetEntryOffset(unsigned long long entry)	{ return static_cast<size_t>(entry >> 32); }
+
+	// @struct 下位ビットから読むビット列
+	struct BitReader
+	{
+		const unsigned char*	src		 = nullptr;
+		size_t					srcBytes = 0;
+		size_t					pos		 = 0;
+		unsigned long long		buffer	 = 0;
+		unsigned				bitCount = 0;
+
+		// @brief 8byte まとめて読めるか
+		//-------------------------------------------------------------
+		bool CanRefillFast() const
+		{
+			return srcBytes - pos >= sizeof(unsigned long long);
+		}
+
+		// @brief 8byte まとめて補充 (56bit 以上になる)
+		// @note  端数のバイトは次の補充で同じ位置に同じ値を重ねるため、そのまま残してよい
+		//-------------------------------------------------------------
+		void RefillFast()
+		{
+			unsigned long long word;
+			std::memcpy(&word, src + pos, sizeof(word));
+			buffer	 |= word << bitCount;
+			pos		 += (63 - bitCount) >> 3;
+			bitCount |= MIN_REFILLED_BITS;
+		}
+
+		// @brief 1byte ずつ補充 (入力の末尾付近)
+		//-------------------------------------------------------------
+		void RefillSlow()
+		{
+			while (bitCount <= MIN_REFILLED_BITS && pos < srcBytes)
+			{
+				buffer	 |= static_cast<unsigned long long>(src[pos++]) << bitCount;
+				bitCount += 8;
+			}
+		}
+
+		// @brief 消費
+		//-------------------------------------------------------------
+		void Consume(unsigned bits)
+		{
+			buffer	 >>= bits;
+			bitCount  -= bits;
+		}
+	};
+}
+
+//-------------------------------------------------------------
+// CanonicalCode
+//-------------------------------------------------------------
+
+// @brief 符号長の配列から符号語を割り当てる
+//-------------------------------------------------------------
+bool CanonicalCode::Build(const unsigned* bitLengths, size_t arraySize)
+{
+	m_bitLengths.clear();
+	m_reversedCodes.clear();
+	m_maxBitLength = 0;
+
+	if (arraySize > MAX_SYMBOL_COUNT)
+		return false;
+
+	// 符号長ごとのシンボル数
+	unsigned countByLength[MAX_BIT_LENGTH + 1] = {};
+	for (size_t i = 0; i < arraySize; ++i)
+	{
+		if (bitLengths[i] > MAX_BIT_LENGTH)
+			return false;
+
+		countByLength[bitLengths[i]] += 1;
+		m_maxBitLength = std::max(m_maxBitLength, bitLengths[i]);
+	}
+
+	// Kraft の不等式 (符号語が足りなくならないか)
+	long long available = 1;
+	for (unsigned len = 1; len <= MAX_BIT_LENGTH; ++len)
+	{
+		available = available * 2 - countByLength[len];
+		if (available < 0)
+			return false;
+
+		// note: これ以上長い符号語がなければ打ち切る (2^32 を超えないように)
+		if (len >= m_maxBitLength)
+			break;
+	}
+
+	// 符号長ごとの最初の符号語
+	unsigned nextCode[MAX_BIT_LENGTH + 1] = {};
+	unsigned code = 0;
+	for (unsigned len = 1; len <= MAX_BIT_LENGTH; ++len)
+	{
+		code		  = (code + (len > 1 ? countByLength[len - 1] : 0)) << 1;
+		nextCode[len] = code;
+	}
+
+	m_bitLengths.resize(arraySize);
+	m_reversedCodes.assign(arraySize, 0);
+	for (size_t i = 0; i < arraySize; ++i)
+	{
+		unsigned len	= bitLengths[i];
+		m_bitLengths[i] = static_cast<unsigned char>(len);
+		if (len)
+			m_reversedCodes[i] = ReverseBits(nextCode[len]++, len);
+	}
+	return true;
+}
+
+// @brief 符号語 (上位ビットから読む値)
+//-------------------------------------------------------------
+unsigned CanonicalCode::GetCode(size_t symbol) const
+{
+	return ReverseBits(m_reversedCodes[symbol], m_bitLengths[symbol]);
+}
+
+// @brief シンボル列を符号化して末尾に追加する
+//-------------------------------------------------------------
+template<class SYMBOL>
+bool CanonicalCode::EncodeImpl(const SYMBOL* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const
+{
+	const size_t startSize = out.size();
+	out.reserve(startSize + (numSymbol * m_maxBitLength + 7) / 8);
+
+	unsigned long long buffer	= 0;
+	unsigned		   bitCount = 0;
+	for (size_t i = 0; i < numSymbol; ++i)
+	{
+		size_t symbol = symbols[i];
+		if (symbol >= m_bitLengths.size() || m_bitLengths[symbol] == 0)
+		{
+			out.resize(startSize);
+			return false;
+		}
+
+		// note: bitCount は 32 未満、符号長は 32 以下なので 64bit に収まる
+		buffer	 |= static_cast<unsigned long long>(m_reversedCodes[symbol]) << bitCount;
+		bitCount += m_bitLengths[symbol];
+		if (bitCount >= 32)
+		{
+			unsigned char bytes[4] = {
+				static_cast<unsigned char>(buffer),		  static_cast<unsigned char>(buffer >> 8),
+				static_cast<unsigned char>(buffer >> 16), static_cast<unsigned char>(buffer >> 24) };
+			out.insert(out.end(), bytes, bytes + 4);
+			buffer	 >>= 32;
+			bitCount  -= 32;
+		}
+	}
+
+	// 残りのビット (最後のバイトの余りはゼロ)
+	for (; bitCount > 0; bitCount -= std::min(bitCount, 8u))
+	{
+		out.push_back(static_cast<unsigned char>(buffer));
+		buffer >>= 8;
+	}
+	return true;
+}
+
+bool CanonicalCode::Encode(const unsigned char* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const
+{
+	return EncodeImpl(symbols, numSymbol, out);
+}
+
+bool CanonicalCode::Encode(const unsigned short* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const
+{
+	return EncodeImpl(symbols, numSymbol, out);
+}
+
+//-------------------------------------------------------------
+// TableDecoder
+//-------------------------------------------------------------
+
+// @brief 符号長の配列から復号表を作る
+//-------------------------------------------------------------
+bool TableDecoder::Build(const unsigned* bitLengths, size_t arraySize, unsigned rootBits)
+{
+	m_table.clear();
+	m_rootTable.clear();
+	if (!m_code.Build(bitLengths, arraySize))
+		return false;
+
+	// 一番長い符号語より大きな表は無駄
+	m_rootBits = std::max(1u, std::min({ rootBits, 16u, m_code.GetMaxBitLength() }));
+
+	// 正準順 (符号長, シンボル識別子) に並べる
+	m_sortedSymbols.clear();
+	for (unsigned len = 1; len <= m_code.GetMaxBitLength(); ++len)
+	{
+		for (size_t i = 0; i < arraySize; ++i)
+		{
+			if (m_code.GetBitLength(i) == len)
+				m_sortedSymbols.push_back(static_cast<unsigned>(i));
+		}
+	}
+
+	// 1シンボルずつの表
+	m_table.assign(static_cast<size_t>(1) << m_rootBits, 0);
+	BuildLevel(0, m_rootBits, 0, 0, m_sortedSymbols.size());
+
+	// 最初の段: 続く短い符号語をまとめる
+	// note: 残りのビットで完結する符号語なら、その先のビットによらず表の同じ要素に当たる
+	const size_t rootSize = static_cast<size_t>(1) << m_rootBits;
+	m_rootTable.assign(m_table.begin(), m_table.begin() + rootSize);
+	for (size_t i = 0; i < rootSize; ++i)
+	{
+		unsigned long long entry = m_rootTable[i];
+		if (GetEntryCount(entry) != 1)
+			continue;
+
+		unsigned totalBits = GetEntryBits(entry);
+		unsigned count	   = 1;
+		while (count < MAX_PACKED_SYMBOL && totalBits < m_rootBits)
+		{
+			unsigned long long next = m_table[i >> totalBits];
+			if (GetEntryCount(next) != 1 || GetEntryBits(next) > m_rootBits - totalBits)
+				break;
+
+			entry	  |= static_cast<unsigned long long>(GetEntrySymbol(next, 0)) << (16 + 16 * count);
+			totalBits += GetEntryBits(next);
+			++count;
+		}
+		m_rootTable[i] = (entry & ~0xFFFFull) | totalBits | (static_cast<unsigned long long>(count) << 8);
+	}
+	return true;
+}
+
+// @brief 1段分の表を作る
+// @param offset    表の位置
+// @param indexBits 表のビット数
+// @param depth     この段までに読んだビット数
+// @param first, last 接頭辞 depth ビットが共通する符号語の区間 (正準順)
+//-------------------------------------------------------------
+void TableDecoder::BuildLevel(size_t offset, unsigned indexBits, unsigned depth, size_t first, size_t last)
+{
+	const unsigned indexMask = (1u << indexBits) - 1;
+	for (size_t i = first; i < last; )
+	{
+		unsigned symbol = m_sortedSymbols[i];
+		unsigned len	= m_code.GetBitLength(symbol);
+		unsigned suffix = static_cast<unsigned>(static_cast<unsigned long long>(m_code.GetReversedCode(symbol)) >> depth);
+
+		// この段で完結する: 残りのビットによらず同じシンボル
+		if (len - depth <= indexBits)
+		{
+			for (size_t idx = suffix; idx <= indexMask; idx += static_cast<size_t>(1) << (len - depth))
+				m_table[offset + idx] = MakeSymbolEntry(symbol, len - depth);
+
+			++i;
+			continue;
+		}
+
+		// 次の段へ: この段の indexBits ビットが同じ符号語をまとめる
+		unsigned key	= suffix & indexMask;
+		unsigned maxLen = len;
+		size_t	 j		= i + 1;
+		for (; j < last; ++j)
+		{
+			unsigned other = m_sortedSymbols[j];
+			if (((static_cast<unsigned long long>(m_code.GetReversedCode(other)) >> depth) & indexMask) != key)
+				break;
+
+			maxLen = std::max(maxLen, m_code.GetBitLength(other));
+		}
+
+		unsigned subBits   = std::min(m_rootBits, maxLen - depth - indexBits);
+		size_t	 subOffset = m_table.size();
+		m_table.resize(subOffset + (static_cast<size_t>(1) << subBits), 0);
+		m_table[offset + key] = MakeLinkEntry(subOffset, subBits);
+
+		BuildLevel(subOffset, subBits, depth + indexBits, i, j);
+		i = j;
+	}
+}
+
+// @brief シンボルを復号する
+//-------------------------------------------------------------
+template<class SYMBOL>
+bool TableDecoder::DecodeImpl(const unsigned char* src, size_t srcBytes, SYMBOL* dst, size_t numSymbol) const
+{
+	if (m_table.empty() || (sizeof(SYMBOL) == 1 && m_code.GetSymbolCount() > 0x100))
+		return numSymbol == 0;
+
+	const unsigned long long* const table	  = m_table.data();
+	const unsigned long long* const rootTable = m_rootTable.data();
+	const unsigned long long		rootMask  = (1ull << m_rootBits) - 1;
+
+	BitReader reader;
+	reader.src		= src;
+	reader.srcBytes = srcBytes;
+
+	// 次の段をたどって 1シンボル復号する
+	// @return 使われていない符号語、または入力が足りない場合は false
+	auto decodeLong = [&](unsigned long long entry, SYMBOL* pOut) -> bool
+	{
+		if (reader.bitCount < m_rootBits)
+			return false;
+		reader.Consume(m_rootBits);
+
+		for (;;)
+		{
+			unsigned bits = GetEntryBits(entry);
+			if (bits == 0)
+				return false;
+
+			entry = table[GetEntryOffset(entry) + (reader.buffer & ((1ull << bits) - 1))];
+			if (GetEntryCount(entry) != 0)
+			{
+				if (reader.bitCount < GetEntryBits(entry))
+					return false;
+
+				*pOut = static_cast<SYMBOL>(GetEntrySymbol(entry, 0));
+				reader.Consume(GetEntryBits(entry));
+				return true;
+			}
+			if (GetEntryBits(entry) == 0 || reader.bitCount < bits)
+				return false;
+
+			reader.Consume(bits);
+		}
+	};
+
+	// 高速: 8byte ずつ補充し、最初の段でまとめて最大 3 シンボルを書く
+	// note: 補充後は 56bit 以上あり、1回の復号で消費するのは最大 32bit
+	size_t out = 0;
+	while (numSymbol - out >= MAX_PACKED_SYMBOL && reader.CanRefillFast())
+	{
+		reader.RefillFast();
+
+		unsigned long long entry = rootTable[reader.buffer & rootMask];
+		unsigned		   count = GetEntryCount(entry);
+		if (count)
+		{
+			dst[out + 0] = static_cast<SYMBOL>(GetEntrySymbol(entry, 0));
+			dst[out + 1] = static_cast<SYMBOL>(GetEntrySymbol(entry, 1));
+			dst[out + 2] = static_cast<SYMBOL>(GetEntrySymbol(entry, 2));
+			out += count;
+			reader.Consume(GetEntryBits(entry));
+			continue;
+		}
+		if (!decodeLong(entry, dst + out))
+			return false;
+		++out;
+	}
+
+	// 末尾: 1byte ずつ補充し、1シンボルずつ復号する
+	while (out < numSymbol)
+	{
+		reader.RefillSlow();
+
+		unsigned long long entry = table[reader.buffer & rootMask];
+		if (GetEntryCount(entry))
+		{
+			if (reader.bitCount < GetEntryBits(entry))
+				return false;
+
+			dst[out++] = static_cast<SYMBOL>(GetEntrySymbol(entry, 0));
+			reader.Consume(GetEntryBits(entry));
+			continue;
+		}
+		if (!decodeLong(entry, dst + out))
+			return false;
+		++out;
+	}
+	return true;
+}
+
+bool TableDecoder::Decode(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t numSymbol) const
+{
+	return DecodeImpl(src, srcBytes, dst, numSymbol);
+}
+
+bool TableDecoder::Decode(const unsigned char* src, size_t srcBytes, unsigned short* dst, size_t numSymbol) const
+{
+	return DecodeImpl(src, srcBytes, dst, numSymbol);
+}
@@ -0,0 +1,106 @@
+//-------------------------------------------------------------
+//! @brief	正準ハフマン符号とテーブル復号
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <vector>
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace Huffman
+{
+	// note:
+	// ビット列は DEFLATE と同じく、各バイトの下位ビットから詰める。
+	// 符号語は上位ビットから順に出力する (= 下位ビットから詰めるために反転した値を書き込む)。
+	// パッケージマージの出力 (符号長の配列) をそのまま受け取り、符号長 0 のシンボルは使わない
+
+	//! 扱える最大の符号長
+	const unsigned MAX_BIT_LENGTH = 32;
+
+	//! 扱える最大のシンボル数 (テーブルにはシンボル識別子を 16bit で保持する)
+	const size_t MAX_SYMBOL_COUNT = 1 << 16;
+
+	// @class 正準ハフマン符号
+	// @note  符号長が短い順、同じ長さならシンボル識別子の昇順に、連続した符号語を割り当てる
+	class CanonicalCode
+	{
+	public:
+
+		//! 符号長の配列から符号語を割り当てる
+		//! @return 符号長が長すぎる、シンボルが多すぎる、Kraft の不等式を満たさない場合は false
+		bool Build(const unsigned* bitLengths, size_t arraySize);
+
+		//! シンボル数 (符号長の配列の要素数)
+		size_t GetSymbolCount() const { return m_bitLengths.size(); }
+
+		//! 一番長い符号長
+		unsigned GetMaxBitLength() const { return m_maxBitLength; }
+
+		//! 符号長
+		unsigned GetBitLength(size_t symbol) const { return m_bitLengths[symbol]; }
+
+		//! 符号語 (上位ビットから読む値)
+		unsigned GetCode(size_t symbol) const;
+
+		//! 下位ビットから詰めるために反転した符号語
+		unsigned GetReversedCode(size_t symbol) const { return m_reversedCodes[symbol]; }
+
+		//! シンボル列を符号化して末尾に追加する (最後のバイトの余りはゼロで埋める)
+		//! @return 符号長 0 のシンボルや範囲外のシンボルを含む場合は false
+		bool Encode(const unsigned char* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const;
+		bool Encode(const unsigned short* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const;
+
+	private:
+		template<class SYMBOL>
+		bool EncodeImpl(const SYMBOL* symbols, size_t numSymbol, std::vector<unsigned char>& /*inout*/out) const;
+
+		std::vector<unsigned char>	m_bitLengths;
+		std::vector<unsigned>		m_reversedCodes;
+		unsigned					m_maxBitLength = 0;
+	};
+
+	// @class 多段テーブルによる復号器
+	// @note  最初の段は rootBits ビットで引き、それより長い符号語は次の段の表 (最大 rootBits ビット) をたどる。
+	//        最初の段では、続けて rootBits に収まる短い符号語を最大 3 シンボルまでまとめて返す
+	class TableDecoder
+	{
+	public:
+
+		//! 符号長の配列から復号表を作る
+		//! @param rootBits 最初の段の表のビット数 (1 ～ 16)
+		//! @return 符号が不正 (CanonicalCode::Build() と同じ条件) なら false
+		bool Build(const unsigned* bitLengths, size_t arraySize, unsigned rootBits = 11);
+
+		//! numSymbol 個のシンボルを復号する
+		//! @return 入力が足りない、または使われていない符号語に当たった場合は false
+		bool Decode(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t numSymbol) const;
+		bool Decode(const unsigned char* src, size_t srcBytes, unsigned short* dst, size_t numSymbol) const;
+
+		//! 復号表のもとになった正準符号
+		const CanonicalCode& GetCanonicalCode() const { return m_code; }
+
+		//! 最初の段のビット数
+		unsigned GetRootBits() const { return m_rootBits; }
+
+		//! 表の要素数 (全段の合計)
+		size_t GetTableSize() const { return m_table.size(); }
+
+	private:
+		template<class SYMBOL>
+		bool DecodeImpl(const unsigned char* src, size_t srcBytes, SYMBOL* dst, size_t numSymbol) const;
+
+		void BuildLevel(size_t offset, unsigned indexBits, unsigned depth, size_t first, size_t last);
+
+		CanonicalCode					m_code;
+		std::vector<unsigned long long>	m_table;			//! 1シンボルずつの表 (最初の段の後ろに次の段が続く)
+		std::vector<unsigned long long>	m_rootTable;		//! 複数シンボルをまとめた最初の段
+		std::vector<unsigned>			m_sortedSymbols;	//! 作業用: 正準順に並べたシンボル
+		unsigned						m_rootBits = 0;
+	};
+}
+}// end namespace
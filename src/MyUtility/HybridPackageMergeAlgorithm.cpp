@@ -0,0 +1,357 @@
+//-------------------------------------------------------------
+//! @brief	ハフマン符号を先に試すパッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill, std::min
+#include <cassert>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// 制限のないハフマン符号の最大符号長が制限符号長以下であれば、
+// それは長さ制限つきの問題に対しても最適解になる。
+// 実際のヒストグラムではこちらに収まることが多いため、
+// まず重みの昇順に並んだリストの上でハフマン符号長を O(n) で求め (Moffat-Katajainen の in-place 方式)、
+// 収まらなかったときだけパッケージマージを行う。
+//
+// HeuristicLimit は収まらなかったときもパッケージマージを行わず、zlib や JPEG と同じように
+// ハフマン符号長を切り詰めてから Kraft の和が 1 に戻るまで符号長を配り直す。
+// 最適とは限らないが、ハフマン符号と同じ O(n) (+ 配り直しの回数) で済む。
+//
+namespace
+{
+	// @struct シンボル単体情報
+	struct SingleSymbol
+	{
+		unsigned		   alphabet = 0;		//! シンボル識別子
+		unsigned		   weight   = 0;		//!	重み (出現回数)
+
+		SingleSymbol()
+		{}
+
+		SingleSymbol(unsigned	alp, unsigned wei)
+			: alphabet(alp)
+			, weight(wei)
+		{}
+	};
+
+	// using
+	using SingleSymbolList = std::vector<SingleSymbol>;
+	using WorkList         = std::vector<unsigned long long>;
+
+	// @struct 作業バッファ
+	struct HybridPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		SingleSymbolList	symbolList;
+		PackageMerge::SymbolSortBuffer	sortBuffer;
+		WorkList			work;		//! 重み → 親の位置 → 深さ の順に書き換えて使う
+		WorkList			lengthCounts;	//! HeuristicLimit のみ: 符号長ごとのシンボル数
+	};
+
+	// @brief ハフマン符号長をその場で求める
+	// @note  a は重みの昇順に並んだ 2つ以上の要素。終了後 a[i] は i 番目のシンボルの符号長になる
+	//-------------------------------------------------------------
+	void CalculateHuffmanLengths(WorkList& /*inout*/a)
+	{
+		const size_t n = a.size();
+		assert(n >= 2 && "シンボルが2つ未満でハフマン符号を作るのはあり得ない");
+
+		// 1. 内部ノードの重みを作る。作ったノードは先頭から順に並び、使われた時点で親の位置に置き換わる
+		a[0] += a[1];
+		size_t root = 0;
+		size_t leaf = 2;
+		for (size_t next = 1; next < n - 1; ++next)
+		{
+			// 1つ目の子
+			if (leaf >= n || a[root] < a[leaf])
+			{
+				a[next]   = a[root];
+				a[root++] = next;
+			}
+			else
+			{
+				a[next] = a[leaf++];
+			}
+			// 2つ目の子
+			if (leaf >= n || (root < next && a[root] < a[leaf]))
+			{
+				a[next]  += a[root];
+				a[root++] = next;
+			}
+			else
+			{
+				a[next] += a[leaf++];
+			}
+		}
+
+		// 2. 親の位置を内部ノードの深さに置き換える (根は一番最後)
+		a[n - 2] = 0;
+		for (size_t next = n - 2; next > 0; --next)
+			a[next - 1] = a[a[next - 1]] + 1;
+
+		// 3. 内部ノードの深さから葉の深さ (符号長) を求める。重みの大きなシンボルほど短い
+		size_t			   numAvailable = 1;
+		size_t			   numUsed		= 0;
+		unsigned long long depth		= 0;
+		size_t			   internal		= n - 1;	// 内部ノードの末尾 +1
+		size_t			   next			= n;		// 書き込み先の末尾 +1
+		while (numAvailable > 0)
+		{
+			while (internal > 0 && a[internal - 1] == depth)
+			{
+				++numUsed;
+				--internal;
+			}
+			while (numAvailable > numUsed)
+			{
+				a[--next] = depth;
+				--numAvailable;
+			}
+			numAvailable = 2 * numUsed;
+			numUsed		 = 0;
+			++depth;
+		}
+	}
+
+	// @brief 長すぎる符号長を切り詰め、Kraft の不等式を満たすまで配り直す
+	// @note  a は重みの昇順に並んだシンボルのハフマン符号長 (codeLengthLimit < 64)。
+	//        終了後 a[i] は codeLengthLimit 以下の符号長になり、重みの小さいシンボルほど長い
+	//-------------------------------------------------------------
+	void LimitHuffmanLengths(WorkList& /*inout*/a, size_t codeLengthLimit, WorkList& /*out*/counts)
+	{
+		const unsigned long long limit = codeLengthLimit;
+
+		// 1. 符号長ごとのシンボル数 (長すぎるものは制限符号長にそろえる)
+		counts.assign(codeLengthLimit + 1, 0);
+		for (unsigned long long length : a)
+			++counts[std::min(length, limit)];
+
+		// 2. Kraft の和 Σ 2^(L - 符号長) が 2^L を超える分だけ、
+		//    制限符号長のシンボルを 1つ減らし、それより短い中で一番長い符号語を 1段伸ばして 2つに分ける (1回で和が 1 減る)
+		//    note: 超過分は切り詰めたシンボルの数より少ないため、制限符号長のシンボルが尽きることはない
+		unsigned long long total = 0;
+		for (size_t length = 1; length <= codeLengthLimit; ++length)
+			total += counts[length] << (codeLengthLimit - length);
+
+		for (; total > (1ULL << codeLengthLimit); --total)
+		{
+			--counts[codeLengthLimit];
+			for (size_t length = codeLengthLimit - 1; length > 0; --length)
+			{
+				if (counts[length] != 0)
+				{
+					--counts[length];
+					counts[length + 1] += 2;
+					break;
+				}
+			}
+		}
+
+		// 3. 重みの小さいシンボルから長い符号長を割り当てる
+		size_t i = 0;
+		for (size_t length = codeLengthLimit; length > 0; --length)
+		{
+			for (unsigned long long count = counts[length]; count > 0; --count)
+				a[i++] = length;
+		}
+	}
+
+	// @brief 代替のアルゴリズムの結果を Status にそろえる
+	// @note  代替のアルゴリズムは符号化が可能な入力でのみ呼ぶため、bool 版の失敗は数えられる範囲を超えた場合
+	//-------------------------------------------------------------
+	inline PackageMerge::Status ToStatus(bool isSucceeded)
+	{
+		return isSucceeded ? PackageMerge::STATUS_SUCCESS : PackageMerge::STATUS_CAPACITY_EXCEEDED;
+	}
+
+	inline PackageMerge::Status ToStatus(PackageMerge::Status status)
+	{
+		return status;
+	}
+
+	// @brief ハフマン符号を先に試すパッケージマージアルゴリズム本体
+	// @note  FALLBACK は EngineFunc または StatusEngineFunc
+	//-------------------------------------------------------------
+	template<class FALLBACK>
+	PackageMerge::Status HybridPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths,
+									  FALLBACK fallback, PackageMerge::CodePath* pPath)
+	{
+		using namespace PackageMerge;
+		HybridPMBuffer& buffer = rWorkspace.GetBuffer<HybridPMBuffer>(Workspace::SLOT_HYBRID);
+		StatsScope	stats(rWorkspace, Workspace::SLOT_HYBRID);
+
+		const SingleSymbolList& symbolList = buffer.symbolList;
+		ExtractSortedSymbolList(symbolWeights, arraySize, buffer.sortBuffer, /*out*/buffer.symbolList);
+		stats.EndSort();
+
+		CodePath dummyPath;
+		CodePath& rPath = pPath ? *pPath : dummyPath;
+
+		if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
+		{
+			rPath = PATH_IMPOSSIBLE;
+			return STATUS_IMPOSSIBLE_CODING;
+		}
+
+		std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+		if (symbolList.size() <= 1)
+		{
+			// note: 他のアルゴリズムに合わせて、唯一のシンボルには 1bit を割り当てる
+			if (!symbolList.empty())
+				pBitLengths[symbolList[0].alphabet] = 1;
+
+			rPath = PATH_TRIVIAL;
+			return STATUS_SUCCESS;
+		}
+
+		WorkList& work = buffer.work;
+		work.resize(symbolList.size());
+		for (size_t i = 0; i < symbolList.size(); ++i)
+			work[i] = symbolList[i].weight;
+
+		CalculateHuffmanLengths(/*inout*/work);
+
+		// 一番重みの小さなシンボルの符号長が最大
+		if (work[0] <= codeLengthLimit)
+		{
+			for (size_t i = 0; i < symbolList.size(); ++i)
+				pBitLengths[symbolList[i].alphabet] = static_cast<unsigned>(work[i]);
+
+			rPath = PATH_HUFFMAN;
+			return STATUS_SUCCESS;
+		}
+
+		// 制限符号長に収まらない
+		rPath = PATH_PACKAGE_MERGE;
+		return ToStatus(fallback(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+	}
+
+	// @brief ハフマン符号の長すぎる符号長を切り詰めて配り直す経験的な方法の本体
+	//-------------------------------------------------------------
+	template<class FALLBACK>
+	PackageMerge::Status HeuristicLimitImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths,
+											FALLBACK fallback)
+	{
+		using namespace PackageMerge;
+		HybridPMBuffer& buffer = rWorkspace.GetBuffer<HybridPMBuffer>(Workspace::SLOT_HEURISTIC);
+		StatsScope	stats(rWorkspace, Workspace::SLOT_HEURISTIC);
+
+		const SingleSymbolList& symbolList = buffer.symbolList;
+		ExtractSortedSymbolList(symbolWeights, arraySize, buffer.sortBuffer, /*out*/buffer.symbolList);
+		stats.EndSort();
+
+		if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+		if (symbolList.size() <= 1)
+		{
+			if (!symbolList.empty())
+				pBitLengths[symbolList[0].alphabet] = 1;
+
+			return STATUS_SUCCESS;
+		}
+
+		WorkList& work = buffer.work;
+		work.resize(symbolList.size());
+		for (size_t i = 0; i < symbolList.size(); ++i)
+			work[i] = symbolList[i].weight;
+
+		CalculateHuffmanLengths(/*inout*/work);
+
+		// 一番重みの小さなシンボルの符号長が最大
+		if (work[0] > codeLengthLimit)
+		{
+			// note: Kraft の和を 64bit で数えられないほど長い制限では、切り詰めずに最適解を求める
+			if (codeLengthLimit >= 64)
+				return ToStatus(fallback(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths));
+
+			LimitHuffmanLengths(/*inout*/work, codeLengthLimit, /*out*/buffer.lengthCounts);
+		}
+
+		for (size_t i = 0; i < symbolList.size(); ++i)
+			pBitLengths[symbolList[i].alphabet] = static_cast<unsigned>(work[i]);
+
+		return STATUS_SUCCESS;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief ハフマン符号を先に試すパッケージマージアルゴリズム
+//-------------------------------------------------------------
+std::vector<unsigned> PackageMerge::HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!HybridPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief ハフマン符号を先に試すパッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------
+bool PackageMerge::HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return HybridPM(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, BoundaryPM, nullptr);
+}
+
+// @brief ハフマン符号を先に試すパッケージマージアルゴリズム (代替のアルゴリズムを指定する版)
+//-------------------------------------------------------------
+bool PackageMerge::HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths,
+							EngineFunc fallback, CodePath* pPath)
+{
+	return HybridPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, fallback, pPath) == STATUS_SUCCESS;
+}
+
+// @brief ハフマン符号を先に試すパッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryHybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return HybridPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, static_cast<StatusEngineFunc>(TryBoundaryPM), nullptr);
+}
+
+// @brief ハフマン符号の長すぎる符号長を切り詰めて配り直す経験的な方法
+//-------------------------------------------------------------
+std::vector<unsigned> PackageMerge::HeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!HeuristicLimit(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>();
+
+	return bitLengthsList;
+}
+
+// @brief ハフマン符号の長すぎる符号長を切り詰めて配り直す経験的な方法 (作業領域を使い回す版)
+//-------------------------------------------------------------
+bool PackageMerge::HeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return HeuristicLimitImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, static_cast<EngineFunc>(BoundaryPM)) == STATUS_SUCCESS;
+}
+
+// @brief ハフマン符号の長すぎる符号長を切り詰めて配り直す経験的な方法 (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryHeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return HeuristicLimitImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, static_cast<StatusEngineFunc>(TryBoundaryPM));
+}
@@ -0,0 +1,669 @@
+//-------------------------------------------------------------
+//! @brief	重みの差分から符号長を求め直すパッケージマージ
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "IncrementalPackageMerge.h"
+#include "SymbolExtraction.h"
+#include <algorithm>	// std::sort, std::fill, std::lower_bound, std::min
+#include <stdexcept>	// std::runtime_error
+#include <limits>		// std::numeric_limits
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::PackageMerge;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// 計数パッケージマージ (CountingPM) と同じく、ステージごとに
+// 「重み」と「先頭から m 組の中にあるパッケージの数」を持つ。
+//
+// ステージ i のマージは、シンボル単体の列と上のステージから作るパッケージの列を先頭から順に取り出す。
+// 取り出した数が シンボル単体 s 個、パッケージ k 個の時点までに
+// 比較に使ったシンボル・パッケージがどちらも変化していなければ、そこまでの出力は以前と同じになる。
+// そこで、重みが変化した最初の位置 (シンボル単体は p、上のステージは d) から
+// 「s < p かつ k < d/2」を満たす一番後ろの組の境目を二分探索し、そこからマージを再開する。
+// 再開後に書き込む値を以前の値と比べれば、このステージで重みが変化した最初の位置がわかり、次のステージに引き継げる。
+//
+// シンボルの数が変わらない場合、各ステージの要素数も変わらない。
+// このときは変化した位置を区間の列として持ち、変化した入力を比較に使う直前の組の境目からマージし直して、
+// 組の境目で取り出したパッケージの数が以前と一致した時点 (= 以前と同じ状態に戻った時点) で次の変化まで読み飛ばす。
+// 変化が少なければ、各ステージでマージし直すのは変化した入力の周辺だけで済む。
+//
+namespace
+{
+	// 変更されたシンボルの割合がこれを超えたら (1/N)、並べ替えからすべてを計算し直す
+	const size_t FULL_RECOMPUTE_RATIO = 8;
+
+	// 並びの中にないシンボル
+	const unsigned NO_POSITION = std::numeric_limits<unsigned>::max();
+
+	// using
+	using KeyList          = std::vector<unsigned long long>;
+	using WeightList       = std::vector<unsigned long long>;
+	using PackageCountList = std::vector<unsigned>;
+
+	// @struct 重みが変化した区間 [begin, end)
+	struct Range
+	{
+		size_t begin;
+		size_t end;
+	};
+	using RangeList = std::vector<Range>;
+
+	// 変化した区間がない
+	const size_t NO_RANGE = std::numeric_limits<size_t>::max();
+
+	// @brief キーの重み
+	//-------------------------------------------------------------
+	inline unsigned long long GetKeyWeight(unsigned long long key)
+	{
+		return key >> 32;
+	}
+
+	// @brief キーのシンボル識別子
+	//-------------------------------------------------------------
+	inline unsigned GetKeyAlphabet(unsigned long long key)
+	{
+		return static_cast<unsigned>(key);
+	}
+
+	// @brief キーを作る
+	//-------------------------------------------------------------
+	inline unsigned long long MakeKey(unsigned weight, size_t alphabet)
+	{
+		return (static_cast<unsigned long long>(weight) << 32) | static_cast<unsigned>(alphabet);
+	}
+
+	// @brief ステージの t 番目に書き込み、以前の内容と初めて異なった位置を記録する
+	//-------------------------------------------------------------
+	inline void WriteStageItem(WeightList& /*inout*/stage, size_t t, unsigned long long weight, size_t& /*inout*/firstDiff)
+	{
+		if (t < stage.size())
+		{
+			if (t < firstDiff && stage[t] != weight)
+				firstDiff = t;
+
+			stage[t] = weight;
+			return;
+		}
+		if (t < firstDiff)
+			firstDiff = t;
+
+		stage.push_back(weight);
+	}
+
+	// @brief 区間の列の末尾に追加する (重なる・隣接する区間はまとめる)
+	//-------------------------------------------------------------
+	inline void AddRange(RangeList& /*inout*/list, size_t begin, size_t end)
+	{
+		if (!list.empty() && list.back().end >= begin)
+		{
+			list.back().end = std::max(list.back().end, end);
+			return;
+		}
+		list.push_back(Range{ begin, end });
+	}
+
+	// @brief 区間の列のうち、位置 pos 以降で最初に変化している位置
+	// @note  cursor は呼び出しごとに単調に進む
+	//-------------------------------------------------------------
+	inline size_t FindNextRange(const RangeList& list, size_t& /*inout*/cursor, size_t pos)
+	{
+		while (cursor < list.size() && list[cursor].end <= pos)
+			++cursor;
+
+		return (cursor < list.size()) ? std::max(list[cursor].begin, pos) : NO_RANGE;
+	}
+}
+
+//-------------------------------------------------------------
+// Impl
+//-------------------------------------------------------------
+struct IncrementalPackageMerge::Impl
+{
+	size_t							arraySize		= 0;
+	size_t							codeLengthLimit	= 0;
+	std::vector<unsigned>			weights;			//! 現在の重み (未反映の変更を含む)
+	std::vector<unsigned char>		changedFlags;		//! 未反映の変更があるか
+	std::vector<unsigned>			changedList;		//! 未反映の変更があるシンボル
+
+	SymbolSortBuffer				sortBuffer;			//! keys が (重み, シンボル識別子) の昇順に並んだシンボル
+	std::vector<unsigned>			positions;			//! シンボル識別子 → 並びの中の位置
+	KeyList							changedKeys;		//! 作業用: 変更後のキー
+	KeyList							oldSuffix;			//! 作業用: 並べ直す前の後ろ側
+	RangeList						symbolRanges;		//! 作業用: シンボル単体の重みが変化した区間
+	RangeList						stageRanges[2];		//! 作業用: 上のステージ / このステージの重みが変化した区間
+
+	bool							stagesValid		= false;
+	size_t							numStage		= 0;
+	size_t							numStageSymbol	= 0;	//! ステージを作ったときのシンボルの数
+	std::vector<WeightList>			stages;				//! [ステージ] = 重み (昇順)
+	std::vector<PackageCountList>	packageCounts;		//! [ステージ][m] = 先頭から m+1 組の中にあるパッケージの数
+	std::vector<size_t>				symbolCounts;		//! ステージごとに採用されるシンボル単体の数
+	std::vector<unsigned>			numStageBySymbol;	//! 長さテーブル構築用
+
+	std::vector<unsigned>			bitLengths;
+	bool							succeeded		= false;	//! 直近の結果
+	IncrementalStats				stats;
+
+	// @brief 並べ替えからすべてを計算し直す
+	//-------------------------------------------------------------
+	bool FullRecompute()
+	{
+		ClearChanges();
+		SortSymbolKeys(weights.data(), arraySize, sortBuffer);
+		stagesValid = false;
+
+		std::fill(positions.begin(), positions.end(), NO_POSITION);
+		const KeyList& sortedKeys = sortBuffer.keys;
+		for (size_t i = 0; i < sortedKeys.size(); ++i)
+			positions[GetKeyAlphabet(sortedKeys[i])] = static_cast<unsigned>(i);
+
+		++stats.numFullRecompute;
+		return succeeded = Solve(0);
+	}
+
+	// @brief 未反映の変更を並びに反映する
+	// @return 並びの中で重みが変化した最初の位置
+	//-------------------------------------------------------------
+	size_t ApplyChanges()
+	{
+		KeyList& sortedKeys = sortBuffer.keys;
+		size_t	 oldSize	= sortedKeys.size();
+
+		// 変更されたシンボルのうち、一番手前にあったものの位置
+		size_t begin = oldSize;
+		changedKeys.clear();
+		for (unsigned alphabet : changedList)
+		{
+			if (positions[alphabet] != NO_POSITION)
+				begin = std::min<size_t>(begin, positions[alphabet]);
+
+			if (weights[alphabet])
+				changedKeys.push_back(MakeKey(weights[alphabet], alphabet));
+		}
+		std::sort(changedKeys.begin(), changedKeys.end());
+
+		// 変更後のキーが入る一番手前の位置
+		if (!changedKeys.empty())
+		{
+			size_t insertPos = std::lower_bound(sortedKeys.begin(), sortedKeys.end(), changedKeys.front()) - sortedKeys.begin();
+			begin = std::min(begin, insertPos);
+		}
+
+		// begin より後ろだけを並べ直す (変更されていないものと変更後のものをマージ)
+		oldSuffix.assign(sortedKeys.begin() + begin, sortedKeys.end());
+		sortedKeys.resize(begin);
+
+		size_t changed_i = 0;
+		for (unsigned long long key : oldSuffix)
+		{
+			if (changedFlags[GetKeyAlphabet(key)])
+				continue;
+
+			while (changed_i < changedKeys.size() && changedKeys[changed_i] < key)
+				sortedKeys.push_back(changedKeys[changed_i++]);
+
+			sortedKeys.push_back(key);
+		}
+		sortedKeys.insert(sortedKeys.end(), changedKeys.begin() + changed_i, changedKeys.end());
+
+		for (unsigned alphabet : changedList)
+			positions[alphabet] = NO_POSITION;
+		for (size_t i = begin; i < sortedKeys.size(); ++i)
+			positions[GetKeyAlphabet(sortedKeys[i])] = static_cast<unsigned>(i);
+
+		ClearChanges();
+
+		// 並びの中で重みが変化した区間 (シンボル識別子だけが入れ替わった位置はステージに影響しない)
+		symbolRanges.clear();
+		size_t numCommon = std::min(oldSuffix.size(), sortedKeys.size() - begin);
+		for (size_t i = 0; i < numCommon; ++i)
+		{
+			if (GetKeyWeight(oldSuffix[i]) != GetKeyWeight(sortedKeys[begin + i]))
+				AddRange(symbolRanges, begin + i, begin + i + 1);
+		}
+		if (oldSuffix.size() != sortedKeys.size() - begin)
+			AddRange(symbolRanges, begin + numCommon, sortedKeys.size());
+
+		return symbolRanges.empty() ? sortedKeys.size() : symbolRanges.front().begin;
+	}
+
+	// @brief 未反映の変更を破棄
+	//-------------------------------------------------------------
+	void ClearChanges()
+	{
+		for (unsigned alphabet : changedList)
+			changedFlags[alphabet] = 0;
+
+		changedList.clear();
+	}
+
+	// @brief シンボル単体の重みが位置 symbolDiff から変化したものとして、ステージと符号長を求め直す
+	//-------------------------------------------------------------
+	bool Solve(size_t symbolDiff)
+	{
+		const KeyList& sortedKeys = sortBuffer.keys;
+		const size_t   numSymbol  = sortedKeys.size();
+
+		stats.lastMergedNodes = 0;
+		stats.lastTotalNodes  = 0;
+
+		if (IsImpossibleCoding(numSymbol, codeLengthLimit))
+		{
+			stagesValid = false;
+			bitLengths.clear();
+			return false;
+		}
+
+		bitLengths.assign(arraySize, 0);
+		if (numSymbol <= 1)
+		{
+			// note: 他のアルゴリズムに合わせて、唯一のシンボルには 1bit を割り当てる
+			if (numSymbol == 1)
+				bitLengths[GetKeyAlphabet(sortedKeys[0])] = 1;
+
+			stagesValid = false;
+			return true;
+		}
+
+		// 無駄を軽減
+		size_t stageCount = std::min(codeLengthLimit, numSymbol);
+		if (!stagesValid || stageCount != numStage)
+		{
+			// ステージ数が変わった場合は以前の内容を使えない
+			if (stages.size() < stageCount)
+			{
+				stages.resize(stageCount);
+				packageCounts.resize(stageCount);
+			}
+			for (size_t i = 0; i < stageCount; ++i)
+			{
+				stages[i].clear();
+				packageCounts[i].clear();
+			}
+			numStage	= stageCount;
+			symbolDiff	= 0;
+			stagesValid	= true;
+		}
+		else if (numSymbol == numStageSymbol)
+		{
+			// シンボルの数が変わらなければ、変化した区間の周辺だけをマージし直す
+			BuildTopStageRanges();
+			for (size_t stage_i = 1; stage_i < numStage; ++stage_i)
+				MergeStageRanges(stage_i);
+
+			return FinishSolve();
+		}
+		numStageSymbol = numSymbol;
+
+		// 一番上のステージはシンボル単体のみ
+		size_t firstDiff = BuildTopStage(symbolDiff);
+
+		// 上から下に向かって順番にマージし直す
+		for (size_t stage_i = 1; stage_i < numStage; ++stage_i)
+			firstDiff = MergeStage(stage_i, symbolDiff, firstDiff);
+
+		return FinishSolve();
+	}
+
+	// @brief ステージの内容から符号長を求める
+	//-------------------------------------------------------------
+	bool FinishSolve()
+	{
+		const size_t numSymbol = sortBuffer.keys.size();
+
+		// 最下段から上に向かって、各ステージの採用区間の長さとシンボル単体の数を求める
+		symbolCounts.assign(numStage, 0);
+		size_t numActive = stages[numStage - 1].size();
+		for (size_t stage_i = numStage - 1; stage_i > 0; --stage_i)
+		{
+			size_t numPackage = (numActive == 0) ? 0 : packageCounts[stage_i][numActive / 2 - 1];
+
+			symbolCounts[stage_i] = numActive - numPackage;
+			numActive			  = numPackage * 2;
+		}
+		symbolCounts[0] = numActive;
+
+		if (symbolCounts[0] > numSymbol)
+			throw std::runtime_error("一番上のステージでシンボルの数を超えるのはあり得ない");
+
+		BuildBitLengths();
+		return true;
+	}
+
+	// @brief 一番上のステージを作り直す
+	// @return 重みが変化した最初の位置
+	//-------------------------------------------------------------
+	size_t BuildTopStage(size_t symbolDiff)
+	{
+		const KeyList& sortedKeys = sortBuffer.keys;
+		WeightList&	   stage	  = stages[0];
+
+		size_t newSize	 = sortedKeys.size() & ~static_cast<size_t>(1);
+		size_t firstDiff = newSize;
+		size_t begin	 = std::min(symbolDiff, stage.size());
+		for (size_t t = begin; t < newSize; ++t)
+			WriteStageItem(stage, t, GetKeyWeight(sortedKeys[t]), /*inout*/firstDiff);
+
+		stage.resize(newSize);
+		stats.lastMergedNodes += (newSize > begin) ? newSize - begin : 0;
+		stats.lastTotalNodes  += newSize;
+		return firstDiff;
+	}
+
+	// @brief 以前と同じ結果になる区間のあとから、ステージをマージし直す
+	// @param symbolDiff シンボル単体の重みが変化した最初の位置
+	// @param prevDiff   上のステージの重みが変化した最初の位置
+	// @return このステージの重みが変化した最初の位置
+	//-------------------------------------------------------------
+	size_t MergeStage(size_t stageIdx, size_t symbolDiff, size_t prevDiff)
+	{
+		const KeyList&	  symbols	   = sortBuffer.keys;
+		const WeightList& prevStage	   = stages[stageIdx - 1];
+		WeightList&		  stage		   = stages[stageIdx];
+		PackageCountList& counts	   = packageCounts[stageIdx];
+		const size_t	  numPackage   = prevStage.size() / 2;
+		const size_t	  packageDiff  = prevDiff / 2;	// これより手前のパッケージは変化していない
+
+		// 「s < symbolDiff かつ k < packageDiff」を満たす一番後ろの組の境目を探す
+		size_t lo = 0;
+		size_t hi = counts.size();
+		while (lo < hi)
+		{
+			size_t m		   = (lo + hi + 1) / 2;
+			size_t numTakenPkg = counts[m - 1];
+			size_t numTakenSym = 2 * m - numTakenPkg;
+			if (numTakenSym < symbolDiff && numTakenPkg < packageDiff)
+				lo = m;
+			else
+				hi = m - 1;
+		}
+		size_t package_i = (lo == 0) ? 0 : counts[lo - 1];
+		size_t symbol_i  = 2 * lo - package_i;
+		size_t t		 = 2 * lo;
+		counts.resize(lo);
+
+		size_t firstDiff = std::numeric_limits<size_t>::max();
+		while (symbol_i < symbols.size() || package_i < numPackage)
+		{
+			unsigned long long weight = 0;
+			if (package_i < numPackage &&
+				(symbol_i >= symbols.size() || prevStage[package_i * 2] + prevStage[package_i * 2 + 1] <= GetKeyWeight(symbols[symbol_i])))
+			{
+				weight = prevStage[package_i * 2] + prevStage[package_i * 2 + 1];
+				++package_i;
+			}
+			else
+			{
+				weight = GetKeyWeight(symbols[symbol_i++]);
+			}
+			WriteStageItem(stage, t++, weight, /*inout*/firstDiff);
+
+			// 1組そろうごとに、ここまでのパッケージ数を記録
+			if ((t & 0x1) == 0)
+				counts.push_back(static_cast<unsigned>(package_i));
+		}
+		stats.lastMergedNodes += t - 2 * lo;
+
+		// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
+		size_t newSize = t & ~static_cast<size_t>(1);
+		stage.resize(newSize);
+		stats.lastTotalNodes += newSize;
+
+		return std::min(firstDiff, newSize);
+	}
+
+	// @brief 一番上のステージのうち、重みが変化した区間だけを書き直す (シンボルの数が変わらない場合)
+	//-------------------------------------------------------------
+	void BuildTopStageRanges()
+	{
+		const KeyList& sortedKeys = sortBuffer.keys;
+		WeightList&	   stage	  = stages[0];
+		RangeList&	   outRanges  = stageRanges[0];
+
+		outRanges.clear();
+		for (const Range& range : symbolRanges)
+		{
+			size_t end = std::min(range.end, stage.size());
+			for (size_t t = range.begin; t < end; ++t)
+				stage[t] = GetKeyWeight(sortedKeys[t]);
+
+			if (range.begin < end)
+			{
+				AddRange(outRanges, range.begin, end);
+				stats.lastMergedNodes += end - range.begin;
+			}
+		}
+		stats.lastTotalNodes += stage.size();
+	}
+
+	// @brief 変化した入力の周辺だけステージをマージし直す (シンボルの数が変わらない場合)
+	// @note  上のステージの変化した区間は stageRanges[(stageIdx - 1) & 1]、このステージの分は stageRanges[stageIdx & 1] に書く
+	//-------------------------------------------------------------
+	void MergeStageRanges(size_t stageIdx)
+	{
+		const KeyList&	  symbols	  = sortBuffer.keys;
+		const WeightList& prevStage	  = stages[stageIdx - 1];
+		WeightList&		  stage		  = stages[stageIdx];
+		PackageCountList& counts	  = packageCounts[stageIdx];
+		const RangeList&  prevRanges  = stageRanges[(stageIdx - 1) & 1];
+		RangeList&		  outRanges	  = stageRanges[stageIdx & 1];
+		const size_t	  numSymbol	  = symbols.size();
+		const size_t	  numPackage  = prevStage.size() / 2;
+		const size_t	  numPair	  = counts.size();
+
+		outRanges.clear();
+		size_t symbolCursor	 = 0;
+		size_t packageCursor = 0;
+		size_t t			 = 0;
+		size_t symbol_i		 = 0;
+		size_t package_i	 = 0;
+		while (symbol_i < numSymbol || package_i < numPackage)
+		{
+			// 次に比較に使う、重みが変化したシンボル単体とパッケージ
+			size_t nextSymbol  = FindNextRange(symbolRanges, /*inout*/symbolCursor, symbol_i);
+			size_t nextPackage = FindNextRange(prevRanges, /*inout*/packageCursor, package_i * 2);
+			if (nextPackage != NO_RANGE)
+				nextPackage /= 2;
+			if (nextSymbol == NO_RANGE && nextPackage == NO_RANGE)
+				break;
+
+			// 「s < nextSymbol かつ k < nextPackage」を満たす一番後ろの組の境目まで読み飛ばす
+			size_t lo = t / 2;
+			size_t hi = numPair;
+			while (lo < hi)
+			{
+				size_t m		   = (lo + hi + 1) / 2;
+				size_t numTakenPkg = counts[m - 1];
+				size_t numTakenSym = 2 * m - numTakenPkg;
+				if (numTakenSym < nextSymbol && numTakenPkg < nextPackage)
+					lo = m;
+				else
+					hi = m - 1;
+			}
+			if (lo > t / 2)
+			{
+				t		  = 2 * lo;
+				package_i = counts[lo - 1];
+				symbol_i  = t - package_i;
+			}
+
+			// 組の境目で以前と同じ状態に戻るまで、1つずつマージし直す
+			size_t start = t;
+			while (symbol_i < numSymbol || package_i < numPackage)
+			{
+				unsigned long long weight = 0;
+				if (package_i < numPackage &&
+					(symbol_i >= numSymbol || prevStage[package_i * 2] + prevStage[package_i * 2 + 1] <= GetKeyWeight(symbols[symbol_i])))
+				{
+					weight = prevStage[package_i * 2] + prevStage[package_i * 2 + 1];
+					++package_i;
+				}
+				else
+				{
+					weight = GetKeyWeight(symbols[symbol_i++]);
+				}
+
+				// note: 2組のペアから漏れる一番大きなノードは書き込まない
+				if (t < stage.size() && stage[t] != weight)
+				{
+					stage[t] = weight;
+					AddRange(outRanges, t, t + 1);
+				}
+				++t;
+
+				if ((t & 0x1) == 0 && t / 2 <= numPair)
+				{
+					bool synchronized  = (counts[t / 2 - 1] == package_i);
+					counts[t / 2 - 1]  = static_cast<unsigned>(package_i);
+					if (synchronized)
+						break;
+				}
+			}
+			stats.lastMergedNodes += t - start;
+		}
+		stats.lastTotalNodes += stage.size();
+	}
+
+	// @brief 長さテーブル構築
+	// @note  重みの昇順で j 番目のシンボルの符号長は、採用シンボル数が j を超えるステージの数
+	//-------------------------------------------------------------
+	void BuildBitLengths()
+	{
+		const KeyList& sortedKeys = sortBuffer.keys;
+
+		numStageBySymbol.assign(sortedKeys.size() + 1, 0);
+		for (size_t count : symbolCounts)
+			numStageBySymbol[count] += 1;
+
+		unsigned bitLength = static_cast<unsigned>(symbolCounts.size());
+		for (size_t i = 0; i < sortedKeys.size(); ++i)
+		{
+			bitLength -= numStageBySymbol[i];
+			bitLengths[GetKeyAlphabet(sortedKeys[i])] = bitLength;
+		}
+	}
+};
+
+//-------------------------------------------------------------
+// IncrementalPackageMerge
+//-------------------------------------------------------------
+IncrementalPackageMerge::IncrementalPackageMerge()
+	: m_pImpl(new Impl())
+{}
+
+IncrementalPackageMerge::~IncrementalPackageMerge()
+{}
+
+// @brief 重み表と制限符号長を設定し、すべてを計算し直す
+//-------------------------------------------------------------
+bool IncrementalPackageMerge::Reset(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Impl& impl = *m_pImpl;
+
+	impl.arraySize		 = arraySize;
+	impl.codeLengthLimit = codeLengthLimit;
+	impl.weights.assign(symbolWeights, symbolWeights + arraySize);
+	impl.changedFlags.assign(arraySize, 0);
+	impl.changedList.clear();
+	impl.positions.assign(arraySize, NO_POSITION);
+
+	++impl.stats.numUpdate;
+	return impl.FullRecompute();
+}
+
+// @brief シンボルの重みを変更する
+//-------------------------------------------------------------
+void IncrementalPackageMerge::SetWeight(size_t alphabet, unsigned weight)
+{
+	Impl& impl = *m_pImpl;
+	if (alphabet >= impl.arraySize)
+		throw std::runtime_error("範囲外のシンボル");
+
+	if (impl.weights[alphabet] == weight)
+		return;
+
+	impl.weights[alphabet] = weight;
+	if (!impl.changedFlags[alphabet])
+	{
+		impl.changedFlags[alphabet] = 1;
+		impl.changedList.push_back(static_cast<unsigned>(alphabet));
+	}
+}
+
+// @brief シンボルの重みに差分を加える
+//-------------------------------------------------------------
+void IncrementalPackageMerge::AddWeight(size_t alphabet, long long delta)
+{
+	long long weight = static_cast<long long>(GetWeight(alphabet)) + delta;
+	if (weight < 0 || weight > static_cast<long long>(std::numeric_limits<unsigned>::max()))
+		throw std::runtime_error("重みが範囲外になった");
+
+	SetWeight(alphabet, static_cast<unsigned>(weight));
+}
+
+// @brief 新しい重み表との差分をとって変更する
+//-------------------------------------------------------------
+void IncrementalPackageMerge::SetWeights(const unsigned* symbolWeights)
+{
+	Impl& impl = *m_pImpl;
+	for (size_t i = 0; i < impl.arraySize; ++i)
+	{
+		if (impl.weights[i] != symbolWeights[i])
+			SetWeight(i, symbolWeights[i]);
+	}
+}
+
+// @brief 変更を反映して符号長を求め直す
+//-------------------------------------------------------------
+bool IncrementalPackageMerge::Update()
+{
+	Impl& impl = *m_pImpl;
+	if (impl.changedList.empty())
+	{
+		impl.stats.lastMergedNodes = 0;
+		return impl.succeeded;
+	}
+	++impl.stats.numUpdate;
+
+	// 変更が多い場合は並べ直したほうが速い
+	if (impl.changedList.size() * FULL_RECOMPUTE_RATIO > impl.sortBuffer.keys.size())
+		return impl.FullRecompute();
+
+	size_t symbolDiff = impl.ApplyChanges();
+	return impl.succeeded = impl.Solve(symbolDiff);
+}
+
+// @brief 現在の重み
+//-------------------------------------------------------------
+unsigned IncrementalPackageMerge::GetWeight(size_t alphabet) const
+{
+	if (alphabet >= m_pImpl->arraySize)
+		throw std::runtime_error("範囲外のシンボル");
+
+	return m_pImpl->weights[alphabet];
+}
+
+// @brief 直近の Update() / Reset() で求めた符号長
+//-------------------------------------------------------------
+const std::vector<unsigned>& IncrementalPackageMerge::GetBitLengths() const
+{
+	return m_pImpl->bitLengths;
+}
+
+// @brief 統計
+//-------------------------------------------------------------
+const IncrementalStats& IncrementalPackageMerge::GetStats() const
+{
+	return m_pImpl->stats;
+}
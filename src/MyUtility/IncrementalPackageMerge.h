@@ -0,0 +1,73 @@
+//-------------------------------------------------------------
+//! @brief	重みの差分から符号長を求め直すパッケージマージ
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @struct 差分更新の統計
+	struct IncrementalStats
+	{
+		size_t				numUpdate		 = 0;	//! Update() で符号長を求め直した回数
+		size_t				numFullRecompute = 0;	//! そのうち、すべてを計算し直した回数
+		unsigned long long	lastMergedNodes	 = 0;	//! 直近の Update() でマージし直したノードの数
+		unsigned long long	lastTotalNodes	 = 0;	//! 直近の Update() 時点の全ステージのノードの数
+	};
+
+	// @class 差分更新つきのパッケージマージ
+	// @note  重み順に並べたシンボルと、各ステージの重み・パッケージ数を保持しておき、
+	//        重みが変わったシンボルの周辺だけをマージし直す。
+	//        シンボルが増減した場合は、変化した位置より後ろをすべてマージし直す。
+	//        変化が大きい場合は並べ替えからすべてを計算し直す
+	class IncrementalPackageMerge
+	{
+	public:
+
+		IncrementalPackageMerge();
+		~IncrementalPackageMerge();
+
+		IncrementalPackageMerge(const IncrementalPackageMerge&)				= delete;
+		IncrementalPackageMerge& operator=(const IncrementalPackageMerge&)	= delete;
+
+		//! 重み表と制限符号長を設定し、すべてを計算し直す
+		//! @return 符号化が不可能なら false
+		bool Reset(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+		//! シンボルの重みを変更する (Update() まで反映しない)
+		void SetWeight(size_t alphabet, unsigned weight);
+
+		//! シンボルの重みに差分を加える (Update() まで反映しない)
+		void AddWeight(size_t alphabet, long long delta);
+
+		//! 新しい重み表との差分をとって変更する (Update() まで反映しない)
+		void SetWeights(const unsigned* symbolWeights);
+
+		//! 変更を反映して符号長を求め直す
+		//! @return 符号化が不可能なら false
+		bool Update();
+
+		//! 現在の重み
+		unsigned GetWeight(size_t alphabet) const;
+
+		//! 直近の Update() / Reset() で求めた符号長 (重み表の要素数)
+		const std::vector<unsigned>& GetBitLengths() const;
+
+		//! 統計
+		const IncrementalStats& GetStats() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pImpl;
+	};
+}
+}// end namespace
@@ -0,0 +1,414 @@
+//-------------------------------------------------------------
+//! @brief	4 本のビット列に分けたハフマン符号化・復号 (バイト列用)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "InterleavedHuffman.h"
+#include <algorithm>	// std::min, std::max
+#include <cstring>		// std::memcpy, std::memmove
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::Huffman;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// ビットバッファは 64bit で、8byte 単位の読み書きは little endian を前提にする。
+// 符号化: 書き出し後のバッファは 7bit 以下なので、符号長 L の符号語を 56 / L 個続けて詰めてから 8byte 書き出せる。
+// 復号:   補充後のバッファは 56bit 以上なので、56 / L 個のシンボルを続けて復号できる。
+// どちらも分岐なしで書き出し・補充し、1回あたりのシンボル数はテンプレート引数で固定して展開させる。
+//
+namespace
+{
+	// 1回の書き出し・補充あたりのシンボル数の上限 (これ以上展開しても効果が薄い)
+	const unsigned MAX_SYMBOLS_PER_REFILL = 7;
+
+	// ヘッダー (ビット列 0～2 のバイト数)
+	const size_t HEADER_BYTES = 4 * (NUM_INTERLEAVED_STREAM - 1);
+
+	// @brief 区間の位置
+	//-------------------------------------------------------------
+	inline size_t GetSegmentBegin(size_t size, size_t stream)
+	{
+		size_t segmentSize = (size + NUM_INTERLEAVED_STREAM - 1) / NUM_INTERLEAVED_STREAM;
+		return std::min(segmentSize * stream, size);
+	}
+
+	// @brief 4byte の little endian 書き込み
+	//-------------------------------------------------------------
+	inline void WriteU32(unsigned char* dst, size_t value)
+	{
+		for (int i = 0; i < 4; ++i)
+			dst[i] = static_cast<unsigned char>(value >> (8 * i));
+	}
+
+	// @brief 4byte の little endian 読み込み
+	//-------------------------------------------------------------
+	inline size_t ReadU32(const unsigned char* src)
+	{
+		return static_cast<size_t>(src[0]) | (static_cast<size_t>(src[1]) << 8) | (static_cast<size_t>(src[2]) << 16) | (static_cast<size_t>(src[3]) << 24);
+	}
+
+	// @struct 下位ビットから詰めるビット列の書き込み
+	struct StreamWriter
+	{
+		unsigned char*		ptr		 = nullptr;
+		unsigned long long	buffer	 = 0;
+		unsigned			bitCount = 0;
+
+		// @brief 符号語を詰める
+		//-------------------------------------------------------------
+		void Put(unsigned code, unsigned bitLength)
+		{
+			buffer	 |= static_cast<unsigned long long>(code) << bitCount;
+			bitCount += bitLength;
+		}
+
+		// @brief そろったバイトを書き出す (8byte 書き込むが、進めるのはそろったバイト数だけ)
+		//-------------------------------------------------------------
+		void Flush()
+		{
+			std::memcpy(ptr, &buffer, sizeof(buffer));
+			ptr		 += bitCount >> 3;
+			buffer  >>= bitCount & ~7u;
+			bitCount &= 7;
+		}
+
+		// @brief 残りのビットを書き出す
+		//-------------------------------------------------------------
+		void Finish()
+		{
+			std::memcpy(ptr, &buffer, sizeof(buffer));
+			ptr		+= (bitCount + 7) >> 3;
+			buffer	 = 0;
+			bitCount = 0;
+		}
+	};
+}
+
+//-------------------------------------------------------------
+// InterleavedDecoder::StreamReader
+//-------------------------------------------------------------
+struct InterleavedDecoder::StreamReader
+{
+	const unsigned char*	src		 = nullptr;
+	size_t					begin	 = 0;	//! ビット列の位置 [begin, end)
+	size_t					end		 = 0;
+	size_t					pos		 = 0;
+	unsigned long long		buffer	 = 0;
+	unsigned				bitCount = 0;
+
+	// @brief 8byte まとめて補充 (56bit 以上になる)
+	// @note  ビット列の末尾を越えた分は次のビット列の内容だが、正しい入力なら消費しない
+	//-------------------------------------------------------------
+	void RefillFast()
+	{
+		unsigned long long word;
+		std::memcpy(&word, src + pos, sizeof(word));
+		buffer	 |= word << bitCount;
+		pos		 += (63 - bitCount) >> 3;
+		bitCount |= 56;
+	}
+
+	// @brief ビット列の末尾まで 1byte ずつ補充
+	//-------------------------------------------------------------
+	void RefillSlow()
+	{
+		while (bitCount <= 56 && pos < end)
+		{
+			buffer	 |= static_cast<unsigned long long>(src[pos++]) << bitCount;
+			bitCount += 8;
+		}
+	}
+
+	// @brief ビット列の範囲を越えて消費していないか
+	//-------------------------------------------------------------
+	bool IsWithinStream() const
+	{
+		return (pos - begin) * 8 - bitCount <= (end - begin) * 8;
+	}
+};
+
+//-------------------------------------------------------------
+// InterleavedEncoder
+//-------------------------------------------------------------
+
+// @brief 符号語を割り当てる
+//-------------------------------------------------------------
+bool InterleavedEncoder::Build(const unsigned* bitLengths, size_t arraySize)
+{
+	std::fill(m_codes, m_codes + 0x100, 0u);
+	std::fill(m_lengths, m_lengths + 0x100, static_cast<unsigned char>(0));
+	if (arraySize > 0x100 || !m_code.Build(bitLengths, arraySize))
+		return false;
+
+	for (size_t i = 0; i < arraySize; ++i)
+	{
+		m_codes[i]	 = m_code.GetReversedCode(i);
+		m_lengths[i] = static_cast<unsigned char>(m_code.GetBitLength(i));
+	}
+	return true;
+}
+
+// @brief 4本のビット列を交互に符号化する
+// @param pRegions    ビット列ごとの書き込み先 (最悪の長さ + 8byte 以上)
+// @param streamBytes 出力: ビット列ごとのバイト数
+//-------------------------------------------------------------
+template<unsigned SYMBOLS_PER_FLUSH>
+void InterleavedEncoder::EncodeStreams(const unsigned char* src, size_t srcSize, unsigned char* pRegions[], size_t streamBytes[]) const
+{
+	StreamWriter		 writers[NUM_INTERLEAVED_STREAM];
+	const unsigned char* pSrc[NUM_INTERLEAVED_STREAM];
+	size_t				 segmentSize[NUM_INTERLEAVED_STREAM];
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+	{
+		writers[s].ptr = pRegions[s];
+		pSrc[s]		   = src + GetSegmentBegin(srcSize, s);
+		segmentSize[s] = GetSegmentBegin(srcSize, s + 1) - GetSegmentBegin(srcSize, s);
+	}
+
+	// 4本そろって進める (最後の区間が一番短い)
+	const size_t common = segmentSize[NUM_INTERLEAVED_STREAM - 1];
+	size_t i = 0;
+	for (; i + SYMBOLS_PER_FLUSH <= common; i += SYMBOLS_PER_FLUSH)
+	{
+		for (unsigned j = 0; j < SYMBOLS_PER_FLUSH; ++j)
+		{
+			for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+			{
+				unsigned char symbol = pSrc[s][i + j];
+				writers[s].Put(m_codes[symbol], m_lengths[symbol]);
+			}
+		}
+		for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+			writers[s].Flush();
+	}
+
+	// 残り
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+	{
+		for (size_t k = i; k < segmentSize[s]; ++k)
+		{
+			unsigned char symbol = pSrc[s][k];
+			writers[s].Put(m_codes[symbol], m_lengths[symbol]);
+			writers[s].Flush();
+		}
+		writers[s].Finish();
+		streamBytes[s] = static_cast<size_t>(writers[s].ptr - pRegions[s]);
+	}
+}
+
+// @brief バイト列を符号化して末尾に追加する
+//-------------------------------------------------------------
+bool InterleavedEncoder::Encode(const unsigned char* src, size_t srcSize, std::vector<unsigned char>& /*inout*/out) const
+{
+	for (size_t i = 0; i < srcSize; ++i)
+	{
+		if (m_lengths[src[i]] == 0)
+			return false;
+	}
+
+	// ビット列ごとに最悪の長さの領域を確保して書き、あとで詰める
+	const unsigned maxBitLength = std::max(m_code.GetMaxBitLength(), 1u);
+	const size_t   segmentSize	= GetSegmentBegin(srcSize, 1);
+	const size_t   regionStride = (segmentSize * maxBitLength + 7) / 8 + 2 * sizeof(unsigned long long);
+	const size_t   start		= out.size();
+	out.resize(start + HEADER_BYTES + regionStride * NUM_INTERLEAVED_STREAM);
+
+	unsigned char* pRegions[NUM_INTERLEAVED_STREAM];
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+		pRegions[s] = out.data() + start + HEADER_BYTES + regionStride * s;
+
+	size_t streamBytes[NUM_INTERLEAVED_STREAM];
+	switch (std::min(56 / maxBitLength, MAX_SYMBOLS_PER_REFILL))
+	{
+	case 1:	 EncodeStreams<1>(src, srcSize, pRegions, streamBytes); break;
+	case 2:	 EncodeStreams<2>(src, srcSize, pRegions, streamBytes); break;
+	case 3:	 EncodeStreams<3>(src, srcSize, pRegions, streamBytes); break;
+	case 4:	 EncodeStreams<4>(src, srcSize, pRegions, streamBytes); break;
+	case 5:	 EncodeStreams<5>(src, srcSize, pRegions, streamBytes); break;
+	case 6:	 EncodeStreams<6>(src, srcSize, pRegions, streamBytes); break;
+	default: EncodeStreams<MAX_SYMBOLS_PER_REFILL>(src, srcSize, pRegions, streamBytes); break;
+	}
+
+	// ヘッダーを書き、ビット列を詰める
+	unsigned char* pHeader = out.data() + start;
+	unsigned char* pWrite  = pHeader + HEADER_BYTES;
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+	{
+		if (s + 1 < NUM_INTERLEAVED_STREAM)
+			WriteU32(pHeader + 4 * s, streamBytes[s]);
+
+		std::memmove(pWrite, pRegions[s], streamBytes[s]);
+		pWrite += streamBytes[s];
+	}
+	out.resize(static_cast<size_t>(pWrite - out.data()));
+	return true;
+}
+
+//-------------------------------------------------------------
+// InterleavedDecoder
+//-------------------------------------------------------------
+
+// @brief 復号表を作る
+//-------------------------------------------------------------
+bool InterleavedDecoder::Build(const unsigned* bitLengths, size_t arraySize)
+{
+	m_table.clear();
+	m_tableBits = 0;
+	m_complete	= false;
+
+	CanonicalCode code;
+	if (arraySize > 0x100 || !code.Build(bitLengths, arraySize) || code.GetMaxBitLength() > MAX_INTERLEAVED_BIT_LENGTH)
+		return false;
+
+	m_tableBits = std::max(code.GetMaxBitLength(), 1u);
+	m_table.assign(static_cast<size_t>(1) << m_tableBits, 0);
+
+	// 符号長 len の符号語は、上位 (m_tableBits - len) ビットによらず同じシンボル
+	size_t numFilled = 0;
+	for (size_t i = 0; i < arraySize; ++i)
+	{
+		unsigned len = code.GetBitLength(i);
+		if (len == 0)
+			continue;
+
+		unsigned short entry = static_cast<unsigned short>((len << 8) | i);
+		for (size_t idx = code.GetReversedCode(i); idx < m_table.size(); idx += static_cast<size_t>(1) << len)
+		{
+			m_table[idx] = entry;
+			++numFilled;
+		}
+	}
+	m_complete = (numFilled == m_table.size());
+	return true;
+}
+
+// @brief 4本そろって、補充1回あたり SYMBOLS_PER_REFILL 個ずつ復号する
+// @return 各ビット列で復号したシンボル数
+//-------------------------------------------------------------
+template<unsigned SYMBOLS_PER_REFILL>
+size_t InterleavedDecoder::DecodeFast(size_t srcBytes, StreamReader readers[], unsigned char* pDst[], size_t numSymbol) const
+{
+	const unsigned short* const table = m_table.data();
+	const unsigned long long	mask  = (1ull << m_tableBits) - 1;
+
+	StreamReader& r0 = readers[0];
+	StreamReader& r1 = readers[1];
+	StreamReader& r2 = readers[2];
+	StreamReader& r3 = readers[3];
+	unsigned char* const d0 = pDst[0];
+	unsigned char* const d1 = pDst[1];
+	unsigned char* const d2 = pDst[2];
+	unsigned char* const d3 = pDst[3];
+
+	// 1シンボル復号
+	auto decodeOne = [table, mask](StreamReader& r) -> unsigned char
+	{
+		unsigned short entry = table[r.buffer & mask];
+		r.buffer   >>= entry >> 8;
+		r.bitCount  -= entry >> 8;
+		return static_cast<unsigned char>(entry);
+	};
+
+	// note: 壊れた入力では前のビット列が後ろを追い越しうるため、4本とも範囲を確かめる
+	const size_t limit = srcBytes - sizeof(unsigned long long);
+	size_t i = 0;
+	while (i + SYMBOLS_PER_REFILL <= numSymbol && std::max(std::max(r0.pos, r1.pos), std::max(r2.pos, r3.pos)) <= limit)
+	{
+		r0.RefillFast();
+		r1.RefillFast();
+		r2.RefillFast();
+		r3.RefillFast();
+		for (unsigned j = 0; j < SYMBOLS_PER_REFILL; ++j)
+		{
+			d0[i + j] = decodeOne(r0);
+			d1[i + j] = decodeOne(r1);
+			d2[i + j] = decodeOne(r2);
+			d3[i + j] = decodeOne(r3);
+		}
+		i += SYMBOLS_PER_REFILL;
+	}
+	return i;
+}
+
+// @brief 1本のビット列の残りを 1シンボルずつ復号する
+//-------------------------------------------------------------
+bool InterleavedDecoder::DecodeTail(StreamReader& rReader, unsigned char* dst, size_t numSymbol) const
+{
+	const unsigned long long mask = (1ull << m_tableBits) - 1;
+	for (size_t i = 0; i < numSymbol; ++i)
+	{
+		rReader.RefillSlow();
+
+		unsigned short entry = m_table[rReader.buffer & mask];
+		unsigned	   len	 = entry >> 8;
+		if (len == 0 || len > rReader.bitCount)
+			return false;
+
+		dst[i] = static_cast<unsigned char>(entry);
+		rReader.buffer	 >>= len;
+		rReader.bitCount  -= len;
+	}
+	return true;
+}
+
+// @brief 復号する
+//-------------------------------------------------------------
+bool InterleavedDecoder::Decode(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t dstSize) const
+{
+	if (m_table.empty() || srcBytes < HEADER_BYTES)
+		return false;
+
+	// ビット列の範囲
+	StreamReader readers[NUM_INTERLEAVED_STREAM];
+	size_t		 pos = HEADER_BYTES;
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+	{
+		size_t bytes = (s + 1 < NUM_INTERLEAVED_STREAM) ? ReadU32(src + 4 * s) : srcBytes - pos;
+		if (bytes > srcBytes - pos)
+			return false;
+
+		readers[s].src	 = src;
+		readers[s].begin = pos;
+		readers[s].end	 = pos + bytes;
+		readers[s].pos	 = pos;
+		pos += bytes;
+	}
+
+	unsigned char* pDst[NUM_INTERLEAVED_STREAM];
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+		pDst[s] = dst + GetSegmentBegin(dstSize, s);
+
+	// 使われていない符号語がある場合は、1シンボルずつ確かめながら復号する
+	size_t done = 0;
+	if (m_complete)
+	{
+		const size_t common = GetSegmentBegin(dstSize, NUM_INTERLEAVED_STREAM) - GetSegmentBegin(dstSize, NUM_INTERLEAVED_STREAM - 1);
+		switch (srcBytes < sizeof(unsigned long long) ? 0 : std::min(56 / m_tableBits, MAX_SYMBOLS_PER_REFILL))
+		{
+		case 0:	 break;
+		case 3:	 done = DecodeFast<3>(srcBytes, readers, pDst, common); break;
+		case 4:	 done = DecodeFast<4>(srcBytes, readers, pDst, common); break;
+		case 5:	 done = DecodeFast<5>(srcBytes, readers, pDst, common); break;
+		case 6:	 done = DecodeFast<6>(srcBytes, readers, pDst, common); break;
+		default: done = DecodeFast<MAX_SYMBOLS_PER_REFILL>(srcBytes, readers, pDst, common); break;
+		}
+	}
+
+	for (size_t s = 0; s < NUM_INTERLEAVED_STREAM; ++s)
+	{
+		size_t segmentSize = GetSegmentBegin(dstSize, s + 1) - GetSegmentBegin(dstSize, s);
+		if (!DecodeTail(readers[s], pDst[s] + done, segmentSize - done) || !readers[s].IsWithinStream())
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+//-------------------------------------------------------------
+//! @brief	4 本のビット列に分けたハフマン符号化・復号 (バイト列用)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "HuffmanCode.h"
+#include <vector>
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace Huffman
+{
+	// note:
+	// 入力を 4 つの連続した区間に分け、区間ごとに別のビット列として符号化する。
+	// 1本のビット列ではビットバッファの更新が直列に依存するが、4本を交互に処理すれば並列に進められる。
+	//
+	// 形式: [ビット列 0～2 のバイト数 (各 4byte, little endian)] [ビット列 0] [1] [2] [3]
+	// 区間 k は シンボル位置 [k * ceil(n/4), (k+1) * ceil(n/4)) (n で切り詰め)。
+	// 各ビット列は CanonicalCode::Encode() と同じ、下位ビットから詰める形式
+
+	//! ビット列の数
+	const size_t NUM_INTERLEAVED_STREAM = 4;
+
+	//! 復号できる最大の符号長 (復号表は 2^最大符号長 要素の 1段)
+	const unsigned MAX_INTERLEAVED_BIT_LENGTH = 16;
+
+	// @class 4 本のビット列に分ける符号化器
+	class InterleavedEncoder
+	{
+	public:
+
+		//! 符号長の配列 (256 要素以下) から符号語を割り当てる
+		//! @return 符号が不正、またはシンボルが 256 を超える場合は false
+		bool Build(const unsigned* bitLengths, size_t arraySize);
+
+		//! バイト列を符号化して末尾に追加する
+		//! @return 符号長 0 のシンボルを含む場合は false
+		bool Encode(const unsigned char* src, size_t srcSize, std::vector<unsigned char>& /*inout*/out) const;
+
+		//! 正準符号
+		const CanonicalCode& GetCanonicalCode() const { return m_code; }
+
+	private:
+		template<unsigned SYMBOLS_PER_FLUSH>
+		void EncodeStreams(const unsigned char* src, size_t srcSize, unsigned char* pRegions[], size_t streamBytes[]) const;
+
+		CanonicalCode	m_code;
+		unsigned		m_codes[0x100]	 = {};	//! 下位ビットから詰める符号語
+		unsigned char	m_lengths[0x100] = {};
+	};
+
+	// @class 4 本のビット列を交互に読む復号器
+	// @note  最大符号長が分かっているため、8byte の補充1回で 56 / 最大符号長 個のシンボルを続けて復号する
+	class InterleavedDecoder
+	{
+	public:
+
+		//! 符号長の配列 (256 要素以下) から復号表を作る
+		//! @return 符号が不正、シンボルが 256 を超える、または最大符号長が MAX_INTERLEAVED_BIT_LENGTH を超える場合は false
+		bool Build(const unsigned* bitLengths, size_t arraySize);
+
+		//! dstSize バイトに復号する
+		//! @return 入力が壊れている (足りない、使われていない符号語がある) 場合は false
+		bool Decode(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t dstSize) const;
+
+		//! 復号表の要素数
+		size_t GetTableSize() const { return m_table.size(); }
+
+	private:
+		struct StreamReader;
+
+		template<unsigned SYMBOLS_PER_REFILL>
+		size_t DecodeFast(size_t srcBytes, StreamReader readers[], unsigned char* pDst[], size_t numSymbol) const;
+
+		bool DecodeTail(StreamReader& rReader, unsigned char* dst, size_t numSymbol) const;
+
+		std::vector<unsigned short>	m_table;	//! (符号長 << 8 | シンボル)。符号長 0 は使われていない符号語
+		unsigned					m_tableBits = 0;
+		bool						m_complete	= false;	//! 使われていない符号語がないか
+	};
+}
+}// end namespace
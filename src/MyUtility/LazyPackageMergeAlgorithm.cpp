@@ -1,362 +1,413 @@
-﻿//-------------------------------------------------------------
-//! @brief	遅延パッケージマージアルゴリズム
-//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
-//-------------------------------------------------------------
-
-//-------------------------------------------------------------
-// include
-//-------------------------------------------------------------
-#include "PackageMergeAlgorithm.h"
-#include <algorithm>	// std::sort
-#include <memory>
-
-//-------------------------------------------------------------
-// using
-//-------------------------------------------------------------
-using namespace MyUtility;
-
-//-------------------------------------------------------------
-// inner
-//-------------------------------------------------------------
-namespace
-{
-	// @struct ノード情報(Lazy)
-	struct LazyPMNode
-	{
-		unsigned			alphabet = 0;		//! シンボル識別子
-		unsigned long long	weight   = 0;		//!	重み (出現回数)
-		LazyPMNode*			pLeft    = nullptr;	//! ペアの左側 (これがパッケージノードであれば)
-		LazyPMNode*			pRight   = nullptr;	//! ペアの右側
-		bool				ref      = false;	//! 使用中(poolから貸し出されている場合)
-
-		LazyPMNode()
-		{}
-
-		LazyPMNode(unsigned	alp, unsigned wei)
-			: alphabet(alp)
-			, weight(wei)
-		{}
-		LazyPMNode(LazyPMNode* left, LazyPMNode* right)
-			: pLeft (left)
-			, pRight(right)
-			, weight(left->weight + right->weight)
-		{}
-		void operator=(const LazyPMNode& base)
-		{
-			// ref を除く
-			alphabet = base.alphabet;
-			weight   = base.weight;
-			pLeft    = base.pLeft;
-			pRight   = base.pRight;
-		}
-
-	};
-
-	// @class 超簡易ノードプール
-	class LazyPMNodePool
-	{
-	public:
-
-		// @brief 貸出
-		//---------------------------------------------------------
-		LazyPMNode* Borrow()
-		{
-			for (size_t i = 0; i < m_pool.size(); ++i, ++m_nextIdx)
-			{
-				if (m_nextIdx >= m_pool.size())
-					m_nextIdx = 0;
-
-				if (!m_pool[m_nextIdx].ref)
-				{
-					m_pool[m_nextIdx].ref = true;
-					return &m_pool[m_nextIdx++];
-				}
-			}
-			return nullptr;
-		}
-
-		// @brief 貸出 or 例外
-		//---------------------------------------------------------
-		LazyPMNode* BorrowOrException()
-		{
-			LazyPMNode* erem = Borrow();
-			if (erem == nullptr)
-				throw std::runtime_error("プールに空きがないっぽい");
-
-			return erem;
-		}
-
-		// @brief 返却
-		//---------------------------------------------------------
-		void Return(LazyPMNode* p)
-		{
-			p->ref = false;
-		}
-
-		LazyPMNodePool(size_t size)
-			:m_pool(size)
-		{}
-
-	private:
-		std::vector<LazyPMNode> m_pool;
-		unsigned				m_nextIdx = 0;
-	};
-
-	// using
-	using SymbolNodeList    = std::vector<LazyPMNode>;
-
-	// @struct 先読みツリー
-	struct LookAheadTree
-	{
-		union
-		{
-			struct Pair
-			{
-				LazyPMNode*	pFirst;
-				LazyPMNode*	pSecond;
-			};
-
-			Pair			pair;
-			LazyPMNode*		pElements[2];
-		};
-		size_t				nextSymbleIndex = 0;
-
-		// @brief  先読みツリーの合計の重みを返す
-		//-------------------------------------------------------------
-		inline static unsigned long long GetWeight(const LookAheadTree& lookahead)
-		{
-			if (lookahead.pair.pFirst == nullptr || lookahead.pair.pSecond == nullptr)
-				throw std::runtime_error("nullが来るのはあり得ない");
-
-			return (lookahead.pair.pFirst->weight + lookahead.pair.pSecond->weight);
-		}
-	};
-
-	// @brief  そのノードがパッケージか
-	//-------------------------------------------------------------
-	inline bool IsPackageNode(const LazyPMNode& node)
-	{
-		return (node.pLeft != nullptr && node.pRight != nullptr);
-	}
-
-	// @brief 実際に使われているシンボルを抽出
-	//-------------------------------------------------------------
-	void ExtractSymbolList(const unsigned* symbolWeights, size_t arraySize, SymbolNodeList& /*out*/list)
-	{
-		// 重みがゼロであるシンボルは利用されていないとみなし、
-		// 重みのあるシンボルだけを抽出してリスト化する
-		for (unsigned i = 0; i < arraySize; ++i)
-		{
-			if (symbolWeights[i])
-				list.push_back(LazyPMNode(i, symbolWeights[i]));
-		}
-		// 重みの昇順にソート
-		std::sort(list.begin(), list.end(),
-			[](const LazyPMNode& left, const LazyPMNode& right)
-		{
-			if (left.weight != right.weight)
-				return left.weight < right.weight;
-
-			return left.alphabet < right.alphabet;
-		});
-	}
-
-	// @brief 長さテーブル構築
-	// @note  bitlengths は 事前に resize() 等で必要な領域を割り当てておくこと
-	//-------------------------------------------------------------
-	void ExtractBitLengths(const LazyPMNode* node, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		if (node == nullptr)
-			throw std::runtime_error("nullが来るのはあり得ない");
-
-		if (IsPackageNode(*node))
-		{
-			ExtractBitLengths(node->pLeft,  bitlengths);
-			ExtractBitLengths(node->pRight, bitlengths);
-			return;
-		}
-		// 対象のアルファベットの符号長 +1
-		bitlengths[node->alphabet]++;
-	}
-	//-------------------------------------------------------------
-	void ExtractBitLengths(const SymbolNodeList& nodelist, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		for (const LazyPMNode& node : nodelist)
-		{
-			ExtractBitLengths(&node, /*out*/bitlengths);
-		}
-	}
-	//-------------------------------------------------------------
-	std::vector<unsigned> BuildBitLengthsArray(const SymbolNodeList& nodelist, size_t arraySize)
-	{
-		std::vector<unsigned> bitLengthsList(arraySize);
-		ExtractBitLengths(nodelist, /*out*/bitLengthsList);
-
-		return bitLengthsList;
-	}
-
-	// @brief ステージ数だけの先読みツリーリストを作成
-	//-------------------------------------------------------------
-	std::vector<LookAheadTree> CreateInitialLookAheadPairs(const LazyPMNode& firstSymbol, const LazyPMNode& secondSymbol, size_t codeLengthLimit, LazyPMNodePool& /*ref*/rPool)
-	{	
-		std::vector<LookAheadTree> result;
-		result.resize(codeLengthLimit);
-
-		// すべてのステージの先読みツリーは
-		// シンボルリスト中の一番目、二番目に小さな重みをもつシンボルで初期化される
-		for (size_t i = 0; i < codeLengthLimit; ++i)
-		{
-			result[i].pair.pFirst  = rPool.BorrowOrException();
-			*result[i].pair.pFirst = LazyPMNode(firstSymbol);
-
-			result[i].pair.pSecond  = rPool.BorrowOrException();
-			*result[i].pair.pSecond = LazyPMNode(secondSymbol);
-
-			result[i].nextSymbleIndex = 2;
-		}
-		return result;
-	}
-
-	// @brief 次のノード要素を選択して返す
-	//-------------------------------------------------------------
-	LazyPMNode* ChooseNextNode(const SymbolNodeList& singleSymbolList, size_t index, const LookAheadTree& lookaheadTree, LazyPMNodePool& rPool)
-	{
-		auto     nextElem = rPool.BorrowOrException();
-
-		// note: SymbolListを読み切っているため、残りはすべてパッケージ
-		if (index >= singleSymbolList.size())
-		{
-			*nextElem = LazyPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond);
-			return nextElem;
-		}
-
-		// note:
-		// 重みの小さなノードが先に返る。
-		// 重みが等しい場合はパッケージが優先
-		unsigned long long nextSymbolWeight  = singleSymbolList[index].weight;
-		unsigned long long nextPackageWeight = LookAheadTree::GetWeight(lookaheadTree);
-
-		if (nextSymbolWeight < nextPackageWeight)
-		{
-			*nextElem = LazyPMNode(singleSymbolList[index]);
-		}
-		else
-		{
-			*nextElem = LazyPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond);
-		}
-		return nextElem;
-	}
-	// @brief ノードを再帰的に開放する
-	//-------------------------------------------------------------
-	void ReleaseRecursive(LazyPMNode* pElem, LazyPMNodePool& rPool)
-	{
-		if (pElem == nullptr)
-			return;
-
-		ReleaseRecursive(pElem->pLeft, rPool);
-		ReleaseRecursive(pElem->pRight, rPool);
-
-		rPool.Return(pElem);
-	}
-	// @brief 再帰的に先読みツリーを再構築する
-	//-------------------------------------------------------------
-	void IncrementLookAheadTreeRecursive(std::vector<LookAheadTree>& rLookAheadTreeList, size_t currentStageIdx, const SymbolNodeList& symbolList, LazyPMNodePool& rPool)
-	{
-		// 上にステージがないためシンボル単体を加えるだけ。
-		if (currentStageIdx == 0)
-		{
-			for (size_t i = 0; i < 2; ++i)
-			{
-				size_t nextSymbolIndex = rLookAheadTreeList[0].nextSymbleIndex;
-				if (nextSymbolIndex >= symbolList.size())
-					return;
-
-				rLookAheadTreeList[0].pElements[i]  = rPool.BorrowOrException();
-				*rLookAheadTreeList[0].pElements[i] = LazyPMNode(symbolList[nextSymbolIndex]);
-				rLookAheadTreeList[0].nextSymbleIndex += 1;
-			}
-			return;
-		}
-		// 上にステージがある場合は シンボル単体 または パッケージで再構築
-		for (size_t i = 0; i < 2; ++i)
-		{
-			size_t nextSymbleIndex = rLookAheadTreeList[currentStageIdx].nextSymbleIndex;
-			size_t prevStageIdx = currentStageIdx - 1;
-
-			auto *pNextNode = ChooseNextNode(/*single symbol*/symbolList, nextSymbleIndex,
-											 /*or package*/rLookAheadTreeList[prevStageIdx], rPool);
-
-			rLookAheadTreeList[currentStageIdx].pElements[i] = pNextNode;
-
-
-			if (IsPackageNode(*pNextNode))
-				IncrementLookAheadTreeRecursive(rLookAheadTreeList, prevStageIdx, symbolList, rPool);
-
-			else // if was chosen single symbol
-				rLookAheadTreeList[currentStageIdx].nextSymbleIndex += 1;
-		}
-	}
-}
-
-//-------------------------------------------------------------
-// function
-//-------------------------------------------------------------
-
-// @brief 遅延パッケージマージアルゴリズム
-//-------------------------------------------------------------	
-std::vector<unsigned>  PackageMerge::LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
-{
-	SymbolNodeList symbolList;
-	ExtractSymbolList(symbolWeights, arraySize, /*out*/symbolList);
-
-	// xxx: 
-	// たまに空き要素数が足りなくなることがあるっぽい 
-	// シンボル数 < ステージ数だったときに起こる？
-	// シンボルと同じ数になるようステージ数を減らすことにする。
-	if (codeLengthLimit > symbolList.size())
-		codeLengthLimit = symbolList.size();
-
-	if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
-		return std::vector<unsigned>(); 
-
-	if (symbolList.size() <= 1)
-		return BuildBitLengthsArray(symbolList, arraySize);
-
-	// note: プールのサイズは シンボルの数×ステージ数分だけ確保すれば足りる
-	LazyPMNodePool pool(symbolList.size() * codeLengthLimit);
-
-	// note: 処理の都合で、一番末尾のステージは作らない (codeLengthLimit - 1)
-	auto lookaheadStageList = CreateInitialLookAheadPairs(symbolList[0], symbolList[1], codeLengthLimit - 1, pool);
-
-	// 先頭二つは確定
-	std::vector<unsigned> bitLengthsList(arraySize);
-	ExtractBitLengths(&symbolList[0], /*out*/bitLengthsList);
-	ExtractBitLengths(&symbolList[1], /*out*/bitLengthsList);
-
-	// 最終的にでそろうノードの数は、ステージ数(制限符号長)にかかわらず、シンボル数を n としたとき 2n-2 の数だけとなる
-	// 直前の操作ですでに2つのノードを処理済みなので、i=2から始める
-	size_t nextSymbleIndex  = 2;
-	size_t numLastStageNode = (2 * symbolList.size()) - 2;
-
-	for (size_t i = 2; i < numLastStageNode; ++i)
-	{
-		auto *pNextNode = ChooseNextNode(/*single symbol*/symbolList, nextSymbleIndex,
-										 /*or package*/*lookaheadStageList.rbegin(), pool);
-		// 符号長を更新
-		ExtractBitLengths(pNextNode, /*out*/bitLengthsList);
-
-		if (/*next continue?*/(i + 1) < numLastStageNode)
-		{
-			// 更新に使ったツリーはもう使わないため解体
-			bool wasChosenPackage = IsPackageNode(*pNextNode);
-			ReleaseRecursive(pNextNode, pool);
-
-			if (wasChosenPackage)
-				IncrementLookAheadTreeRecursive(lookaheadStageList, lookaheadStageList.size() -1, symbolList, pool);
-
-			else // if was chosen single symbol
-				nextSymbleIndex += 1;
-		}
-	}
-	return bitLengthsList;
-}
+//-------------------------------------------------------------
+//! @brief	遅延パッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill
+#include <cassert>
+#include <memory>
+#include <deque>		// std::deque
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// @struct ノード情報(Lazy)
+	struct LazyPMNode
+	{
+		unsigned			alphabet = 0;		//! シンボル識別子
+		unsigned long long	weight   = 0;		//!	重み (出現回数)
+		LazyPMNode*			pLeft    = nullptr;	//! ペアの左側 (これがパッケージノードであれば)
+		LazyPMNode*			pRight   = nullptr;	//! ペアの右側
+		bool				ref      = false;	//! 使用中(poolから貸し出されている場合)
+
+		LazyPMNode()
+		{}
+
+		LazyPMNode(unsigned	alp, unsigned wei)
+			: alphabet(alp)
+			, weight(wei)
+		{}
+		LazyPMNode(LazyPMNode* left, LazyPMNode* right)
+			: pLeft (left)
+			, pRight(right)
+			, weight(left->weight + right->weight)
+		{}
+		void operator=(const LazyPMNode& base)
+		{
+			// ref を除く
+			alphabet = base.alphabet;
+			weight   = base.weight;
+			pLeft    = base.pLeft;
+			pRight   = base.pRight;
+		}
+
+	};
+
+	// @class 超簡易ノードプール
+	class LazyPMNodePool
+	{
+	public:
+
+		// @brief 貸出
+		//---------------------------------------------------------
+		LazyPMNode* Borrow()
+		{
+			for (size_t i = 0; i < m_pool.size(); ++i, ++m_nextIdx)
+			{
+				if (m_nextIdx >= m_pool.size())
+					m_nextIdx = 0;
+
+				if (!m_pool[m_nextIdx].ref)
+				{
+					m_counters.OnBorrow();
+					m_pool[m_nextIdx].ref = true;
+					return &m_pool[m_nextIdx++];
+				}
+			}
+
+			// note:
+			// 先読みツリーが深いと 見積もり (シンボル数×ステージ数) を超えることがある。
+			// 貸し出したノードのアドレスは変えられないため、要素を足してもアドレスの変わらない予備の領域から貸し出す
+			m_counters.OnBorrow();
+			for (LazyPMNode& node : m_overflow)
+			{
+				if (!node.ref)
+				{
+					node.ref = true;
+					return &node;
+				}
+			}
+			m_overflow.emplace_back();
+			m_overflow.back().ref = true;
+			return &m_overflow.back();
+		}
+
+		// @brief 返却
+		//---------------------------------------------------------
+		void Return(LazyPMNode* p)
+		{
+			m_counters.OnRelease();
+			p->ref = false;
+		}
+
+		// @brief 必要な容量で初期化 (確保済みの領域は使い回す)
+		//---------------------------------------------------------
+		void Reset(size_t size)
+		{
+			// note: 代入演算子は ref を引き継がないため、作り直す
+			m_pool.clear();
+			m_pool.resize(size);
+			m_overflow.clear();
+			m_nextIdx = 0;
+			m_counters.Reset();
+		}
+
+		//! 見積もりの容量
+		size_t GetCapacity() const { return m_pool.size(); }
+
+		//! 見積もりを超えて足したノードの数
+		size_t GetOverflowCount() const { return m_overflow.size(); }
+
+		//! 呼び出し1回分の計測 (先読みの再構築の深さもここに記録する)
+		PackageMerge::EngineCounters& GetCounters() { return m_counters; }
+
+		LazyPMNodePool()
+		{}
+
+	private:
+		std::vector<LazyPMNode> m_pool;
+		std::deque<LazyPMNode>	m_overflow;		//! 見積もりを超えた分
+		unsigned				m_nextIdx = 0;
+		PackageMerge::EngineCounters m_counters;
+	};
+
+	// using
+	using SymbolNodeList    = std::vector<LazyPMNode>;
+
+	// @struct 先読みツリー
+	struct LookAheadTree
+	{
+		struct Pair
+		{
+			LazyPMNode*	pFirst;
+			LazyPMNode*	pSecond;
+		};
+		union
+		{
+			Pair			pair;
+			LazyPMNode*		pElements[2];
+		};
+		size_t				nextSymbleIndex = 0;
+
+		// @brief  先読みツリーの合計の重みを返す
+		//-------------------------------------------------------------
+		inline static unsigned long long GetWeight(const LookAheadTree& lookahead)
+		{
+			assert(lookahead.pair.pFirst != nullptr && lookahead.pair.pSecond != nullptr && "nullが来るのはあり得ない");
+
+			return (lookahead.pair.pFirst->weight + lookahead.pair.pSecond->weight);
+		}
+	};
+
+	// @struct 作業バッファ
+	struct LazyPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		SymbolNodeList				symbolList;
+		PackageMerge::SymbolSortBuffer	sortBuffer;
+		LazyPMNodePool				pool;
+		std::vector<LookAheadTree>	lookaheadStageList;
+	};
+
+	// @brief  そのノードがパッケージか
+	//-------------------------------------------------------------
+	inline bool IsPackageNode(const LazyPMNode& node)
+	{
+		return (node.pLeft != nullptr && node.pRight != nullptr);
+	}
+
+	// @brief 長さテーブル構築
+	// @note  bitlengths は 事前にゼロで初期化しておくこと
+	//-------------------------------------------------------------
+	void ExtractBitLengths(const LazyPMNode* node, unsigned* /*out*/bitlengths)
+	{
+		assert(node != nullptr && "nullが来るのはあり得ない");
+
+		if (IsPackageNode(*node))
+		{
+			ExtractBitLengths(node->pLeft,  bitlengths);
+			ExtractBitLengths(node->pRight, bitlengths);
+			return;
+		}
+		// 対象のアルファベットの符号長 +1
+		bitlengths[node->alphabet]++;
+	}
+	//-------------------------------------------------------------
+	void ExtractBitLengths(const SymbolNodeList& nodelist, unsigned* /*out*/bitlengths)
+	{
+		for (const LazyPMNode& node : nodelist)
+		{
+			ExtractBitLengths(&node, /*out*/bitlengths);
+		}
+	}
+	//-------------------------------------------------------------
+	void BuildBitLengthsArray(const SymbolNodeList& nodelist, size_t arraySize, unsigned* /*out*/bitLengthsList)
+	{
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		ExtractBitLengths(nodelist, /*out*/bitLengthsList);
+	}
+
+	// @brief ステージ数だけの先読みツリーリストを作成
+	//-------------------------------------------------------------
+	void CreateInitialLookAheadPairs(const LazyPMNode& firstSymbol, const LazyPMNode& secondSymbol, size_t codeLengthLimit, LazyPMNodePool& /*ref*/rPool, std::vector<LookAheadTree>& /*out*/result)
+	{	
+		result.resize(codeLengthLimit);
+
+		// すべてのステージの先読みツリーは
+		// シンボルリスト中の一番目、二番目に小さな重みをもつシンボルで初期化される
+		for (size_t i = 0; i < codeLengthLimit; ++i)
+		{
+			result[i].pair.pFirst  = rPool.Borrow();
+			*result[i].pair.pFirst = LazyPMNode(firstSymbol);
+
+			result[i].pair.pSecond  = rPool.Borrow();
+			*result[i].pair.pSecond = LazyPMNode(secondSymbol);
+
+			result[i].nextSymbleIndex = 2;
+		}
+	}
+
+	// @brief 次のノード要素を選択して返す
+	//-------------------------------------------------------------
+	LazyPMNode* ChooseNextNode(const SymbolNodeList& singleSymbolList, size_t index, const LookAheadTree& lookaheadTree, LazyPMNodePool& rPool)
+	{
+		auto     nextElem = rPool.Borrow();
+
+		// note: SymbolListを読み切っているため、残りはすべてパッケージ
+		if (index >= singleSymbolList.size())
+		{
+			*nextElem = LazyPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond);
+			return nextElem;
+		}
+
+		// note:
+		// 重みの小さなノードが先に返る。
+		// 重みが等しい場合はパッケージが優先
+		unsigned long long nextSymbolWeight  = singleSymbolList[index].weight;
+		unsigned long long nextPackageWeight = LookAheadTree::GetWeight(lookaheadTree);
+
+		if (nextSymbolWeight < nextPackageWeight)
+		{
+			*nextElem = LazyPMNode(singleSymbolList[index]);
+		}
+		else
+		{
+			*nextElem = LazyPMNode(lookaheadTree.pair.pFirst, lookaheadTree.pair.pSecond);
+		}
+		return nextElem;
+	}
+	// @brief ノードを再帰的に開放する
+	//-------------------------------------------------------------
+	void ReleaseRecursive(LazyPMNode* pElem, LazyPMNodePool& rPool)
+	{
+		if (pElem == nullptr)
+			return;
+
+		ReleaseRecursive(pElem->pLeft, rPool);
+		ReleaseRecursive(pElem->pRight, rPool);
+
+		rPool.Return(pElem);
+	}
+	// @brief 再帰的に先読みツリーを再構築する
+	//-------------------------------------------------------------
+	void IncrementLookAheadTreeRecursive(std::vector<LookAheadTree>& rLookAheadTreeList, size_t currentStageIdx, const SymbolNodeList& symbolList, LazyPMNodePool& rPool)
+	{
+		rPool.GetCounters().OnDepth(rLookAheadTreeList.size() - currentStageIdx);
+
+		// 上にステージがないためシンボル単体を加えるだけ。
+		if (currentStageIdx == 0)
+		{
+			for (size_t i = 0; i < 2; ++i)
+			{
+				size_t nextSymbolIndex = rLookAheadTreeList[0].nextSymbleIndex;
+				if (nextSymbolIndex >= symbolList.size())
+					return;
+
+				rLookAheadTreeList[0].pElements[i]  = rPool.Borrow();
+				*rLookAheadTreeList[0].pElements[i] = LazyPMNode(symbolList[nextSymbolIndex]);
+				rLookAheadTreeList[0].nextSymbleIndex += 1;
+			}
+			return;
+		}
+		// 上にステージがある場合は シンボル単体 または パッケージで再構築
+		for (size_t i = 0; i < 2; ++i)
+		{
+			size_t nextSymbleIndex = rLookAheadTreeList[currentStageIdx].nextSymbleIndex;
+			size_t prevStageIdx = currentStageIdx - 1;
+
+			auto *pNextNode = ChooseNextNode(/*single symbol*/symbolList, nextSymbleIndex,
+											 /*or package*/rLookAheadTreeList[prevStageIdx], rPool);
+
+			rLookAheadTreeList[currentStageIdx].pElements[i] = pNextNode;
+
+
+			if (IsPackageNode(*pNextNode))
+				IncrementLookAheadTreeRecursive(rLookAheadTreeList, prevStageIdx, symbolList, rPool);
+
+			else // if was chosen single symbol
+				rLookAheadTreeList[currentStageIdx].nextSymbleIndex += 1;
+		}
+	}
+
+	// @brief 遅延パッケージマージアルゴリズム本体
+	//-------------------------------------------------------------
+	PackageMerge::Status LazyPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		LazyPMBuffer& buffer = rWorkspace.GetBuffer<LazyPMBuffer>(Workspace::SLOT_LAZY);
+		StatsScope	  stats(rWorkspace, Workspace::SLOT_LAZY);
+
+		const SymbolNodeList& symbolList = buffer.symbolList;
+		ExtractSortedSymbolList(symbolWeights, arraySize, buffer.sortBuffer, /*out*/buffer.symbolList);
+		stats.EndSort();
+
+		// note:
+		// 符号長は シンボル数 - 1 を超えないため、ステージ数をシンボル数まで減らしても結果は変わらない
+		if (codeLengthLimit > symbolList.size())
+			codeLengthLimit = symbolList.size();
+
+		if (IsImpossibleCoding(symbolList.size(), codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		if (symbolList.size() <= 1)
+		{
+			BuildBitLengthsArray(symbolList, arraySize, /*out*/pBitLengths);
+			return STATUS_SUCCESS;
+		}
+
+		// note: プールは シンボルの数×ステージ数分を確保しておく (ほとんどの場合はこれで足り、超えた分は Borrow() が足す)
+		LazyPMNodePool& pool = buffer.pool;
+		pool.Reset(symbolList.size() * codeLengthLimit);
+
+		// note: 処理の都合で、一番末尾のステージは作らない (codeLengthLimit - 1)
+		std::vector<LookAheadTree>& lookaheadStageList = buffer.lookaheadStageList;
+		CreateInitialLookAheadPairs(symbolList[0], symbolList[1], codeLengthLimit - 1, pool, /*out*/lookaheadStageList);
+
+		// 先頭二つは確定
+		std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+		ExtractBitLengths(&symbolList[0], /*out*/pBitLengths);
+		ExtractBitLengths(&symbolList[1], /*out*/pBitLengths);
+
+		// 最終的にでそろうノードの数は、ステージ数(制限符号長)にかかわらず、シンボル数を n としたとき 2n-2 の数だけとなる
+		// 直前の操作ですでに2つのノードを処理済みなので、i=2から始める
+		size_t nextSymbleIndex  = 2;
+		size_t numLastStageNode = (2 * symbolList.size()) - 2;
+
+		for (size_t i = 2; i < numLastStageNode; ++i)
+		{
+			auto *pNextNode = ChooseNextNode(/*single symbol*/symbolList, nextSymbleIndex,
+											 /*or package*/*lookaheadStageList.rbegin(), pool);
+			// 符号長を更新
+			ExtractBitLengths(pNextNode, /*out*/pBitLengths);
+
+			if (/*next continue?*/(i + 1) < numLastStageNode)
+			{
+				// 更新に使ったツリーはもう使わないため解体
+				bool wasChosenPackage = IsPackageNode(*pNextNode);
+				ReleaseRecursive(pNextNode, pool);
+
+				if (wasChosenPackage)
+					IncrementLookAheadTreeRecursive(lookaheadStageList, lookaheadStageList.size() -1, symbolList, pool);
+
+				else // if was chosen single symbol
+					nextSymbleIndex += 1;
+			}
+		}
+		stats.AddCounters(pool.GetCounters(), pool.GetCapacity());
+		stats.AddOverflows(pool.GetOverflowCount());
+		return STATUS_SUCCESS;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 遅延パッケージマージアルゴリズム
+//-------------------------------------------------------------	
+std::vector<unsigned>  PackageMerge::LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!LazyPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>(); 
+
+	return bitLengthsList;
+}
+
+// @brief 遅延パッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------	
+bool PackageMerge::LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return LazyPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 遅延パッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryLazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return LazyPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
@@ -1,204 +1,707 @@
-﻿//-------------------------------------------------------------
-//! @brief	ふつうのパッケージマージアルゴリズム
-//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
-//-------------------------------------------------------------
-
-//-------------------------------------------------------------
-// include
-//-------------------------------------------------------------
-#include "PackageMergeAlgorithm.h"
-#include <algorithm>	// std::sort
-
-//-------------------------------------------------------------
-// using
-//-------------------------------------------------------------
-using namespace MyUtility;
-
-//-------------------------------------------------------------
-// inner
-//-------------------------------------------------------------
-namespace
-{
-	// @struct ノード情報
-	struct SymbolNode
-	{
-		unsigned		   alphabet = 0;		//! シンボル識別子
-		unsigned long long weight   = 0;		//!	重み (出現回数)
-		
-		const SymbolNode*  pLeft   = nullptr;	//! ペアの左側 (これがパッケージノードであれば)
-		const SymbolNode*  pRight  = nullptr;	//! ペアの右側
-
-		SymbolNode()
-		{}
-
-		SymbolNode(unsigned	alp, unsigned wei)
-			: alphabet(alp)
-			, weight(wei)
-		{}
-		SymbolNode(const SymbolNode* left, const SymbolNode* right)
-			: pLeft(left)
-			, pRight(right)
-			, weight(left->weight + right->weight)
-		{}
-	};
-
-	// using
-	using SymbolNodeList = std::vector<SymbolNode>;
-
-
-	// @brief 実際に使われているシンボルを抽出
-	//-------------------------------------------------------------
-	void ExtractSymbolList(const unsigned* symbolWeights, size_t arraySize, SymbolNodeList& /*out*/list)
-	{
-		// 重みがゼロであるシンボルは利用されていないとみなし、
-		// 重みのあるシンボルだけを抽出してリスト化する
-		for (size_t i = 0; i < arraySize; ++i)
-		{
-			if (symbolWeights[i])
-			{
-				unsigned symbol = static_cast<unsigned>(i);
-				list.push_back(SymbolNode(symbol, symbolWeights[i]));
-			}
-		}
-	}
-
-	// @brief  そのノードがパッケージか
-	//-------------------------------------------------------------
-	inline bool IsPackageNode(const SymbolNode& node)
-	{
-		return (node.pLeft != nullptr && node.pRight != nullptr);
-	}
-
-	// @brief ソート用比較関数
-	//-------------------------------------------------------------
-	bool LessCompare(const SymbolNode& left, const SymbolNode& right)
-	{
-		if (left.weight != right.weight)
-			return left.weight < right.weight;
-
-		if (left.alphabet != right.alphabet)
-			return left.alphabet < right.alphabet;
-
-		// note: 遅延 / 境界パッケージマージと結果を合わせる目的。なくても可
-		if (IsPackageNode(left))
-		{
-			// ポインタ比較。上のステージでより左側にあるノードを参照しているほうが左側
-			if (IsPackageNode(right))
-				return left.pLeft < right.pLeft;
-
-			// シンボル単体のノードよりパッケージのほうが常に左側
-			else
-				return true;
-		}
-		return false;
-	}
-
-	// @brief ノードステージ整理
-	//-------------------------------------------------------------
-	void ResolveNodeStage(SymbolNodeList& /*inout*/list)
-	{
-		// 値の昇順のアルファベットの昇順にソート
-		std::sort(list.begin(), list.end(), LessCompare);
-
-		// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
-		if (list.size() & 0x1)
-			list.pop_back();
-	}
-
-	// @brief 長さテーブル構築
-	// @note  bitlengths は 事前に resize() 等で必要な領域を割り当てておくこと
-	//-------------------------------------------------------------
-	void ExtractBitLengths(const SymbolNode* node, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		if (node == nullptr)
-			throw std::runtime_error("nullが来るのはあり得ない");
-
-		if (IsPackageNode(*node))
-		{
-			ExtractBitLengths(node->pLeft,  bitlengths);
-			ExtractBitLengths(node->pRight, bitlengths);
-			return;
-		}
-		// 対象のアルファベットの符号長 +1
-		bitlengths[node->alphabet]++;
-	}
-	//-------------------------------------------------------------
-	void ExtractBitLengths(const SymbolNodeList& nodelist, std::vector<unsigned>& /*out*/bitlengths)
-	{
-		for (const SymbolNode& node : nodelist)
-		{
-			ExtractBitLengths(&node, /*out*/bitlengths);
-		}
-	}
-	//-------------------------------------------------------------
-	std::vector<unsigned> BuildBitLengthsArray(const SymbolNodeList& nodelist, size_t arraySize)
-	{
-		std::vector<unsigned> bitLengthsList(arraySize);
-		ExtractBitLengths(nodelist, /*out*/bitLengthsList);
-
-		return bitLengthsList;
-	}
-}
-
-//-------------------------------------------------------------
-// function
-//-------------------------------------------------------------
-
-// @brief 純粋なパッケージマージアルゴリズム
-//-------------------------------------------------------------	
-std::vector<unsigned> PackageMerge::NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
-{
-	std::vector<SymbolNodeList> nodeStages(codeLengthLimit);
-	ExtractSymbolList(symbolWeights, arraySize, /*out*/nodeStages[0]);
-
-	// キャパオーバー
-	if (IsImpossibleCoding(nodeStages[0].size(), codeLengthLimit))
-		return std::vector<unsigned>(); // 空の配列を返す
-
-	// 有効なシンボルが2つ以上存在しない
-	if (nodeStages[0].size() <= 1)
-		return BuildBitLengthsArray(nodeStages[0], arraySize);
-
-	// 各ステージを初期化
-	for (size_t i = 1; i < codeLengthLimit; ++i)
-	{
-		nodeStages[i].assign(nodeStages[0].begin(), nodeStages[0].end());
-	}
-	ResolveNodeStage(/*ref*/nodeStages[0]);
-
-	// 上から下に向かって順番にマージする
-	for (unsigned stage_i = 1; stage_i < nodeStages.size(); ++stage_i)
-	{
-		const SymbolNodeList& prevStage = nodeStages[stage_i - 1];
-		SymbolNodeList&       nextStage = nodeStages[stage_i];
-
-		// 2つのノードを子とするパッケージを作成して次のステージに追加
-		// ペアから漏れる要素に対しては処理が通らないことに注意 (elem_i = 1 3 5...)
-		for (unsigned elem_i = 1; elem_i < prevStage.size(); elem_i += 2)
-		{
-			const SymbolNode* left  = &prevStage[elem_i - 1];
-			const SymbolNode* right = &prevStage[elem_i];
-
-			nextStage.push_back(SymbolNode(left, right));
-		}
-		ResolveNodeStage(/*ref*/nextStage);
-	}
-
-	// 結果を生成する
-	return BuildBitLengthsArray(nodeStages[codeLengthLimit - 1], arraySize);
-}
-
-// @brief  符号化が不可能か
-// @return 不可能なら true
-//-------------------------------------------------------------	
-bool PackageMerge::IsImpossibleCoding(size_t numSymbol, size_t codeLengthLimit)
-{
-	// シンボルの数を "n"
-	// 要求される最大符号長を "L" としたとき
-	// シンボルの符号化を正しく行うには
-	// L ≥ [log2 n] の式を満たす必要がある
-	//
-	// この式を満たさないほどにシンボルの数が増えると
-	// 符号を割り当てることができない
-	return numSymbol > (1ULL << codeLengthLimit);
+//-------------------------------------------------------------
+//! @brief	ふつうのパッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include "SymbolExtraction.h"
+#include "PackageMergeStats.h"
+#include <algorithm>	// std::sort, std::fill
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <utility>	// std::move
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// パッケージノードを表すフラグ (index の最上位ビット)
+	const unsigned PACKAGE_FLAG = 0x80000000u;
+
+	// @struct ノード情報
+	// @note  子ノードはポインタではなく上のステージ中の要素番号で参照する。
+	//        SUM はパッケージの重みを数える型で、32bit なら 8byte、64bit なら 16byte
+	template<class SUM>
+	struct SymbolNode
+	{
+		SUM		 weight = 0;	//!	重み (出現回数)
+		unsigned index  = 0;	//! シンボル単体ならシンボル識別子、パッケージならペアの左側の要素番号 (右側は +1) に PACKAGE_FLAG を立てたもの
+
+		SymbolNode()
+		{}
+
+		SymbolNode(unsigned	alp, SUM wei)
+			: weight(wei)
+			, index(alp)
+		{}
+
+		// @brief パッケージノードを作る
+		static SymbolNode Package(SUM wei, size_t leftIndex)
+		{
+			return SymbolNode(static_cast<unsigned>(leftIndex) | PACKAGE_FLAG, wei);
+		}
+	};
+
+	// using
+	template<class SUM>
+	using SymbolNodeList = std::vector<SymbolNode<SUM>>;
+
+	// @struct パッケージの重みの型ごとの作業領域
+	template<class SUM>
+	struct NaturalPMState
+	{
+		SymbolNodeList<SUM>					symbolList;
+		std::vector<SymbolNodeList<SUM>>	nodeStages;	//! ステージ数は呼び出しごとに変わるため、縮めずに使い回す
+	};
+
+	// @struct パイプライン化したステージの進み具合
+	// @note  ステージの出力 (nodeStages[s]) をそのまま単一生産者・単一消費者のキューとして使い、
+	//        公開済みの要素数だけを受け渡す。キャッシュラインを分けてスレッド間の偽共有を避ける
+	struct alignas(64) PipelineStage
+	{
+		std::atomic<size_t>	published{ 0 };		//! 下のステージに公開したノード数
+		std::atomic<bool>	done{ false };		//! 出力し終えたか (published は確定)
+		size_t				symbol_i  = 0;		//! 以下は持ち主のスレッドだけが触る
+		size_t				package_i = 0;
+		size_t				numNode	  = 0;
+	};
+
+	// @struct 作業バッファ
+	struct NaturalPMBuffer : public PackageMerge::Workspace::Buffer
+	{
+		PackageMerge::SymbolSortBuffer	sortBuffer;
+		NaturalPMState<unsigned>			narrow;	//! 重みの合計 × 制限符号長 が 32bit に収まる場合
+		NaturalPMState<unsigned long long>	wide;
+
+		std::unique_ptr<PipelineStage[]>	pipelineStages;			//! パイプライン化した版でのみ使う
+		size_t								numPipelineStage = 0;
+	};
+
+
+	// @brief  そのノードがパッケージか
+	//-------------------------------------------------------------
+	template<class SUM>
+	inline bool IsPackageNode(const SymbolNode<SUM>& node)
+	{
+		return (node.index & PACKAGE_FLAG) != 0;
+	}
+
+	// @brief ノードステージ整理
+	//-------------------------------------------------------------
+	template<class SUM>
+	void ResolveNodeStage(SymbolNodeList<SUM>& /*inout*/list)
+	{
+		// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
+		if (list.size() & 0x1)
+			list.pop_back();
+	}
+
+	// @brief 次のノードステージを構築
+	// @note  シンボルリストは重みの昇順、上のステージから作るパッケージも重みの昇順に並ぶため、
+	//        ソートせずとも 2つの列のマージだけで整列済みのステージが作れる
+	//-------------------------------------------------------------
+	template<class SUM>
+	void MergeNodeStage(const SymbolNodeList<SUM>& symbolList, const SymbolNodeList<SUM>& prevStage, SymbolNodeList<SUM>& /*out*/nextStage)
+	{
+		size_t numPackage = prevStage.size() / 2;
+		nextStage.clear();
+		nextStage.reserve(symbolList.size() + numPackage);
+
+		size_t symbol_i  = 0;
+		size_t package_i = 0;
+		while (symbol_i < symbolList.size() || package_i < numPackage)
+		{
+			if (package_i < numPackage)
+			{
+				size_t leftIndex     = package_i * 2;
+				SUM	   packageWeight = prevStage[leftIndex].weight + prevStage[leftIndex + 1].weight;
+
+				// note:
+				// 重みが等しい場合はパッケージが優先 (遅延 / 境界パッケージマージと結果を合わせる目的)
+				// パッケージ同士は上のステージでより左側にあるノードを参照しているほうが左側
+				if (symbol_i >= symbolList.size() || packageWeight <= symbolList[symbol_i].weight)
+				{
+					nextStage.push_back(SymbolNode<SUM>::Package(packageWeight, leftIndex));
+					++package_i;
+					continue;
+				}
+			}
+			nextStage.push_back(symbolList[symbol_i++]);
+		}
+		ResolveNodeStage(/*ref*/nextStage);
+	}
+
+	// @brief 長さテーブル構築
+	// @note  bitlengths は 事前にゼロで初期化しておくこと
+	//-------------------------------------------------------------
+	template<class SUM>
+	void ExtractBitLengths(const std::vector<SymbolNodeList<SUM>>& nodeStages, size_t stageIdx, size_t nodeIdx, unsigned* /*out*/bitlengths)
+	{
+		const SymbolNode<SUM>& node = nodeStages[stageIdx][nodeIdx];
+		if (IsPackageNode(node))
+		{
+			assert(stageIdx != 0 && "一番上のステージにパッケージがあるのはあり得ない");
+
+			unsigned leftIndex = node.index & ~PACKAGE_FLAG;
+			ExtractBitLengths(nodeStages, stageIdx - 1, leftIndex,     bitlengths);
+			ExtractBitLengths(nodeStages, stageIdx - 1, leftIndex + 1, bitlengths);
+			return;
+		}
+		// 対象のアルファベットの符号長 +1
+		bitlengths[node.index]++;
+	}
+	//-------------------------------------------------------------
+	template<class SUM>
+	void BuildBitLengthsArray(const std::vector<SymbolNodeList<SUM>>& nodeStages, size_t stageIdx, size_t arraySize, unsigned* /*out*/bitLengthsList)
+	{
+		std::fill(bitLengthsList, bitLengthsList + arraySize, 0u);
+		for (size_t node_i = 0; node_i < nodeStages[stageIdx].size(); ++node_i)
+		{
+			ExtractBitLengths(nodeStages, stageIdx, node_i, /*out*/bitLengthsList);
+		}
+	}
+
+	// @brief ステージのノード数を統計に記録する (すべてのステージを同時に保持するため、ノード数がそのまま使用量になる)
+	//-------------------------------------------------------------
+	template<class SUM>
+	void RecordNodeStages(const std::vector<SymbolNodeList<SUM>>& nodeStages, size_t numStage, PackageMerge::StatsScope& rStats)
+	{
+#if MYUTILITY_PACKAGE_MERGE_STATS
+		size_t numNode	= 0;
+		size_t capacity	= 0;
+		for (size_t stage_i = 0; stage_i < numStage; ++stage_i)
+		{
+			numNode	 += nodeStages[stage_i].size();
+			capacity += nodeStages[stage_i].capacity();
+		}
+		rStats.AddNodes(numNode);
+		rStats.ObservePool(numNode, capacity);
+#else
+		(void)nodeStages;
+		(void)numStage;
+		(void)rStats;
+#endif
+	}
+
+	// @brief 純粋なパッケージマージアルゴリズム本体 (シンボルは並べ替え済み)
+	//-------------------------------------------------------------
+	template<class SUM, class WEIGHT>
+	PackageMerge::Status RunNaturalPM(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, const PackageMerge::SymbolSortBuffer& sortBuffer, NaturalPMState<SUM>& rState, unsigned* pBitLengths, PackageMerge::StatsScope& rStats)
+	{
+		const SymbolNodeList<SUM>& symbolList = rState.symbolList;
+		PackageMerge::BuildSortedSymbolList(symbolWeights, sortBuffer, /*out*/rState.symbolList);
+
+		std::vector<SymbolNodeList<SUM>>& nodeStages = rState.nodeStages;
+		if (nodeStages.size() < std::max<size_t>(codeLengthLimit, 1))
+			nodeStages.resize(std::max<size_t>(codeLengthLimit, 1));
+
+		// 一番上のステージはシンボル単体のみ
+		nodeStages[0].assign(symbolList.begin(), symbolList.end());
+
+		// 有効なシンボルが2つ以上存在しない
+		if (symbolList.size() <= 1)
+		{
+			BuildBitLengthsArray(nodeStages, 0, arraySize, /*out*/pBitLengths);
+			return PackageMerge::STATUS_SUCCESS;
+		}
+		ResolveNodeStage(/*ref*/nodeStages[0]);
+
+		// 上から下に向かって順番にマージする
+		// ペアから漏れる要素に対しては処理が通らないことに注意
+		for (size_t stage_i = 1; stage_i < codeLengthLimit; ++stage_i)
+		{
+			MergeNodeStage(symbolList, nodeStages[stage_i - 1], /*out*/nodeStages[stage_i]);
+		}
+		RecordNodeStages(nodeStages, codeLengthLimit, rStats);
+
+		// 結果を生成する
+		BuildBitLengthsArray(nodeStages, codeLengthLimit - 1, arraySize, /*out*/pBitLengths);
+		return PackageMerge::STATUS_SUCCESS;
+	}
+
+	//-------------------------------------------------------------
+	// pipeline
+	//-------------------------------------------------------------
+
+	// これ未満のシンボル数ではスレッドを立てる手間が勝つため、パイプライン化しない
+	const size_t PIPELINE_MIN_SYMBOL = 1 << 14;
+
+	// ステージを一度に進めるノード数 (この単位で下のステージへ公開する)
+	const size_t PIPELINE_QUOTA = 1024;
+
+	// @brief ステージを進められるだけ進める
+	// @return 1つでもノードを出力したか
+	// @note  上のステージのパッケージがまだ揃っていなくても、未公開のパッケージの重みは
+	//        公開済みの最後のノードの重みの 2倍以上になるため、それより軽いシンボル単体は先に出力できる
+	//-------------------------------------------------------------
+	template<class SUM>
+	bool AdvancePipelineStage(const SymbolNodeList<SUM>& symbolList, const SymbolNode<SUM>* pPrevNodes, PipelineStage& rPrev, SymbolNode<SUM>* pNodes, PipelineStage& rStage)
+	{
+		// note: done を先に読めば、done のときの published は確定している
+		const bool	 isPrevDone	= rPrev.done.load(std::memory_order_acquire);
+		const size_t numPrev	= rPrev.published.load(std::memory_order_acquire);
+		const size_t numPackage	= numPrev / 2;
+		const size_t numSymbol	= symbolList.size();
+
+		size_t symbol_i	 = rStage.symbol_i;
+		size_t package_i = rStage.package_i;
+		size_t numNode	 = rStage.numNode;
+		size_t quota	 = PIPELINE_QUOTA;
+		for (; quota > 0; --quota)
+		{
+			if (package_i < numPackage)
+			{
+				size_t leftIndex	 = package_i * 2;
+				SUM	   packageWeight = pPrevNodes[leftIndex].weight + pPrevNodes[leftIndex + 1].weight;
+
+				// 重みが等しい場合はパッケージが優先 (MergeNodeStage と同じ)
+				if (symbol_i >= numSymbol || packageWeight <= symbolList[symbol_i].weight)
+				{
+					pNodes[numNode++] = SymbolNode<SUM>::Package(packageWeight, leftIndex);
+					++package_i;
+					continue;
+				}
+			}
+			else if (!isPrevDone)
+			{
+				// 次のパッケージの重みがまだ分からない
+				if (symbol_i >= numSymbol || numPrev == 0)
+					break;
+
+				// note: weight < 2 × last を桁あふれしないように比べる
+				SUM weight = symbolList[symbol_i].weight;
+				SUM last   = pPrevNodes[numPrev - 1].weight;
+				if (weight >= last && weight - last >= last)
+					break;
+			}
+			else if (symbol_i >= numSymbol)
+			{
+				// 2組のペアから漏れる要素がある場合、一番大きなノード１つを除外する
+				if (numNode & 0x1)
+					--numNode;
+
+				rStage.numNode = numNode;
+				rStage.published.store(numNode, std::memory_order_release);
+				rStage.done.store(true, std::memory_order_release);
+				return true;
+			}
+			pNodes[numNode++] = symbolList[symbol_i++];
+		}
+
+		bool isProgressed = (numNode != rStage.numNode);
+		rStage.symbol_i	  = symbol_i;
+		rStage.package_i  = package_i;
+		rStage.numNode	  = numNode;
+		if (isProgressed)
+			rStage.published.store(numNode, std::memory_order_release);
+
+		return isProgressed;
+	}
+
+	// @brief 受け持ちのステージ [beginStage, endStage) をすべて出力し終えるまで進める
+	//-------------------------------------------------------------
+	template<class SUM>
+	void RunPipelineWorker(const SymbolNodeList<SUM>& symbolList, std::vector<SymbolNodeList<SUM>>& nodeStages, PipelineStage* pStages, size_t beginStage, size_t endStage)
+	{
+		size_t firstActive = beginStage;
+		while (firstActive < endStage)
+		{
+			bool isProgressed = false;
+			for (size_t stage_i = firstActive; stage_i < endStage; ++stage_i)
+			{
+				if (pStages[stage_i].done.load(std::memory_order_relaxed))
+					continue;
+
+				isProgressed |= AdvancePipelineStage(symbolList, nodeStages[stage_i - 1].data(), pStages[stage_i - 1], nodeStages[stage_i].data(), pStages[stage_i]);
+			}
+
+			// 上のステージから順に終わるため、終わったステージは以降見ない
+			while (firstActive < endStage && pStages[firstActive].done.load(std::memory_order_relaxed))
+				++firstActive;
+
+			// 上のステージを受け持つスレッドを待つ
+			if (!isProgressed)
+				std::this_thread::yield();
+		}
+	}
+
+	// @brief ステージをスレッドに割り振ってパイプライン化した純粋なパッケージマージアルゴリズム本体 (シンボルは並べ替え済み)
+	// @note  シンボルは 2つ以上あること
+	//-------------------------------------------------------------
+	template<class SUM, class WEIGHT>
+	PackageMerge::Status RunPipelinedNaturalPM(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, size_t numWorker, NaturalPMBuffer& rBuffer, NaturalPMState<SUM>& rState, unsigned* pBitLengths, PackageMerge::StatsScope& rStats)
+	{
+		const SymbolNodeList<SUM>& symbolList = rState.symbolList;
+		PackageMerge::BuildSortedSymbolList(symbolWeights, rBuffer.sortBuffer, /*out*/rState.symbolList);
+
+		// 各ステージの出力は シンボル数 + 上のステージの半分 (< 2n) を超えないため、先に確保しておく
+		// note: 縮めずに使い回し、要素数はステージの進み具合で持つ
+		std::vector<SymbolNodeList<SUM>>& nodeStages = rState.nodeStages;
+		if (nodeStages.size() < codeLengthLimit)
+			nodeStages.resize(codeLengthLimit);
+
+		for (size_t stage_i = 1; stage_i < codeLengthLimit; ++stage_i)
+		{
+			if (nodeStages[stage_i].size() < symbolList.size() * 2)
+				nodeStages[stage_i].resize(symbolList.size() * 2);
+		}
+
+		if (rBuffer.numPipelineStage < codeLengthLimit)
+		{
+			rBuffer.pipelineStages.reset(new PipelineStage[codeLengthLimit]);
+			rBuffer.numPipelineStage = codeLengthLimit;
+		}
+		PipelineStage* pStages = rBuffer.pipelineStages.get();
+		for (size_t stage_i = 0; stage_i < codeLengthLimit; ++stage_i)
+		{
+			pStages[stage_i].published.store(0, std::memory_order_relaxed);
+			pStages[stage_i].done.store(false, std::memory_order_relaxed);
+			pStages[stage_i].symbol_i  = 0;
+			pStages[stage_i].package_i = 0;
+			pStages[stage_i].numNode   = 0;
+		}
+
+		// 一番上のステージはシンボル単体のみ
+		nodeStages[0].assign(symbolList.begin(), symbolList.end());
+		ResolveNodeStage(/*ref*/nodeStages[0]);
+		pStages[0].numNode = nodeStages[0].size();
+		pStages[0].published.store(nodeStages[0].size(), std::memory_order_relaxed);
+		pStages[0].done.store(true, std::memory_order_relaxed);
+
+		// ステージ 1 ～ L-1 を連続した塊に分けて各スレッドに割り振る (呼び出し元のスレッドは先頭の塊)
+		const size_t numStage = codeLengthLimit - 1;
+		std::vector<std::thread> threads;
+		threads.reserve(numWorker - 1);
+		for (size_t worker_i = 1; worker_i < numWorker; ++worker_i)
+		{
+			size_t beginStage = 1 + numStage * worker_i / numWorker;
+			size_t endStage	  = 1 + numStage * (worker_i + 1) / numWorker;
+			threads.emplace_back(RunPipelineWorker<SUM>, std::cref(symbolList), std::ref(nodeStages), pStages, beginStage, endStage);
+		}
+		RunPipelineWorker(symbolList, nodeStages, pStages, 1, 1 + numStage / numWorker);
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+#if MYUTILITY_PACKAGE_MERGE_STATS
+		// note: ステージの領域は 2n 要素ずつ先に確保しているため、使用量は実際に出力したノード数で数える
+		size_t numNode	= 0;
+		size_t capacity	= 0;
+		for (size_t stage_i = 0; stage_i < codeLengthLimit; ++stage_i)
+		{
+			numNode	 += pStages[stage_i].numNode;
+			capacity += nodeStages[stage_i].capacity();
+		}
+		rStats.AddNodes(numNode);
+		rStats.ObservePool(numNode, capacity);
+#else
+		(void)rStats;
+#endif
+
+		// 結果を生成する
+		// note: パッケージは上のステージのペアを先頭から順に使うため、最後のステージから使われるノードは各ステージの先頭からの連続した範囲になる。
+		//       下のステージから順に、範囲中のシンボル単体の符号長を +1 し、パッケージの数の 2倍を上のステージの範囲とする
+		std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+		size_t numUsed = pStages[codeLengthLimit - 1].numNode;
+		for (size_t stage_i = codeLengthLimit; stage_i-- > 0; )
+		{
+			const SymbolNode<SUM>* pNodes = nodeStages[stage_i].data();
+			size_t numPackage = 0;
+			for (size_t node_i = 0; node_i < numUsed; ++node_i)
+			{
+				if (IsPackageNode(pNodes[node_i]))
+					++numPackage;
+				else
+					++pBitLengths[pNodes[node_i].index];
+			}
+			numUsed = numPackage * 2;
+		}
+		return PackageMerge::STATUS_SUCCESS;
+	}
+
+	// @brief 純粋なパッケージマージアルゴリズム (重みの型ごとの共通部分)
+	// @note  パッケージの重みは 制限符号長 × 重みの合計 を超えないため、収まるなら 32bit で数える
+	//-------------------------------------------------------------
+	template<class WEIGHT>
+	PackageMerge::Status NaturalPMImpl(const WEIGHT* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths)
+	{
+		using namespace PackageMerge;
+		NaturalPMBuffer& buffer = rWorkspace.GetBuffer<NaturalPMBuffer>(Workspace::SLOT_NATURAL);
+		StatsScope		 stats(rWorkspace, Workspace::SLOT_NATURAL);
+
+		SymbolSummary summary = SortSymbolKeys(symbolWeights, arraySize, buffer.sortBuffer);
+		stats.EndSort();
+
+		// キャパオーバー
+		if (IsImpossibleCoding(summary.numSymbol, codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		if (IsNarrowSumEnough(summary, codeLengthLimit))
+			return RunNaturalPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.narrow, pBitLengths, stats);
+
+		if (IsWideSumEnough(summary, codeLengthLimit))
+			return RunNaturalPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.wide, pBitLengths, stats);
+
+		// パッケージの重みが 64bit に収まらない
+		return STATUS_CAPACITY_EXCEEDED;
+	}
+
+	// @brief ステージをスレッドに割り振ってパイプライン化した純粋なパッケージマージアルゴリズム
+	//-------------------------------------------------------------
+	PackageMerge::Status PipelinedNaturalPMImpl(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, PackageMerge::Workspace& rWorkspace, unsigned* pBitLengths, size_t numThread)
+	{
+		using namespace PackageMerge;
+		if (numThread == 0)
+			numThread = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+		NaturalPMBuffer& buffer = rWorkspace.GetBuffer<NaturalPMBuffer>(Workspace::SLOT_NATURAL);
+		StatsScope		 stats(rWorkspace, Workspace::SLOT_NATURAL);
+
+		SymbolSummary summary = SortSymbolKeys(symbolWeights, arraySize, buffer.sortBuffer);
+		stats.EndSort();
+
+		// キャパオーバー
+		if (IsImpossibleCoding(summary.numSymbol, codeLengthLimit))
+			return STATUS_IMPOSSIBLE_CODING;
+
+		// 1ステージに 1スレッドより多くは割り振らない
+		size_t numWorker = std::min(numThread, codeLengthLimit - 1);
+		bool   isNarrow	 = IsNarrowSumEnough(summary, codeLengthLimit);
+
+		// 小さな入力や 1スレッドでは、パイプライン化せずに順に求める
+		if (numWorker <= 1 || summary.numSymbol < PIPELINE_MIN_SYMBOL)
+		{
+			if (isNarrow)
+				return RunNaturalPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.narrow, pBitLengths, stats);
+
+			if (IsWideSumEnough(summary, codeLengthLimit))
+				return RunNaturalPM(symbolWeights, arraySize, codeLengthLimit, buffer.sortBuffer, buffer.wide, pBitLengths, stats);
+
+			return STATUS_CAPACITY_EXCEEDED;
+		}
+
+		if (isNarrow)
+			return RunPipelinedNaturalPM(symbolWeights, arraySize, codeLengthLimit, numWorker, buffer, buffer.narrow, pBitLengths, stats);
+
+		if (IsWideSumEnough(summary, codeLengthLimit))
+			return RunPipelinedNaturalPM(symbolWeights, arraySize, codeLengthLimit, numWorker, buffer, buffer.wide, pBitLengths, stats);
+
+		// パッケージの重みが 64bit に収まらない
+		return STATUS_CAPACITY_EXCEEDED;
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 純粋なパッケージマージアルゴリズム
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!NaturalPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>(); // 空の配列を返す
+
+	return bitLengthsList;
+}
+
+// @brief 純粋なパッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------	
+bool PackageMerge::NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 純粋なパッケージマージアルゴリズム (16bit の重み)
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::NaturalPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!NaturalPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>(); // 空の配列を返す
+
+	return bitLengthsList;
+}
+
+bool PackageMerge::NaturalPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief 純粋なパッケージマージアルゴリズム (64bit の重み)
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::NaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!NaturalPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>(); // 空の配列を返す
+
+	return bitLengthsList;
+}
+
+bool PackageMerge::NaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths) == STATUS_SUCCESS;
+}
+
+// @brief ステージをスレッドに割り振ってパイプライン化した純粋なパッケージマージアルゴリズム
+//-------------------------------------------------------------	
+std::vector<unsigned> PackageMerge::PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit)
+{
+	Workspace			  workspace;
+	std::vector<unsigned> bitLengthsList(arraySize);
+
+	if (!PipelinedNaturalPM(symbolWeights, arraySize, codeLengthLimit, workspace, bitLengthsList.data()))
+		return std::vector<unsigned>(); // 空の配列を返す
+
+	return bitLengthsList;
+}
+
+// @brief ステージをスレッドに割り振ってパイプライン化した純粋なパッケージマージアルゴリズム (作業領域を使い回す版)
+//-------------------------------------------------------------	
+bool PackageMerge::PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	return PipelinedNaturalPM(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, 0);
+}
+
+bool PackageMerge::PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths, size_t numThread)
+{
+	return PipelinedNaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, numThread) == STATUS_SUCCESS;
+}
+
+// @brief 純粋なパッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+PackageMerge::Status PackageMerge::TryNaturalPM(const unsigned short* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+PackageMerge::Status PackageMerge::TryNaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return NaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+}
+
+// @brief ステージをスレッドに割り振ってパイプライン化した純粋なパッケージマージアルゴリズム (例外を送出しない版)
+//-------------------------------------------------------------
+PackageMerge::Status PackageMerge::TryPipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+{
+	return PipelinedNaturalPMImpl(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths, 0);
+}
+
+// @brief  符号化が不可能か
+// @return 不可能なら true
+//-------------------------------------------------------------	
+bool PackageMerge::IsImpossibleCoding(size_t numSymbol, size_t codeLengthLimit) noexcept
+{
+	// シンボルの数を "n"
+	// 要求される最大符号長を "L" としたとき
+	// シンボルの符号化を正しく行うには
+	// L ≥ [log2 n] の式を満たす必要がある
+	//
+	// この式を満たさないほどにシンボルの数が増えると
+	// 符号を割り当てることができない
+	return numSymbol > (1ULL << codeLengthLimit);
+}
+
+// @brief 符号化後の総ビット数
+//-------------------------------------------------------------
+unsigned long long PackageMerge::CalculateTotalBits(const unsigned* symbolWeights, const unsigned* pBitLengths, size_t arraySize)
+{
+	unsigned long long totalBits = 0;
+	for (size_t i = 0; i < arraySize; ++i)
+		totalBits += static_cast<unsigned long long>(symbolWeights[i]) * pBitLengths[i];
+
+	return totalBits;
+}
+
+// @brief 別の統計を加える
+//-------------------------------------------------------------
+void PackageMerge::EngineStats::Merge(const EngineStats& other)
+{
+	callCount		 += other.callCount;
+	nodeCount		 += other.nodeCount;
+	sweepCount		 += other.sweepCount;
+	releaseCount	 += other.releaseCount;
+	overflowCount	 += other.overflowCount;
+	maxRecursionDepth = std::max(maxRecursionDepth, other.maxRecursionDepth);
+	peakPoolInUse	  = std::max(peakPoolInUse, other.peakPoolInUse);
+	peakPoolCapacity  = std::max(peakPoolCapacity, other.peakPoolCapacity);
+	peakPoolUsage	  = std::max(peakPoolUsage, other.peakPoolUsage);
+	sortNs			 += other.sortNs;
+	mainLoopNs		 += other.mainLoopNs;
+}
+
+// @brief 統計を記録するビルドか
+//-------------------------------------------------------------
+bool PackageMerge::IsEngineStatsEnabled()
+{
+	return MYUTILITY_PACKAGE_MERGE_STATS != 0;
+}
+
+// @brief アルゴリズムの統計を取得
+//-------------------------------------------------------------
+const PackageMerge::EngineStats& PackageMerge::GetEngineStats(Workspace& rWorkspace, Workspace::BufferSlot slot)
+{
+	return rWorkspace.GetBuffer<EngineStatsBuffer>(Workspace::SLOT_STATS).stats[slot];
+}
+
+// @brief 統計をすべてゼロに戻す
+//-------------------------------------------------------------
+void PackageMerge::ResetEngineStats(Workspace& rWorkspace)
+{
+	EngineStatsBuffer& buffer = rWorkspace.GetBuffer<EngineStatsBuffer>(Workspace::SLOT_STATS);
+	for (EngineStats& stats : buffer.stats)
+		stats = EngineStats();
+}
+
+//-------------------------------------------------------------
+// Workspace
+//-------------------------------------------------------------
+PackageMerge::Workspace::Workspace()
+{}
+
+PackageMerge::Workspace::~Workspace()
+{}
+
+PackageMerge::Workspace::Workspace(Workspace&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+PackageMerge::Workspace& PackageMerge::Workspace::operator=(Workspace&& other) noexcept
+{
+	for (size_t i = 0; i < NUM_BUFFER_SLOT; ++i)
+		m_buffers[i] = std::move(other.m_buffers[i]);
+
+	return *this;
+}
+
+// @brief 保持しているバッファをすべて解放する
+//-------------------------------------------------------------	
+void PackageMerge::Workspace::Release()
+{
+	for (auto& buffer : m_buffers)
+		buffer.reset();
 }
\ No newline at end of file
@@ -1,28 +1,269 @@
-//-------------------------------------------------------------
-//! @brief	pbP[W}[WASY܂
-//! @author	ĩ=ڽè
-//-------------------------------------------------------------
-#pragma once
-
-//-------------------------------------------------------------
-// include
-//-------------------------------------------------------------
-#include <vector>
-
-namespace MyUtility
-{
-namespace PackageMerge
-{
-	//! ȃpbP[W}[WASY
-	std::vector<unsigned> NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
-
-	//! xpbP[W}[WASY
-	std::vector<unsigned>  LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
-
-	//! EpbP[W}[WASY
-	std::vector<unsigned> BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
-
-	//! s\H
-	bool IsImpossibleCoding(size_t numSymbol, size_t codeLengthLimit);
-}
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムまわり
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <vector>
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @class 作業領域
+	// @note  各アルゴリズムが使うバッファを保持し、呼び出しをまたいで容量を使い回す。
+	//        同じ作業領域を複数のスレッドから同時に使わないこと
+	class Workspace
+	{
+	public:
+
+		// @enum バッファの種類 (アルゴリズムごと)
+		enum BufferSlot
+		{
+			SLOT_NATURAL,
+			SLOT_LAZY,
+			SLOT_BOUNDARY,
+			SLOT_DIVIDE_AND_CONQUER,
+			SLOT_COUNTING,
+			SLOT_HYBRID,
+			SLOT_HEURISTIC,
+			SLOT_COMPACT_BOUNDARY,
+			SLOT_CACHE,
+			SLOT_STATS,			//! 統計 (EngineStats)
+
+			NUM_BUFFER_SLOT
+		};
+
+		// @class バッファの基底
+		class Buffer
+		{
+		public:
+			virtual ~Buffer() {}
+		};
+
+		Workspace();
+		~Workspace();
+		Workspace(Workspace&&) noexcept;
+		Workspace& operator=(Workspace&&) noexcept;
+
+		Workspace(const Workspace&)				= delete;
+		Workspace& operator=(const Workspace&)	= delete;
+
+		//! 保持しているバッファをすべて解放する
+		void Release();
+
+		//! バッファを取得 (初回のみ確保する)
+		template<class T>
+		T& GetBuffer(BufferSlot slot)
+		{
+			if (!m_buffers[slot])
+				m_buffers[slot].reset(new T());
+
+			return static_cast<T&>(*m_buffers[slot]);
+		}
+
+	private:
+		std::unique_ptr<Buffer> m_buffers[NUM_BUFFER_SLOT];
+	};
+
+	//! 作業領域を使い回す版のアルゴリズム
+	using EngineFunc = bool(*)(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	// @enum 符号長の求め方 (HybridPM がどの経路を通ったか)
+	enum CodePath
+	{
+		PATH_IMPOSSIBLE,		//! 符号化が不可能なため求めなかった
+		PATH_TRIVIAL,			//! 有効なシンボルが1つ以下
+		PATH_HUFFMAN,			//! 制限のないハフマン符号がそのまま制限符号長に収まった
+		PATH_PACKAGE_MERGE,		//! 収まらなかったためパッケージマージで求めた
+	};
+
+	// @enum 符号長を求めた結果 (例外を送出しない版の戻り値)
+	enum Status
+	{
+		STATUS_SUCCESS,				//! 求められた
+		STATUS_IMPOSSIBLE_CODING,	//! 符号化が不可能 (シンボル数が 2^制限符号長 を超える)
+		STATUS_CAPACITY_EXCEEDED,	//! パッケージの重みやノードの添字が 数えられる範囲を超える
+	};
+
+	//! 例外を送出しない版のアルゴリズム
+	using StatusEngineFunc = Status(*)(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 純粋なパッケージマージアルゴリズム
+	std::vector<unsigned> NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 純粋なパッケージマージアルゴリズム (ステージをスレッドに割り振ってパイプライン化した版。スレッド数はハードウェアのスレッド数)
+	std::vector<unsigned> PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 遅延パッケージマージアルゴリズム
+	std::vector<unsigned>  LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 境界パッケージマージアルゴリズム
+	std::vector<unsigned> BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 境界パッケージマージアルゴリズム (ノードを 32bit の添字でつないだ配列に分け、ステージの再帰をループにした版)
+	std::vector<unsigned> CompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 分割統治パッケージマージアルゴリズム (作業領域が L にほとんど依存しない)
+	std::vector<unsigned> DivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! 計数パッケージマージアルゴリズム (子の参照を持たず、ステージごとのパッケージ数だけを記録する)
+	std::vector<unsigned> CountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! ハフマン符号を先に試し、制限符号長に収まらないときだけ境界パッケージマージを使う
+	std::vector<unsigned> HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	//! ハフマン符号の長すぎる符号長を切り詰め、Kraft の不等式を満たすまで配り直す経験的な方法 (最適とは限らない)
+	std::vector<unsigned> HeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+
+	// note:
+	// 以下は作業領域を使い回し、結果を呼び出し側の領域 (arraySize 要素) に書き込む版。
+	// 作業領域が温まった後はヒープ確保を行わない。
+	// 符号化が不可能な場合は false を返す (pBitLengths の内容は不定)
+
+	//! 純粋なパッケージマージアルゴリズム
+	bool NaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 純粋なパッケージマージアルゴリズム (ステージをスレッドに割り振ってパイプライン化した版)
+	bool PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 遅延パッケージマージアルゴリズム
+	bool LazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 境界パッケージマージアルゴリズム
+	bool BoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 境界パッケージマージアルゴリズム (ノードを 32bit の添字でつないだ配列に分け、ステージの再帰をループにした版)
+	bool CompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 分割統治パッケージマージアルゴリズム
+	bool DivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 計数パッケージマージアルゴリズム
+	bool CountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! ハフマン符号を先に試し、制限符号長に収まらないときだけ境界パッケージマージを使う
+	bool HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! ハフマン符号の長すぎる符号長を切り詰め、Kraft の不等式を満たすまで配り直す経験的な方法 (最適とは限らない)
+	bool HeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	// note:
+	// NaturalPM と BoundaryPM は 16bit / 64bit の重みも受け付ける。
+	// パッケージの重みは 重みの合計 × 制限符号長 を超えないため、これが 32bit に収まる間は (32bit の重みを含めて) 32bit で数え、
+	// 収まらなければ 64bit で数える。64bit にも収まらない場合は false を返す
+
+	//! 純粋なパッケージマージアルゴリズム (16bit / 64bit の重み)
+	std::vector<unsigned> NaturalPM(const unsigned short*	   symbolWeights, size_t arraySize, size_t codeLengthLimit);
+	std::vector<unsigned> NaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+	bool NaturalPM(const unsigned short*	  symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+	bool NaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 境界パッケージマージアルゴリズム (16bit / 64bit の重み)
+	std::vector<unsigned> BoundaryPM(const unsigned short*	    symbolWeights, size_t arraySize, size_t codeLengthLimit);
+	std::vector<unsigned> BoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit);
+	bool BoundaryPM(const unsigned short*	   symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+	bool BoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+	//! 純粋なパッケージマージアルゴリズム (ステージをスレッドに割り振ってパイプライン化した版)
+	//! @param numThread 使うスレッド数 (呼び出し元のスレッドを含む)。0 ならハードウェアのスレッド数
+	//! @note  呼び出しのたびにスレッドを立てる。シンボルが少ない場合やスレッドが 1つの場合は NaturalPM と同じく順に求める
+	bool PipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths, size_t numThread);
+
+	//! ハフマン符号を先に試し、制限符号長に収まらないときだけ fallback を使う
+	//! @param pPath 通った経路の出力先 (不要なら nullptr)
+	bool HybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths,
+				  EngineFunc fallback, CodePath* pPath);
+
+	// note:
+	// 以下は例外を送出しない版 (-fno-exceptions でビルドする呼び出し側向け)。結果の書き込み先は作業領域を使い回す版と同じ。
+	// 失敗は Status で返し、アルゴリズム内部の不変条件はデバッグビルドの assert でのみ確かめる。
+	// 作業領域やスレッドを用意できない場合は std::terminate() になるため、作業領域は先に同じ程度の入力で温めておくこと
+	// (LazyPM は見積もりを超えたノードを足すことがあり、PipelinedNaturalPM は呼び出しのたびにスレッドを立てる)
+
+	//! 純粋なパッケージマージアルゴリズム
+	Status TryNaturalPM(const unsigned*			  symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+	Status TryNaturalPM(const unsigned short*	  symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+	Status TryNaturalPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 純粋なパッケージマージアルゴリズム (ステージをスレッドに割り振ってパイプライン化した版)
+	Status TryPipelinedNaturalPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 遅延パッケージマージアルゴリズム
+	Status TryLazyPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 境界パッケージマージアルゴリズム
+	Status TryBoundaryPM(const unsigned*			   symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+	Status TryBoundaryPM(const unsigned short*	   symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+	Status TryBoundaryPM(const unsigned long long* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 境界パッケージマージアルゴリズム (ノードを 32bit の添字でつないだ配列に分け、ステージの再帰をループにした版)
+	Status TryCompactBoundaryPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 分割統治パッケージマージアルゴリズム
+	Status TryDivideAndConquerPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! 計数パッケージマージアルゴリズム
+	Status TryCountingPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! ハフマン符号を先に試し、制限符号長に収まらないときだけ境界パッケージマージを使う
+	Status TryHybridPM(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	//! ハフマン符号の長すぎる符号長を切り詰め、Kraft の不等式を満たすまで配り直す経験的な方法 (最適とは限らない)
+	Status TryHeuristicLimit(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept;
+
+	// @struct 境界パッケージマージのノードプール統計 (直近の呼び出し分)
+	struct BoundaryPMPoolStats
+	{
+		size_t	capacity	= 0;	//! プールの容量
+		size_t	borrowCount	= 0;	//! 貸し出したノードの総数
+		size_t	peakInUse	= 0;	//! 同時に貸し出していたノード数の最大
+		size_t	sweepCount	= 0;	//! プール全体を走査して回収した回数 (参照カウントで回収するため常にゼロ)
+	};
+
+	//! 境界パッケージマージのノードプール統計を取得
+	BoundaryPMPoolStats GetBoundaryPMPoolStats(Workspace& rWorkspace);
+
+	// @struct アルゴリズムの統計 (作業領域ごとに、呼び出しをまたいで積算する)
+	// @note  ライブラリを MYUTILITY_PACKAGE_MERGE_STATS=1 でビルドした場合のみ記録し、それ以外では常にゼロ。
+	//        各アルゴリズムは自身のバッファの種類 (Workspace::BufferSlot) の欄に記録する。
+	//        スレッドごとの作業領域の値は Merge() でまとめられる
+	struct EngineStats
+	{
+		unsigned long long	callCount		  = 0;		//! 呼び出し回数
+		unsigned long long	nodeCount		  = 0;		//! 作ったノードの数
+		unsigned long long	sweepCount		  = 0;		//! プール全体を走査して空きを探した回数 (BoundaryPM)
+		unsigned long long	releaseCount	  = 0;		//! 返却したノードの数 (LazyPM は ReleaseRecursive() でたどった数)
+		unsigned long long	overflowCount	  = 0;		//! プールの見積もりを超えて足したノードの数 (LazyPM)
+		size_t				maxRecursionDepth = 0;		//! 先読みの再構築で再帰したステージ数の最大
+		size_t				peakPoolInUse	  = 0;		//! プールの同時使用数の最大
+		size_t				peakPoolCapacity  = 0;		//! プールの容量の最大 (BoundaryPM は L(L+1)、LazyPM は n・L)
+		double				peakPoolUsage	  = 0.0;	//! 1回の呼び出しでの 同時使用数 / 容量 の最大
+		unsigned long long	sortNs			  = 0;		//! シンボルの並べ替えにかかった時間
+		unsigned long long	mainLoopNs		  = 0;		//! 並べ替え以降にかかった時間
+
+		//! 別の統計を加える (回数・時間は合計、最大値は最大)
+		void Merge(const EngineStats& other);
+	};
+
+	//! 統計を記録するビルドか
+	bool IsEngineStatsEnabled();
+
+	//! アルゴリズムの統計を取得
+	const EngineStats& GetEngineStats(Workspace& rWorkspace, Workspace::BufferSlot slot);
+
+	//! 統計をすべてゼロに戻す
+	void ResetEngineStats(Workspace& rWorkspace);
+
+	//! 符号化が不可能？
+	bool IsImpossibleCoding(size_t numSymbol, size_t codeLengthLimit) noexcept;
+
+	//! 符号化後の総ビット数 (Σ 重み × 符号長)。最適な符号長と比べれば経験的な方法の損失が分かる
+	unsigned long long CalculateTotalBits(const unsigned* symbolWeights, const unsigned* pBitLengths, size_t arraySize);
+}
 }// end namespace
\ No newline at end of file
@@ -0,0 +1,357 @@
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムの一括計算
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeBatch.h"
+#include "PackageMergeCache.h"
+#include <algorithm>	// std::max
+#include <atomic>
+#include <condition_variable>
+#include <exception>	// std::exception_ptr
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::PackageMerge;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// 1件あたりの処理量は おおよそ 重み表の要素数 × 制限符号長 に比例する。
+	// 小さなジョブを1件ずつ受け渡すと同期のコストが勝つため、
+	// この量を目安にジョブをまとめた「塊」を受け渡しの単位にする
+	constexpr unsigned long long MIN_CHUNK_COST	  = 1 << 14;
+	constexpr size_t			 CHUNKS_PER_THREAD = 8;
+
+	// @struct ジョブの塊 [begin, end)
+	struct JobRange
+	{
+		size_t begin = 0;
+		size_t end   = 0;
+	};
+
+	// @struct スレッドごとの作業キュー
+	// @note   持ち主は末尾から取り出し、他のスレッドは先頭から盗む
+	struct WorkQueue
+	{
+		std::mutex				mutex;
+		std::vector<JobRange>	ranges;
+		size_t					head = 0;
+
+		// @brief 持ち主による取り出し
+		//-------------------------------------------------------------
+		bool Pop(JobRange& /*out*/range)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (head >= ranges.size())
+				return false;
+
+			range = ranges.back();
+			ranges.pop_back();
+			return true;
+		}
+
+		// @brief 他のスレッドによる取り出し
+		//-------------------------------------------------------------
+		bool Steal(JobRange& /*out*/range)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (head >= ranges.size())
+				return false;
+
+			range = ranges[head++];
+			return true;
+		}
+	};
+
+	// @brief 1件のジョブの処理量の目安
+	//-------------------------------------------------------------
+	unsigned long long EstimateCost(const BatchJob& job)
+	{
+		return static_cast<unsigned long long>(std::max<size_t>(job.arraySize, 1)) * std::max<size_t>(job.codeLengthLimit, 1);
+	}
+}
+
+//-------------------------------------------------------------
+// BatchExecutor::Impl
+//-------------------------------------------------------------
+struct BatchExecutor::Impl
+{
+	std::vector<std::thread>				threads;
+	std::vector<std::unique_ptr<WorkQueue>>	queues;		//! スレッドごと (0 は呼び出し元)
+	std::vector<Workspace>					workspaces;	//! スレッドごと
+
+	std::mutex								mutex;
+	std::condition_variable					wakeup;
+	std::condition_variable					finished;
+	unsigned long long						generation	 = 0;	//! Run() のたびに進める
+	size_t									busyWorkers	 = 0;
+	bool									quit		 = false;
+
+	// 実行中の Run() の内容
+	BatchJob*								pJobs		 = nullptr;
+	EngineFunc								engine		 = nullptr;
+	CodeLengthCache*						pCache		 = nullptr;	//! nullptr 以外ならキャッシュを通す
+	std::mutex								errorMutex;
+	std::exception_ptr						error;
+	std::mutex								runMutex;	//! Run() の同時呼び出しを防ぐ
+	std::vector<JobRange>					chunks;		//! 配布前の塊 (Run() をまたいで使い回す)
+
+	// @brief 塊をひとつ処理する
+	//-------------------------------------------------------------
+	void ProcessRange(const JobRange& range, Workspace& rWorkspace)
+	{
+		for (size_t i = range.begin; i < range.end; ++i)
+		{
+			BatchJob& job = pJobs[i];
+			try
+			{
+				if (pCache)
+					job.succeeded = pCache->Compute(job.symbolWeights, job.arraySize, job.codeLengthLimit, rWorkspace, job.pBitLengths);
+				else
+					job.succeeded = engine(job.symbolWeights, job.arraySize, job.codeLengthLimit, rWorkspace, job.pBitLengths);
+			}
+			catch (...)
+			{
+				job.succeeded = false;
+
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+	}
+
+	// @brief 自分のキューを処理し、空になったら他から盗む
+	//-------------------------------------------------------------
+	void ProcessQueues(size_t workerIdx)
+	{
+		Workspace& rWorkspace = workspaces[workerIdx];
+		JobRange   range;
+		for (;;)
+		{
+			if (queues[workerIdx]->Pop(range))
+			{
+				ProcessRange(range, rWorkspace);
+				continue;
+			}
+
+			// note: Run() の途中で塊が増えることはないため、全キューが空なら終わり
+			bool stolen = false;
+			for (size_t i = 1; i < queues.size() && !stolen; ++i)
+				stolen = queues[(workerIdx + i) % queues.size()]->Steal(range);
+
+			if (!stolen)
+				return;
+
+			ProcessRange(range, rWorkspace);
+		}
+	}
+
+	// @brief ワーカースレッド本体
+	//-------------------------------------------------------------
+	void WorkerMain(size_t workerIdx)
+	{
+		unsigned long long seenGeneration = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeup.wait(lock, [&] { return quit || generation != seenGeneration; });
+				if (quit)
+					return;
+
+				seenGeneration = generation;
+			}
+			ProcessQueues(workerIdx);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busyWorkers == 0)
+					finished.notify_all();
+			}
+		}
+	}
+
+	// @brief ジョブを塊に分けて各キューに配る
+	//-------------------------------------------------------------
+	void Distribute(size_t numJob)
+	{
+		unsigned long long totalCost = 0;
+		for (size_t i = 0; i < numJob; ++i)
+			totalCost += EstimateCost(pJobs[i]);
+
+		unsigned long long chunkCost = std::max(MIN_CHUNK_COST, totalCost / (queues.size() * CHUNKS_PER_THREAD));
+
+		// 連続したジョブは同じスレッドに配る (入出力の局所性のため)
+		chunks.clear();
+		JobRange			  current;
+		unsigned long long	  currentCost = 0;
+		for (size_t i = 0; i < numJob; ++i)
+		{
+			currentCost += EstimateCost(pJobs[i]);
+			current.end  = i + 1;
+			if (currentCost >= chunkCost)
+			{
+				chunks.push_back(current);
+				current.begin = current.end;
+				currentCost   = 0;
+			}
+		}
+		if (current.begin < current.end)
+			chunks.push_back(current);
+
+		for (size_t q = 0; q < queues.size(); ++q)
+		{
+			WorkQueue& queue = *queues[q];
+			queue.ranges.clear();
+			queue.head = 0;
+
+			// note: 持ち主は末尾から取り出すため、逆順に積んで先頭の塊から処理させる
+			size_t begin = chunks.size() * q / queues.size();
+			size_t end   = chunks.size() * (q + 1) / queues.size();
+			for (size_t c = end; c > begin; --c)
+				queue.ranges.push_back(chunks[c - 1]);
+		}
+	}
+
+	// @brief ジョブを配り、ワーカーと一緒に処理し終えるまで待つ
+	//-------------------------------------------------------------
+	void Execute(size_t numJob)
+	{
+		Distribute(numJob);
+
+		// ワーカーを起こし、自分も処理に加わる
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers = threads.size();
+			generation += 1;
+		}
+		wakeup.notify_all();
+		ProcessQueues(0);
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [&] { return busyWorkers == 0; });
+		}
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief コンストラクタ
+//-------------------------------------------------------------
+BatchExecutor::BatchExecutor(size_t numThread)
+	: m_pImpl(new Impl())
+{
+	if (numThread == 0)
+		numThread = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+	m_pImpl->workspaces.resize(numThread);
+	for (size_t i = 0; i < numThread; ++i)
+		m_pImpl->queues.emplace_back(new WorkQueue());
+
+	// note: 0 番は Run() を呼んだスレッド自身が担当する
+	for (size_t i = 1; i < numThread; ++i)
+		m_pImpl->threads.emplace_back(&Impl::WorkerMain, m_pImpl.get(), i);
+}
+
+// @brief デストラクタ
+//-------------------------------------------------------------
+BatchExecutor::~BatchExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_pImpl->mutex);
+		m_pImpl->quit = true;
+	}
+	m_pImpl->wakeup.notify_all();
+
+	for (std::thread& thread : m_pImpl->threads)
+		thread.join();
+}
+
+// @brief スレッド数
+//-------------------------------------------------------------
+size_t BatchExecutor::GetThreadCount() const
+{
+	return m_pImpl->queues.size();
+}
+
+// @brief すべてのジョブを処理する
+//-------------------------------------------------------------
+void BatchExecutor::Run(BatchJob* pJobs, size_t numJob, EngineFunc engine)
+{
+	if (numJob == 0)
+		return;
+
+	Impl& impl = *m_pImpl;
+	std::lock_guard<std::mutex> runLock(impl.runMutex);
+
+	impl.pJobs  = pJobs;
+	impl.engine = engine;
+	impl.pCache = nullptr;
+	impl.error  = nullptr;
+	impl.Execute(numJob);
+}
+
+// @brief キャッシュを通してすべてのジョブを処理する
+//-------------------------------------------------------------
+void BatchExecutor::Run(BatchJob* pJobs, size_t numJob, CodeLengthCache& rCache)
+{
+	if (numJob == 0)
+		return;
+
+	Impl& impl = *m_pImpl;
+	std::lock_guard<std::mutex> runLock(impl.runMutex);
+
+	impl.pJobs  = pJobs;
+	impl.engine = rCache.GetEngine();
+	impl.pCache = &rCache;
+	impl.error  = nullptr;
+	impl.Execute(numJob);
+}
+
+// @brief 全スレッドの作業領域の統計をまとめて取得
+//-------------------------------------------------------------
+EngineStats BatchExecutor::GetEngineStats(Workspace::BufferSlot slot)
+{
+	std::lock_guard<std::mutex> runLock(m_pImpl->runMutex);
+
+	EngineStats stats;
+	for (Workspace& rWorkspace : m_pImpl->workspaces)
+		stats.Merge(PackageMerge::GetEngineStats(rWorkspace, slot));
+
+	return stats;
+}
+
+// @brief 全スレッドの作業領域の統計をゼロに戻す
+//-------------------------------------------------------------
+void BatchExecutor::ResetEngineStats()
+{
+	std::lock_guard<std::mutex> runLock(m_pImpl->runMutex);
+
+	for (Workspace& rWorkspace : m_pImpl->workspaces)
+		PackageMerge::ResetEngineStats(rWorkspace);
+}
+
+// @brief 一括計算 (簡易版)
+//-------------------------------------------------------------
+void PackageMerge::BatchPM(BatchJob* pJobs, size_t numJob, size_t numThread, EngineFunc engine)
+{
+	BatchExecutor executor(numThread);
+	executor.Run(pJobs, numJob, engine);
+}
@@ -0,0 +1,68 @@
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムの一括計算
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	class CodeLengthCache;
+
+	// @struct 一括計算の1件分
+	struct BatchJob
+	{
+		const unsigned*	symbolWeights	= nullptr;	//! 重み表
+		size_t			arraySize		= 0;		//! 重み表の要素数
+		size_t			codeLengthLimit	= 0;		//! 制限符号長
+		unsigned*		pBitLengths		= nullptr;	//! 出力先 (arraySize 要素)
+		bool			succeeded		= false;	//! 出力: 符号化できたか
+	};
+
+	// @class 一括計算の実行器
+	// @note  スレッドごとに作業領域を持ち、ジョブの塊をスレッド間で盗み合って (work stealing) 処理する。
+	//        スレッドと作業領域は Run() をまたいで使い回す
+	class BatchExecutor
+	{
+	public:
+
+		//! @param numThread 使うスレッド数 (呼び出し元のスレッドを含む)。0 ならハードウェアのスレッド数
+		explicit BatchExecutor(size_t numThread = 0);
+		~BatchExecutor();
+
+		BatchExecutor(const BatchExecutor&)				= delete;
+		BatchExecutor& operator=(const BatchExecutor&)	= delete;
+
+		//! スレッド数
+		size_t GetThreadCount() const;
+
+		//! すべてのジョブを処理し終えるまで待つ
+		//! @note 途中でアルゴリズムが例外を投げた場合は、全ジョブの終了後に最初の例外を投げ直す
+		void Run(BatchJob* pJobs, size_t numJob, EngineFunc engine = BoundaryPM);
+
+		//! キャッシュを通してすべてのジョブを処理し終えるまで待つ (キャッシュにない場合はキャッシュのアルゴリズムを使う)
+		void Run(BatchJob* pJobs, size_t numJob, CodeLengthCache& rCache);
+
+		//! 全スレッドの作業領域の統計をまとめて取得 (Run() の実行中は終わるまで待つ)
+		EngineStats GetEngineStats(Workspace::BufferSlot slot);
+
+		//! 全スレッドの作業領域の統計をゼロに戻す (Run() の実行中は終わるまで待つ)
+		void ResetEngineStats();
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pImpl;
+	};
+
+	//! 一括計算 (その場でスレッドを用意する簡易版)
+	void BatchPM(BatchJob* pJobs, size_t numJob, size_t numThread = 0, EngineFunc engine = BoundaryPM);
+}
+}// end namespace
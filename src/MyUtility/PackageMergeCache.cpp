@@ -0,0 +1,372 @@
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムの結果キャッシュ
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeCache.h"
+#include "SymbolExtraction.h"
+#include <algorithm>	// std::fill, std::max
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using namespace MyUtility::PackageMerge;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+//
+// note:
+// キーは CompactSymbolKeys() で作る (重み << 32 | シンボル識別子) の列で、シンボル識別子の昇順に並ぶ。
+// 重みのないシンボルはキーに含まれないため、疎な重み表でも保存量は重みのあるシンボルの数に比例する。
+// 符号長も同じ並びで 1byte ずつ保存し、返すときに重み表の並びに散らす。
+// ハッシュ値が一致しても中身まで比べるため、衝突しても誤った結果は返さない。
+//
+namespace
+{
+	// 1件あたりの管理情報の概算 (エントリ本体 + 索引)
+	constexpr size_t ENTRY_OVERHEAD = 96;
+
+	// 符号長を 1byte で保存できる上限
+	constexpr unsigned MAX_STORED_BIT_LENGTH = 0xFF;
+
+	// using
+	using KeyList = std::vector<unsigned long long>;
+
+	// @struct 作業バッファ
+	struct CacheBuffer : public Workspace::Buffer
+	{
+		KeyList	keys;
+	};
+
+	// @struct 保存した結果
+	struct CacheEntry
+	{
+		unsigned long long			hash			= 0;
+		size_t						arraySize		= 0;
+		size_t						codeLengthLimit	= 0;
+		KeyList						keys;					//! 重みのあるシンボル (シンボル識別子の昇順)
+		std::vector<unsigned char>	bitLengths;				//! keys と同じ並びの符号長
+		size_t						bytes			= 0;	//! 使用量の概算
+		bool						succeeded		= false;
+		bool						referenced		= false;	//! CLOCK の参照ビット
+		bool						used			= false;
+	};
+
+	// @struct シャード
+	// @note   ロックの取り合いで隣のシャードと同じキャッシュラインを共有しないように揃える
+	struct alignas(64) CacheShard
+	{
+		std::mutex										mutex;
+		std::unordered_map<unsigned long long, size_t>	index;		//! ハッシュ値 → エントリ
+		std::vector<CacheEntry>							entries;
+		std::vector<size_t>								freeSlots;
+		size_t											hand		= 0;	//! CLOCK の針
+		size_t											usedBytes	= 0;
+		unsigned long long								hitCount	= 0;
+		unsigned long long								missCount	= 0;
+		unsigned long long								insertCount	= 0;
+		unsigned long long								evictCount	= 0;
+	};
+
+	// @brief 64bit の値をかき混ぜる
+	//-------------------------------------------------------------
+	inline unsigned long long MixHash(unsigned long long h)
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// @brief ハッシュ値に1要素を加える
+	//-------------------------------------------------------------
+	inline unsigned long long CombineHash(unsigned long long h, unsigned long long key)
+	{
+		h = (h ^ key) * 0x9E3779B97F4A7C15ull;
+		return (h << 31) | (h >> 33);
+	}
+
+	// @brief キー列のハッシュ値
+	// @note  乗算の待ち時間を隠すため、4つの系列に分けて計算してから混ぜる
+	//-------------------------------------------------------------
+	unsigned long long HashKeys(const KeyList& keys, size_t arraySize, size_t codeLengthLimit)
+	{
+		unsigned long long h0 = MixHash(static_cast<unsigned long long>(arraySize) * 0x9E3779B97F4A7C15ull ^ codeLengthLimit);
+		unsigned long long h1 = h0 ^ 0x2545F4914F6CDD1Dull;
+		unsigned long long h2 = h0 ^ 0x6A09E667F3BCC908ull;
+		unsigned long long h3 = h0 ^ 0xBB67AE8584CAA73Bull;
+
+		const size_t numKey = keys.size();
+		size_t i = 0;
+		for (; i + 4 <= numKey; i += 4)
+		{
+			h0 = CombineHash(h0, keys[i + 0]);
+			h1 = CombineHash(h1, keys[i + 1]);
+			h2 = CombineHash(h2, keys[i + 2]);
+			h3 = CombineHash(h3, keys[i + 3]);
+		}
+		for (; i < numKey; ++i)
+			h0 = CombineHash(h0, keys[i]);
+
+		h0 = CombineHash(h0, MixHash(h1));
+		h0 = CombineHash(h0, MixHash(h2));
+		h0 = CombineHash(h0, MixHash(h3));
+		return MixHash(h0 ^ numKey);
+	}
+
+	// @brief エントリを捨てる
+	//-------------------------------------------------------------
+	void EvictEntry(CacheShard& shard, size_t slot)
+	{
+		CacheEntry& entry = shard.entries[slot];
+		shard.index.erase(entry.hash);
+		shard.usedBytes -= entry.bytes;
+		shard.freeSlots.push_back(slot);
+		shard.evictCount += 1;
+
+		// note: 容量を正しく見積もるため、確保済みの領域も返す
+		KeyList().swap(entry.keys);
+		std::vector<unsigned char>().swap(entry.bitLengths);
+		entry.used = false;
+	}
+
+	// @brief CLOCK 方式で、needBytes を追加できるまで捨てる
+	//-------------------------------------------------------------
+	void MakeRoom(CacheShard& shard, size_t needBytes, size_t capacityBytes)
+	{
+		while (shard.usedBytes + needBytes > capacityBytes && !shard.index.empty())
+		{
+			if (shard.hand >= shard.entries.size())
+				shard.hand = 0;
+
+			CacheEntry& entry = shard.entries[shard.hand];
+			if (entry.used)
+			{
+				// 最近参照されたものは一周だけ見逃す
+				if (entry.referenced)
+					entry.referenced = false;
+				else
+					EvictEntry(shard, shard.hand);
+			}
+			++shard.hand;
+		}
+	}
+}
+
+//-------------------------------------------------------------
+// Impl
+//-------------------------------------------------------------
+struct CodeLengthCache::Impl
+{
+	EngineFunc								engine		  = nullptr;
+	size_t									shardCapacity = 0;	//! シャードごとの使用量の上限
+	unsigned								shardShift	  = 64;	//! ハッシュ値の上位ビットでシャードを選ぶ
+	std::vector<std::unique_ptr<CacheShard>>	shards;
+
+	// @brief ハッシュ値に対応するシャード
+	//-------------------------------------------------------------
+	CacheShard& GetShard(unsigned long long hash)
+	{
+		return *shards[(shardShift >= 64) ? 0 : static_cast<size_t>(hash >> shardShift)];
+	}
+
+	// @brief 保存済みの結果を探す
+	// @return 見つかったか
+	//-------------------------------------------------------------
+	bool Find(CacheShard& shard, unsigned long long hash, const KeyList& keys, size_t arraySize, size_t codeLengthLimit,
+			  unsigned* pBitLengths, bool& /*out*/succeeded)
+	{
+		auto it = shard.index.find(hash);
+		if (it == shard.index.end())
+			return false;
+
+		CacheEntry& entry = shard.entries[it->second];
+		if (entry.arraySize != arraySize || entry.codeLengthLimit != codeLengthLimit || entry.keys != keys)
+			return false;
+
+		entry.referenced = true;
+		succeeded		 = entry.succeeded;
+		if (succeeded)
+		{
+			std::fill(pBitLengths, pBitLengths + arraySize, 0u);
+			for (size_t i = 0; i < keys.size(); ++i)
+				pBitLengths[static_cast<unsigned>(keys[i])] = entry.bitLengths[i];
+		}
+		return true;
+	}
+
+	// @brief 結果を保存する
+	//-------------------------------------------------------------
+	void Insert(CacheShard& shard, unsigned long long hash, const KeyList& keys, size_t arraySize, size_t codeLengthLimit,
+				const unsigned* pBitLengths, bool succeeded)
+	{
+		size_t bytes = ENTRY_OVERHEAD + keys.size() * (sizeof(unsigned long long) + 1);
+		if (bytes > shardCapacity)
+			return;
+
+		// 符号長が 1byte に収まらない場合は保存しない
+		if (succeeded)
+		{
+			for (unsigned long long key : keys)
+			{
+				if (pBitLengths[static_cast<unsigned>(key)] > MAX_STORED_BIT_LENGTH)
+					return;
+			}
+		}
+
+		// 同じハッシュ値のもの (他のスレッドが先に保存したもの、または衝突したもの) は置き換える
+		auto it = shard.index.find(hash);
+		if (it != shard.index.end())
+			EvictEntry(shard, it->second);
+
+		MakeRoom(shard, bytes, shardCapacity);
+
+		size_t slot = shard.entries.size();
+		if (!shard.freeSlots.empty())
+		{
+			slot = shard.freeSlots.back();
+			shard.freeSlots.pop_back();
+		}
+		else
+		{
+			shard.entries.emplace_back();
+		}
+
+		CacheEntry& entry	 = shard.entries[slot];
+		entry.hash			 = hash;
+		entry.arraySize		 = arraySize;
+		entry.codeLengthLimit = codeLengthLimit;
+		entry.keys			 = keys;
+		entry.bitLengths.clear();
+		if (succeeded)
+		{
+			entry.bitLengths.reserve(keys.size());
+			for (unsigned long long key : keys)
+				entry.bitLengths.push_back(static_cast<unsigned char>(pBitLengths[static_cast<unsigned>(key)]));
+		}
+		entry.bytes		 = bytes;
+		entry.succeeded	 = succeeded;
+		entry.referenced = false;
+		entry.used		 = true;
+
+		shard.index[hash] = slot;
+		shard.usedBytes	 += bytes;
+		shard.insertCount += 1;
+	}
+};
+
+//-------------------------------------------------------------
+// CodeLengthCache
+//-------------------------------------------------------------
+
+// @brief コンストラクタ
+//-------------------------------------------------------------
+CodeLengthCache::CodeLengthCache(EngineFunc engine, size_t capacityBytes, size_t numShard)
+	: m_pImpl(new Impl())
+{
+	if (numShard == 0)
+		numShard = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+
+	// 2 の累乗に切り上げる
+	unsigned shardBits = 0;
+	while ((static_cast<size_t>(1) << shardBits) < numShard)
+		++shardBits;
+	numShard = static_cast<size_t>(1) << shardBits;
+
+	m_pImpl->engine		   = engine;
+	m_pImpl->shardCapacity = capacityBytes / numShard;
+	m_pImpl->shardShift	   = 64 - shardBits;
+	for (size_t i = 0; i < numShard; ++i)
+		m_pImpl->shards.emplace_back(new CacheShard());
+}
+
+// @brief デストラクタ
+//-------------------------------------------------------------
+CodeLengthCache::~CodeLengthCache()
+{}
+
+// @brief 符号長を求める
+//-------------------------------------------------------------
+bool CodeLengthCache::Compute(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+{
+	Impl&		 impl	= *m_pImpl;
+	CacheBuffer& buffer = rWorkspace.GetBuffer<CacheBuffer>(Workspace::SLOT_CACHE);
+
+	CompactSymbolKeys(symbolWeights, arraySize, /*out*/buffer.keys);
+	unsigned long long hash	 = HashKeys(buffer.keys, arraySize, codeLengthLimit);
+	CacheShard&		   shard = impl.GetShard(hash);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		bool succeeded = false;
+		if (impl.Find(shard, hash, buffer.keys, arraySize, codeLengthLimit, pBitLengths, /*out*/succeeded))
+		{
+			shard.hitCount += 1;
+			return succeeded;
+		}
+		shard.missCount += 1;
+	}
+
+	// note: 計算中はロックを持たない (同じ内容を同時に計算した場合は後から保存したほうが残る)
+	bool succeeded = impl.engine(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		impl.Insert(shard, hash, buffer.keys, arraySize, codeLengthLimit, pBitLengths, succeeded);
+	}
+	return succeeded;
+}
+
+// @brief キャッシュにない場合に使うアルゴリズム
+//-------------------------------------------------------------
+EngineFunc CodeLengthCache::GetEngine() const
+{
+	return m_pImpl->engine;
+}
+
+// @brief 統計
+//-------------------------------------------------------------
+CacheStats CodeLengthCache::GetStats() const
+{
+	CacheStats stats;
+	for (const std::unique_ptr<CacheShard>& pShard : m_pImpl->shards)
+	{
+		std::lock_guard<std::mutex> lock(pShard->mutex);
+		stats.hitCount	  += pShard->hitCount;
+		stats.missCount	  += pShard->missCount;
+		stats.insertCount += pShard->insertCount;
+		stats.evictCount  += pShard->evictCount;
+		stats.numEntry	  += pShard->index.size();
+		stats.usedBytes	  += pShard->usedBytes;
+	}
+	return stats;
+}
+
+// @brief 保存している結果と統計をすべて捨てる
+//-------------------------------------------------------------
+void CodeLengthCache::Clear()
+{
+	for (std::unique_ptr<CacheShard>& pShard : m_pImpl->shards)
+	{
+		std::lock_guard<std::mutex> lock(pShard->mutex);
+		pShard->index.clear();
+		std::vector<CacheEntry>().swap(pShard->entries);
+		pShard->freeSlots.clear();
+		pShard->hand		= 0;
+		pShard->usedBytes	= 0;
+		pShard->hitCount	= 0;
+		pShard->missCount	= 0;
+		pShard->insertCount	= 0;
+		pShard->evictCount	= 0;
+	}
+}
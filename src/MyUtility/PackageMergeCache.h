@@ -0,0 +1,65 @@
+//-------------------------------------------------------------
+//! @brief	パッケージマージアルゴリズムの結果キャッシュ
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <memory>	// std::unique_ptr
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @struct キャッシュの統計
+	struct CacheStats
+	{
+		unsigned long long	hitCount		= 0;	//! 保存済みの結果を返した回数
+		unsigned long long	missCount		= 0;	//! アルゴリズムを実行した回数
+		unsigned long long	insertCount		= 0;	//! 結果を保存した回数
+		unsigned long long	evictCount		= 0;	//! 容量を空けるために捨てた回数
+		size_t				numEntry		= 0;	//! 保存している結果の数
+		size_t				usedBytes		= 0;	//! 保存している結果の使用量の概算
+	};
+
+	// @class 符号長の計算結果のキャッシュ
+	// @note  (重みのあるシンボルとその重み, 重み表の要素数, 制限符号長) が一致すれば、保存済みの符号長を返す。
+	//        ハッシュ値でシャードに分け、シャードごとのロックで排他する。
+	//        容量を超えたらシャードごとに CLOCK 方式で捨てる。
+	//        複数のスレッドから同時に使ってよい (作業領域はスレッドごとに用意すること)
+	class CodeLengthCache
+	{
+	public:
+
+		//! @param engine        キャッシュにない場合に使うアルゴリズム
+		//! @param capacityBytes 保存する結果の使用量の上限 (シャードごとに等分する)
+		//! @param numShard      シャードの数 (2 の累乗に切り上げる)。0 ならハードウェアのスレッド数の 4 倍
+		explicit CodeLengthCache(EngineFunc engine = BoundaryPM, size_t capacityBytes = 16 << 20, size_t numShard = 0);
+		~CodeLengthCache();
+
+		CodeLengthCache(const CodeLengthCache&)				= delete;
+		CodeLengthCache& operator=(const CodeLengthCache&)	= delete;
+
+		//! 符号長を求める (キャッシュになければアルゴリズムを実行して保存する)
+		//! @return 符号化が不可能なら false
+		bool Compute(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths);
+
+		//! キャッシュにない場合に使うアルゴリズム
+		EngineFunc GetEngine() const;
+
+		//! 統計
+		CacheStats GetStats() const;
+
+		//! 保存している結果と統計をすべて捨てる
+		void Clear();
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pImpl;
+	};
+}
+}// end namespace
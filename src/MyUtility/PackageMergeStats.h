@@ -0,0 +1,129 @@
+//-------------------------------------------------------------
+//! @brief	アルゴリズムの統計の記録 (各アルゴリズム共通)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <algorithm>	// std::max
+#include <chrono>
+#include <cstddef>	// size_t
+
+// note:
+// 1 にすると各アルゴリズムが EngineStats を記録する。
+// 0 (既定) の場合、以下の記録用の関数はすべて空になり、呼び出し側の計測ごと消える
+#ifndef MYUTILITY_PACKAGE_MERGE_STATS
+#define MYUTILITY_PACKAGE_MERGE_STATS 0
+#endif
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @struct 統計の置き場 (バッファの種類ごと)
+	struct EngineStatsBuffer : public Workspace::Buffer
+	{
+		EngineStats stats[Workspace::NUM_BUFFER_SLOT];
+	};
+
+	// @struct 呼び出し1回分の計測
+	// @note  ノードプールに持たせ、プールを受け取る関数から記録する
+	struct EngineCounters
+	{
+#if MYUTILITY_PACKAGE_MERGE_STATS
+		unsigned long long	nodeCount	 = 0;	//! 貸し出したノードの数
+		unsigned long long	releaseCount = 0;	//! 返却したノードの数
+		size_t				numInUse	 = 0;
+		size_t				peakInUse	 = 0;
+		size_t				maxDepth	 = 0;	//! 先読みの再構築で再帰した深さの最大
+
+		void OnBorrow()				{ ++nodeCount; if (++numInUse > peakInUse) peakInUse = numInUse; }
+		void OnRelease()			{ ++releaseCount; --numInUse; }
+		void OnDepth(size_t depth)	{ if (depth > maxDepth) maxDepth = depth; }
+#else
+		void OnBorrow()				{}
+		void OnRelease()			{}
+		void OnDepth(size_t)		{}
+#endif
+		void Reset()				{ *this = EngineCounters(); }
+	};
+
+	// @class 1回の呼び出しの統計を記録する
+	// @note  生成から EndSort() までを並べ替え、それ以降の破棄までを本体の時間として数える
+	class StatsScope
+	{
+	public:
+#if MYUTILITY_PACKAGE_MERGE_STATS
+		StatsScope(Workspace& rWorkspace, Workspace::BufferSlot slot)
+			: m_rStats(rWorkspace.GetBuffer<EngineStatsBuffer>(Workspace::SLOT_STATS).stats[slot])
+			, m_beginTime(Clock::now())
+			, m_sortEndTime(m_beginTime)
+		{
+			m_rStats.callCount += 1;
+		}
+
+		~StatsScope()
+		{
+			m_rStats.mainLoopNs += ToNanoseconds(Clock::now() - m_sortEndTime);
+		}
+
+		//! 並べ替えの終わり
+		void EndSort()
+		{
+			m_sortEndTime	  = Clock::now();
+			m_rStats.sortNs += ToNanoseconds(m_sortEndTime - m_beginTime);
+		}
+
+		//! 作ったノードの数
+		void AddNodes(unsigned long long count) { m_rStats.nodeCount += count; }
+
+		//! プール全体を走査した回数
+		void AddSweeps(unsigned long long count) { m_rStats.sweepCount += count; }
+
+		//! プールの見積もりを超えて足したノードの数
+		void AddOverflows(unsigned long long count) { m_rStats.overflowCount += count; }
+
+		//! プールの使用量
+		void ObservePool(size_t peakInUse, size_t capacity)
+		{
+			m_rStats.peakPoolInUse	  = std::max(m_rStats.peakPoolInUse, peakInUse);
+			m_rStats.peakPoolCapacity = std::max(m_rStats.peakPoolCapacity, capacity);
+			if (capacity)
+				m_rStats.peakPoolUsage = std::max(m_rStats.peakPoolUsage, static_cast<double>(peakInUse) / capacity);
+		}
+
+		//! 呼び出し1回分の計測をまとめて記録する (ノード数・返却数・再帰の深さ・プールの使用量)
+		void AddCounters(const EngineCounters& counters, size_t capacity)
+		{
+			m_rStats.nodeCount	   += counters.nodeCount;
+			m_rStats.releaseCount  += counters.releaseCount;
+			m_rStats.maxRecursionDepth = std::max(m_rStats.maxRecursionDepth, counters.maxDepth);
+			ObservePool(counters.peakInUse, capacity);
+		}
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		static unsigned long long ToNanoseconds(Clock::duration duration)
+		{
+			return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+		}
+
+		EngineStats&		m_rStats;
+		Clock::time_point	m_beginTime;
+		Clock::time_point	m_sortEndTime;
+#else
+		StatsScope(Workspace&, Workspace::BufferSlot)		{}
+		void EndSort()										{}
+		void AddNodes(unsigned long long)					{}
+		void AddSweeps(unsigned long long)					{}
+		void AddOverflows(unsigned long long)				{}
+		void ObservePool(size_t, size_t)					{}
+		void AddCounters(const EngineCounters&, size_t)		{}
+#endif
+	};
+}
+}// end namespace
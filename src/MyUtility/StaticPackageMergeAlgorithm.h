@@ -0,0 +1,271 @@
+//-------------------------------------------------------------
+//! @brief	シンボル数と制限符号長を固定した境界パッケージマージアルゴリズム
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "PackageMergeAlgorithm.h"
+#include <array>
+#include <algorithm>	// std::sort, std::fill
+#include <cassert>
+#include <cstddef>		// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// note:
+	// DEFLATE の (286, 15), (30, 15), (19, 7) や JPEG の (256, 11/12) のように、形が決まっている呼び出し向け。
+	// BoundaryPM と同じ手順だが、ノードプール (L(L+1) 個)・先読みチェーン・ソート済みのシンボルをすべて std::array で持ち、
+	// ステージの再帰はテンプレートで展開する。ヒープ確保は一切行わない。
+	// ノードの参照は 16bit の添字で持つため、N は 65535 以下 (スタックには およそ 12N byte を置く)
+
+	// @class シンボル数 N、制限符号長 L に固定した境界パッケージマージアルゴリズム
+	template<size_t N, size_t L>
+	class StaticBoundaryPM
+	{
+		static_assert(N >= 2 && N <= 0xffff, "シンボル数は 2～65535");
+		static_assert(L >= 2 && L <= 32, "制限符号長は 2～32");
+
+	public:
+
+		//! シンボル数
+		static constexpr size_t NUM_SYMBOL = N;
+
+		//! 制限符号長
+		static constexpr size_t CODE_LENGTH_LIMIT = L;
+
+		//! 符号長を求める (重み・符号長ともに N 要素。例外は送出しない)
+		//! @return 符号化が不可能なら false
+		bool Compute(const unsigned* symbolWeights, unsigned* /*out*/pBitLengths) noexcept;
+
+		bool Compute(const std::array<unsigned, N>& symbolWeights, std::array<unsigned, N>& /*out*/bitLengths) noexcept
+		{
+			return Compute(symbolWeights.data(), bitLengths.data());
+		}
+
+		//! EngineFunc として渡せる版 (形が一致しなければ BoundaryPM を使う)
+		static bool Engine(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths)
+		{
+			if (arraySize != N || codeLengthLimit != L)
+				return BoundaryPM(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+
+			StaticBoundaryPM engine;
+			return engine.Compute(symbolWeights, pBitLengths);
+		}
+
+		//! StatusEngineFunc として渡せる版 (形が一致しなければ TryBoundaryPM を使う)
+		static Status TryEngine(const unsigned* symbolWeights, size_t arraySize, size_t codeLengthLimit, Workspace& rWorkspace, unsigned* pBitLengths) noexcept
+		{
+			if (arraySize != N || codeLengthLimit != L)
+				return TryBoundaryPM(symbolWeights, arraySize, codeLengthLimit, rWorkspace, pBitLengths);
+
+			StaticBoundaryPM engine;
+			return engine.Compute(symbolWeights, pBitLengths) ? STATUS_SUCCESS : STATUS_IMPOSSIBLE_CODING;
+		}
+
+	private:
+		using Index = unsigned short;
+
+		//! ノードがない
+		static constexpr Index NIL = 0xffff;
+
+		//! プールの容量 (BoundaryPM と同じ L(L+1))
+		static constexpr size_t POOL_SIZE = L * (L + 1);
+
+		// @struct ノード情報
+		struct Node
+		{
+			unsigned long long	weight;				//! 重み
+			Index				singleSymbolCount;	//! このノードの重み以下の重みを持つシンボル単体の数 (このノードを含める)
+			Index				next;				//! ツリー右側のノード (プールの空きリストでは次の空きノード)
+			Index				refCount;			//! 参照カウント
+		};
+
+		// @brief シンボル単体の重み
+		//-------------------------------------------------------------
+		unsigned long long GetSymbolWeight(size_t i) const { return m_keys[i] >> 32; }
+
+		// @brief 貸出 (参照カウント 1 で返す)
+		//-------------------------------------------------------------
+		Index Borrow(unsigned long long weight, Index next, size_t singleSymbolCount)
+		{
+			Index index = m_freeList;
+			assert(index != NIL && "プールに空きがないっぽい");
+			m_freeList	= m_pool[index].next;
+
+			Node& rNode				= m_pool[index];
+			rNode.weight			= weight;
+			rNode.singleSymbolCount	= static_cast<Index>(singleSymbolCount);
+			rNode.next				= next;
+			rNode.refCount			= 1;
+			AddRef(next);
+			return index;
+		}
+
+		// @brief 参照を追加
+		//-------------------------------------------------------------
+		void AddRef(Index index)
+		{
+			if (index != NIL)
+				++m_pool[index].refCount;
+		}
+
+		// @brief 参照を解放 (参照がなくなったノードはチェインをたどって順に返却)
+		//-------------------------------------------------------------
+		void Release(Index index)
+		{
+			while (index != NIL && --m_pool[index].refCount == 0)
+			{
+				Index next			= m_pool[index].next;
+				m_pool[index].next	= m_freeList;
+				m_freeList			= index;
+				index				= next;
+			}
+		}
+
+		// @brief 次のノード要素を選ぶ (重みが等しい場合はパッケージが優先)
+		//-------------------------------------------------------------
+		Node ChooseNextNode(const std::array<Index, 2>& lookahead, const Node& beforeNode) const
+		{
+			size_t			   nextSymbolIndex	 = beforeNode.singleSymbolCount;
+			unsigned long long nextPackageWeight = m_pool[lookahead[0]].weight + m_pool[lookahead[1]].weight;
+
+			if (nextSymbolIndex < m_numSymbol && GetSymbolWeight(nextSymbolIndex) < nextPackageWeight)
+				return Node{ GetSymbolWeight(nextSymbolIndex), static_cast<Index>(nextSymbolIndex + 1), beforeNode.next, 0 };
+
+			return Node{ nextPackageWeight, static_cast<Index>(nextSymbolIndex), lookahead[1], 0 };
+		}
+
+		// @brief 先読みチェーンを再構築する (上のステージへの再帰は展開される)
+		//-------------------------------------------------------------
+		template<size_t STAGE>
+		void IncrementLookAhead()
+		{
+			std::array<Index, 2>& rLookahead = m_lookaheads[STAGE];
+			Index before = rLookahead[1];
+
+			for (size_t i = 0; i < 2; ++i)
+			{
+				if constexpr (STAGE == 0)
+				{
+					// 上にステージがないためシンボル単体を加えるだけ
+					size_t nextSymbolIndex = m_pool[before].singleSymbolCount;
+					if (nextSymbolIndex >= m_numSymbol)
+						return;
+
+					Index next = m_pool[before].next;
+					Release(rLookahead[i]);
+					rLookahead[i] = Borrow(GetSymbolWeight(nextSymbolIndex), next, nextSymbolIndex + 1);
+				}
+				else
+				{
+					// note: before は常に保持中のもう一方の要素なので、先に解放してよい
+					Release(rLookahead[i]);
+
+					Node node	  = ChooseNextNode(m_lookaheads[STAGE - 1], m_pool[before]);
+					rLookahead[i] = Borrow(node.weight, node.next, node.singleSymbolCount);
+
+					if (m_lookaheads[STAGE - 1][1] == node.next)
+						IncrementLookAhead<STAGE - 1>();
+				}
+				before = rLookahead[i];
+			}
+		}
+
+		std::array<unsigned long long, N>	m_keys;			//! (重み << 32 | シンボル識別子) を昇順に並べたもの
+		size_t								m_numSymbol = 0;
+		std::array<Node, POOL_SIZE>			m_pool;
+		Index								m_freeList	= NIL;
+		std::array<std::array<Index, 2>, L - 1>	m_lookaheads;	//! 最下段を除くステージの先読みチェーン
+	};
+
+	// @brief 符号長を求める
+	//-------------------------------------------------------------
+	template<size_t N, size_t L>
+	bool StaticBoundaryPM<N, L>::Compute(const unsigned* symbolWeights, unsigned* /*out*/pBitLengths) noexcept
+	{
+		// 重みのあるシンボルを重みの昇順、シンボル識別子の昇順に並べる
+		m_numSymbol = 0;
+		for (size_t i = 0; i < N; ++i)
+		{
+			if (symbolWeights[i] != 0)
+				m_keys[m_numSymbol++] = (static_cast<unsigned long long>(symbolWeights[i]) << 32) | i;
+		}
+
+		if (IsImpossibleCoding(m_numSymbol, L))
+			return false;
+
+		std::fill(pBitLengths, pBitLengths + N, 0u);
+		if (m_numSymbol <= 1)
+		{
+			if (m_numSymbol == 1)
+				pBitLengths[static_cast<unsigned>(m_keys[0])] = 1;
+
+			return true;
+		}
+		std::sort(m_keys.begin(), m_keys.begin() + m_numSymbol);
+
+		// すべてのノードを空きリストにつなぐ
+		for (size_t i = 0; i < POOL_SIZE; ++i)
+			m_pool[i].next = static_cast<Index>(i + 1 < POOL_SIZE ? i + 1 : NIL);
+		m_freeList = 0;
+
+		// すべてのステージの先読みチェーンは、一番目・二番目に小さな重みを持つシンボルで初期化される
+		for (std::array<Index, 2>& rLookahead : m_lookaheads)
+		{
+			rLookahead[0] = Borrow(GetSymbolWeight(0), NIL, 1);
+			rLookahead[1] = Borrow(GetSymbolWeight(1), NIL, 2);
+		}
+
+		// 最下段の一番右側にあるチェインノード (プールの外に置く)
+		Node rightistChainNode{ GetSymbolWeight(1), 2, NIL, 0 };
+
+		const size_t numLastStageNode = 2 * m_numSymbol - 2;
+		for (size_t i = 2; i < numLastStageNode; ++i)
+		{
+			Node nextNode = ChooseNextNode(m_lookaheads[L - 2], rightistChainNode);
+
+			AddRef(nextNode.next);
+			Release(rightistChainNode.next);
+			rightistChainNode = nextNode;
+
+			if ((i + 1) < numLastStageNode && m_lookaheads[L - 2][1] == rightistChainNode.next)
+				IncrementLookAhead<L - 2>();
+		}
+
+		// チェインの各ノードは、自身のステージで重みの小さい方から singleSymbolCount 個のシンボルの符号長を 1 増やす。
+		// 差分を積んでから累積する
+		std::array<unsigned, N + 1> diffs;
+		std::fill(diffs.begin(), diffs.begin() + m_numSymbol + 1, 0u);
+		diffs[rightistChainNode.singleSymbolCount] -= 1;
+		unsigned numChainNode = 1;
+		for (Index index = rightistChainNode.next; index != NIL; index = m_pool[index].next)
+		{
+			diffs[m_pool[index].singleSymbolCount] -= 1;
+			++numChainNode;
+		}
+
+		unsigned length = numChainNode;
+		for (size_t i = 0; i < m_numSymbol; ++i)
+		{
+			pBitLengths[static_cast<unsigned>(m_keys[i])] = length;
+			length += diffs[i + 1];
+		}
+		return true;
+	}
+
+	// @brief シンボル数と制限符号長を固定した境界パッケージマージアルゴリズム (作業領域はすべてスタック)
+	// @note  例: PackageMerge::BoundaryPM<286, 15>(weights, /*out*/bitLengths)
+	//-------------------------------------------------------------
+	template<size_t N, size_t L>
+	bool BoundaryPM(const std::array<unsigned, N>& symbolWeights, std::array<unsigned, N>& /*out*/bitLengths) noexcept
+	{
+		StaticBoundaryPM<N, L> engine;
+		return engine.Compute(symbolWeights, bitLengths);
+	}
+}
+}// end namespace
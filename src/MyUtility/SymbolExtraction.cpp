@@ -0,0 +1,433 @@
+//-------------------------------------------------------------
+//! @brief	シンボルの抽出 (各アルゴリズム共通)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include "SymbolExtraction.h"
+#include <algorithm>	// std::sort, std::fill
+#include <atomic>		// std::atomic
+
+// note: SSE2 を前提にできる x64 のみ SIMD を使う
+#if defined(__x86_64__) || defined(_M_X64)
+#define MYUTILITY_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>		// __cpuid, __cpuidex
+#endif
+#endif
+
+// note: GCC / Clang では関数単位で AVX2 を有効にする (MSVC は指定なしで組み込み関数を使える)
+#if defined(MYUTILITY_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MYUTILITY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MYUTILITY_TARGET_AVX2
+#endif
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+using PackageMerge::SimdLevel;
+using PackageMerge::SymbolSummary;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// 基数ソートに切り替えるシンボル数 (これ未満は比較ソートのほうが速い)
+	const size_t RADIX_SORT_THRESHOLD = 1024;
+
+	// 重みのバイト数
+	const size_t NUM_WEIGHT_BYTE = sizeof(unsigned);
+
+	// 詰める際に一度に処理する要素数 (スタック上の一時領域の大きさ)
+	const size_t COMPACT_BLOCK = 1024;
+
+	// 詰める際に書き込み先の末尾を越えて書く最大の要素数 (AVX2 で 4要素単位に書くため)
+	const size_t COMPACT_PADDING = 4;
+
+	// 使用中の SIMD 命令セット (-1 は未決定)
+	std::atomic<int> g_simdLevel(-1);
+
+	// @brief キーを作る
+	//-------------------------------------------------------------
+	inline unsigned long long MakeKey(unsigned long long weight, size_t alphabet)
+	{
+		return (weight << 32) | static_cast<unsigned>(alphabet);
+	}
+
+	// @brief キーの重みの b バイト目
+	//-------------------------------------------------------------
+	inline unsigned GetWeightByte(unsigned long long key, size_t b)
+	{
+		return static_cast<unsigned>(key >> (32 + 8 * b)) & 0xFF;
+	}
+
+	// @brief 4bit の立っているビット数
+	//-------------------------------------------------------------
+	inline unsigned PopCount4(unsigned mask)
+	{
+		static const unsigned char TABLE[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+		return TABLE[mask & 0xF];
+	}
+
+	//-------------------------------------------------------------
+	// scalar
+	//-------------------------------------------------------------
+
+	// @brief 重みのあるシンボルのキーを [begin, end) から詰めて書き込み、重みを合計する
+	// @return 書き込んだ数
+	//-------------------------------------------------------------
+	template<class WEIGHT>
+	size_t CompactScalar(const WEIGHT* symbolWeights, size_t begin, size_t end, unsigned long long* pKeys, unsigned long long& /*inout*/totalWeight)
+	{
+		size_t numKey = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			// note: 分岐を避けるため常に書き込み、重みがあるときだけ進める
+			pKeys[numKey] = MakeKey(symbolWeights[i], i);
+			numKey		 += (symbolWeights[i] != 0);
+			totalWeight	 += symbolWeights[i];
+		}
+		return numKey;
+	}
+
+#if defined(MYUTILITY_SIMD_X86)
+	//-------------------------------------------------------------
+	// SSE2
+	//-------------------------------------------------------------
+
+	// @brief 重みのあるシンボルのキーを [begin, end) から詰めて書き込み、重みを合計する
+	// @note  重みのない 4要素はまとめて飛ばし、それ以外は分岐なしで書き込む
+	//-------------------------------------------------------------
+	size_t CompactSSE2(const unsigned* symbolWeights, size_t begin, size_t end, unsigned long long* pKeys, unsigned long long& /*inout*/totalWeight)
+	{
+		const __m128i zero   = _mm_setzero_si128();
+		__m128i		  total  = _mm_setzero_si128();
+		size_t		  numKey = 0;
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128i weights = _mm_loadu_si128(reinterpret_cast<const __m128i*>(symbolWeights + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(weights, zero)) == 0xFFFF)
+				continue;
+
+			total = _mm_add_epi64(total, _mm_unpacklo_epi32(weights, zero));
+			total = _mm_add_epi64(total, _mm_unpackhi_epi32(weights, zero));
+			for (size_t lane = 0; lane < 4; ++lane)
+			{
+				pKeys[numKey] = MakeKey(symbolWeights[i + lane], i + lane);
+				numKey		 += (symbolWeights[i + lane] != 0);
+			}
+		}
+		unsigned long long lanes[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+		totalWeight += lanes[0] + lanes[1];
+
+		return numKey + CompactScalar(symbolWeights, i, end, pKeys + numKey, totalWeight);
+	}
+
+	//-------------------------------------------------------------
+	// AVX2
+	//-------------------------------------------------------------
+
+	// @struct 64bit 要素4つを左詰めする並べ替え表 (4bit のマスクごと)
+	struct CompactPermutation
+	{
+		unsigned indices[16][8] = {};
+
+		CompactPermutation()
+		{
+			for (unsigned mask = 0; mask < 16; ++mask)
+			{
+				unsigned numLane = 0;
+				for (unsigned lane = 0; lane < 4; ++lane)
+				{
+					if (mask & (1u << lane))
+					{
+						indices[mask][numLane * 2]	   = lane * 2;
+						indices[mask][numLane * 2 + 1] = lane * 2 + 1;
+						++numLane;
+					}
+				}
+			}
+		}
+	};
+	const CompactPermutation COMPACT_PERMUTATION;
+
+	// @brief 重みのあるシンボルのキーを [begin, end) から詰めて書き込み、重みを合計する
+	// @note  書き込み先は詰めた数より COMPACT_PADDING 要素だけ余分に書ける必要がある
+	//-------------------------------------------------------------
+	MYUTILITY_TARGET_AVX2
+	size_t CompactAVX2(const unsigned* symbolWeights, size_t begin, size_t end, unsigned long long* pKeys, unsigned long long& /*inout*/totalWeight)
+	{
+		const __m256i zero   = _mm256_setzero_si256();
+		const __m256i step   = _mm256_set1_epi64x(8);
+		__m256i		  idxLo  = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(begin)), _mm256_setr_epi64x(0, 1, 2, 3));
+		__m256i		  idxHi  = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(begin)), _mm256_setr_epi64x(4, 5, 6, 7));
+		__m256i		  total  = _mm256_setzero_si256();
+		size_t		  numKey = 0;
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256i  weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(symbolWeights + i));
+			unsigned mask	 = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(weights, zero))) & 0xFF;
+
+			if (mask)
+			{
+				// 重みを 64bit に広げて上位に置き、下位にシンボル識別子を入れる
+				__m256i weightsLo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(weights));
+				__m256i weightsHi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(weights, 1));
+				total = _mm256_add_epi64(total, _mm256_add_epi64(weightsLo, weightsHi));
+
+				__m256i keysLo = _mm256_or_si256(_mm256_slli_epi64(weightsLo, 32), idxLo);
+				__m256i keysHi = _mm256_or_si256(_mm256_slli_epi64(weightsHi, 32), idxHi);
+
+				unsigned maskLo = mask & 0xF;
+				unsigned maskHi = mask >> 4;
+
+				// 重みのある要素を左詰めして4要素まとめて書き込み、その数だけ進める
+				__m256i permLo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(COMPACT_PERMUTATION.indices[maskLo]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pKeys + numKey), _mm256_permutevar8x32_epi32(keysLo, permLo));
+				numKey += PopCount4(maskLo);
+
+				__m256i permHi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(COMPACT_PERMUTATION.indices[maskHi]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pKeys + numKey), _mm256_permutevar8x32_epi32(keysHi, permHi));
+				numKey += PopCount4(maskHi);
+			}
+			idxLo = _mm256_add_epi64(idxLo, step);
+			idxHi = _mm256_add_epi64(idxHi, step);
+		}
+		unsigned long long lanes[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+		totalWeight += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+		return numKey + CompactScalar(symbolWeights, i, end, pKeys + numKey, totalWeight);
+	}
+
+	// @brief CPU が AVX2 に対応しているか (OS が YMM レジスタを保存するかを含む)
+	//-------------------------------------------------------------
+	bool IsAVX2Supported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	// @brief 詰めたキー列を重みの安定な LSD 基数ソートで並べる
+	// @note  全キーで同じ値になるバイト (上位のゼロなど) は並びが変わらないため飛ばす
+	//-------------------------------------------------------------
+	void SortCompactedKeys(PackageMerge::SymbolSortBuffer& rBuffer)
+	{
+		std::vector<unsigned long long>& keys = rBuffer.keys;
+		if (keys.size() < RADIX_SORT_THRESHOLD)
+		{
+			std::sort(keys.begin(), keys.end());
+			return;
+		}
+
+		// すべてのバイトの出現数を一度に数える
+		unsigned counts[NUM_WEIGHT_BYTE][256];
+		std::fill(&counts[0][0], &counts[0][0] + NUM_WEIGHT_BYTE * 256, 0u);
+		for (unsigned long long key : keys)
+		{
+			for (size_t b = 0; b < NUM_WEIGHT_BYTE; ++b)
+				counts[b][GetWeightByte(key, b)] += 1;
+		}
+
+		std::vector<unsigned long long>& work = rBuffer.work;
+		work.resize(keys.size());
+
+		for (size_t b = 0; b < NUM_WEIGHT_BYTE; ++b)
+		{
+			// 全キーで同じ値のバイトは飛ばす
+			if (counts[b][GetWeightByte(keys[0], b)] == keys.size())
+				continue;
+
+			// 出現数を書き込み位置に変換
+			unsigned offset = 0;
+			for (unsigned& count : counts[b])
+			{
+				unsigned num = count;
+				count  = offset;
+				offset += num;
+			}
+			for (unsigned long long key : keys)
+				work[counts[b][GetWeightByte(key, b)]++] = key;
+
+			keys.swap(work);
+		}
+	}
+
+	// @brief CPU が対応している最上位の命令セット
+	//-------------------------------------------------------------
+	SimdLevel DetectSimdLevel()
+	{
+#if defined(MYUTILITY_SIMD_X86)
+		return IsAVX2Supported() ? PackageMerge::SIMD_AVX2 : PackageMerge::SIMD_SSE2;
+#else
+		return PackageMerge::SIMD_SCALAR;
+#endif
+	}
+}
+
+//-------------------------------------------------------------
+// function
+//-------------------------------------------------------------
+
+// @brief 使用中の SIMD 命令セット
+//-------------------------------------------------------------
+SimdLevel PackageMerge::GetSimdLevel()
+{
+	int level = g_simdLevel.load(std::memory_order_relaxed);
+	if (level < 0)
+	{
+		level = DetectSimdLevel();
+		g_simdLevel.store(level, std::memory_order_relaxed);
+	}
+	return static_cast<SimdLevel>(level);
+}
+
+// @brief 使用する SIMD 命令セットを変更する
+//-------------------------------------------------------------
+SimdLevel PackageMerge::SetSimdLevel(SimdLevel level)
+{
+	SimdLevel supported = DetectSimdLevel();
+	if (level > supported)
+		level = supported;
+
+	g_simdLevel.store(level, std::memory_order_relaxed);
+	return level;
+}
+
+// @brief SIMD 命令セットの名前
+//-------------------------------------------------------------
+const char* PackageMerge::ToString(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SCALAR:	return "scalar";
+	case SIMD_SSE2:		return "sse2";
+	case SIMD_AVX2:		return "avx2";
+	}
+	return "unknown";
+}
+
+// @brief 重みのあるシンボルだけをシンボル識別子の昇順に詰めたキー列を作る
+// @note  入力は一度だけ読む。ブロックごとにスタック上へ詰めてから書き足すため、
+//        重みのあるシンボルが少ない (疎な) 大きな表でも書き込みは詰めた分だけで済む
+//-------------------------------------------------------------
+SymbolSummary PackageMerge::CompactSymbolKeys(const unsigned* symbolWeights, size_t arraySize, std::vector<unsigned long long>& /*out*/keys)
+{
+	SimdLevel	  level = GetSimdLevel();
+	SymbolSummary summary;
+	keys.clear();
+
+	unsigned long long block[COMPACT_BLOCK + COMPACT_PADDING];
+	for (size_t begin = 0; begin < arraySize; begin += COMPACT_BLOCK)
+	{
+		size_t end	  = std::min(begin + COMPACT_BLOCK, arraySize);
+		size_t numKey = 0;
+		switch (level)
+		{
+#if defined(MYUTILITY_SIMD_X86)
+		case SIMD_AVX2:	numKey = CompactAVX2(symbolWeights, begin, end, block, summary.totalWeight);	break;
+		case SIMD_SSE2:	numKey = CompactSSE2(symbolWeights, begin, end, block, summary.totalWeight);	break;
+#endif
+		default:		numKey = CompactScalar(symbolWeights, begin, end, block, summary.totalWeight);	break;
+		}
+		keys.insert(keys.end(), block, block + numKey);
+	}
+	summary.numSymbol = keys.size();
+
+	return summary;
+}
+
+// @brief 重みのあるシンボルを (重み, シンボル識別子) の昇順に並べたキー列を作る
+// @note  シンボル識別子の昇順に抽出するため、重みだけを安定な LSD 基数ソートで並べれば
+//        (重み, シンボル識別子) の順になる
+//-------------------------------------------------------------
+SymbolSummary PackageMerge::SortSymbolKeys(const unsigned* symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer)
+{
+	// 重みがゼロであるシンボルは利用されていないとみなし、
+	// 重みのあるシンボルだけを抽出する
+	SymbolSummary summary = CompactSymbolKeys(symbolWeights, arraySize, /*out*/rBuffer.keys);
+	SortCompactedKeys(rBuffer);
+	return summary;
+}
+
+// @brief 16bit の重み版
+// @note  キーの形式は 32bit の重みと同じ (上位 2byte は基数ソートで飛ばされる)
+//-------------------------------------------------------------
+SymbolSummary PackageMerge::SortSymbolKeys(const unsigned short* symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer)
+{
+	std::vector<unsigned long long>& keys = rBuffer.keys;
+	SymbolSummary summary;
+
+	keys.resize(arraySize + 1);
+	keys.resize(CompactScalar(symbolWeights, 0, arraySize, keys.data(), summary.totalWeight));
+	summary.numSymbol = keys.size();
+
+	SortCompactedKeys(rBuffer);
+	return summary;
+}
+
+// @brief 64bit の重み版
+// @note  すべての重みが 32bit に収まればキーの形式は 32bit の重みと同じ。
+//        収まらなければキーはシンボル識別子だけになり、(重み, シンボル識別子) の比較ソートで並べる
+//-------------------------------------------------------------
+SymbolSummary PackageMerge::SortSymbolKeys(const unsigned long long* symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer)
+{
+	std::vector<unsigned long long>& keys = rBuffer.keys;
+	SymbolSummary summary;
+
+	keys.clear();
+	unsigned long long maxWeight = 0;
+	for (size_t i = 0; i < arraySize; ++i)
+	{
+		unsigned long long weight = symbolWeights[i];
+		if (weight == 0)
+			continue;
+
+		keys.push_back(i);
+		maxWeight			= std::max(maxWeight, weight);
+		summary.totalWeight = (weight > ~0ULL - summary.totalWeight) ? ~0ULL : summary.totalWeight + weight;
+	}
+	summary.numSymbol = keys.size();
+
+	if (maxWeight <= 0xFFFFFFFFULL)
+	{
+		for (unsigned long long& key : keys)
+			key = MakeKey(symbolWeights[key], static_cast<size_t>(key));
+
+		SortCompactedKeys(rBuffer);
+		return summary;
+	}
+
+	std::sort(keys.begin(), keys.end(), [symbolWeights](unsigned long long a, unsigned long long b)
+	{
+		return (symbolWeights[a] != symbolWeights[b]) ? symbolWeights[a] < symbolWeights[b] : a < b;
+	});
+	return summary;
+}
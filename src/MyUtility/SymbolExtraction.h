@@ -0,0 +1,105 @@
+//-------------------------------------------------------------
+//! @brief	シンボルの抽出 (各アルゴリズム共通)
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <vector>
+#include <algorithm>	// std::max
+#include <cstddef>	// size_t
+
+namespace MyUtility
+{
+namespace PackageMerge
+{
+	// @enum 抽出に使う SIMD 命令セット
+	enum SimdLevel
+	{
+		SIMD_SCALAR,	//! SIMD を使わない
+		SIMD_SSE2,		//! SSE2
+		SIMD_AVX2,		//! AVX2
+	};
+
+	// @struct 抽出したシンボルの集計
+	struct SymbolSummary
+	{
+		size_t				numSymbol	= 0;	//! 重みのあるシンボルの数
+		unsigned long long	totalWeight	= 0;	//! 重みの合計 (64bit の重みであふれる場合は ~0ULL)
+	};
+
+	// @struct 抽出に使う作業バッファ
+	struct SymbolSortBuffer
+	{
+		std::vector<unsigned long long> keys;	//! (重み << 32 | シンボル識別子)
+		std::vector<unsigned long long> work;	//! 基数ソートの書き込み先
+	};
+
+	//! 使用中の SIMD 命令セット (初回に CPU を調べて決める)
+	SimdLevel GetSimdLevel();
+
+	//! 使用する SIMD 命令セットを変更する (CPU が対応していない場合は対応している中で最も近いものになる)
+	//! @return 実際に使われる命令セット
+	SimdLevel SetSimdLevel(SimdLevel level);
+
+	//! SIMD 命令セットの名前
+	const char* ToString(SimdLevel level);
+
+	//! 重みのあるシンボルだけをシンボル識別子の昇順に詰めたキー列 (重み << 32 | シンボル識別子) を作る
+	SymbolSummary CompactSymbolKeys(const unsigned* symbolWeights, size_t arraySize, std::vector<unsigned long long>& /*out*/keys);
+
+	//! 重みのあるシンボルを (重み, シンボル識別子) の昇順に並べたキー列を作る (結果は rBuffer.keys)
+	//! @note 64bit の重みで 32bit に収まらない重みがある場合、キーはシンボル識別子だけになる (下位 32bit がシンボル識別子なのは同じ)
+	SymbolSummary SortSymbolKeys(const unsigned short*	   symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer);
+	SymbolSummary SortSymbolKeys(const unsigned*		   symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer);
+	SymbolSummary SortSymbolKeys(const unsigned long long* symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer);
+
+	// @brief パッケージの重みを 32bit で数えられるか
+	// @note  ステージ s のリストの重みの合計は s × 重みの合計 以下なので、どのパッケージの重みも 制限符号長 × 重みの合計 を超えない
+	//-------------------------------------------------------------
+	inline bool IsNarrowSumEnough(const SymbolSummary& summary, size_t codeLengthLimit)
+	{
+		return summary.totalWeight <= 0xFFFFFFFFULL / std::max<size_t>(codeLengthLimit, 1);
+	}
+
+	// @brief パッケージの重みを 64bit で数えられるか
+	//-------------------------------------------------------------
+	inline bool IsWideSumEnough(const SymbolSummary& summary, size_t codeLengthLimit)
+	{
+		return summary.totalWeight < ~0ULL / std::max<size_t>(codeLengthLimit, 1);
+	}
+
+	// @brief SortSymbolKeys() で並べたキー列から (シンボル識別子, 重み) のリストを作る
+	// @note  SYMBOL は (シンボル識別子, 重み) から構築でき、重みのメンバ weight を持つこと
+	//-------------------------------------------------------------
+	template<class SYMBOL, class WEIGHT>
+	void BuildSortedSymbolList(const WEIGHT* symbolWeights, const SymbolSortBuffer& rBuffer, std::vector<SYMBOL>& /*out*/list)
+	{
+		using SymbolWeight = decltype(SYMBOL::weight);
+
+		list.clear();
+		list.reserve(rBuffer.keys.size());
+		for (unsigned long long key : rBuffer.keys)
+		{
+			unsigned alphabet = static_cast<unsigned>(key);
+			if constexpr (sizeof(WEIGHT) <= sizeof(unsigned))
+				list.push_back(SYMBOL(alphabet, static_cast<SymbolWeight>(key >> 32)));
+			else
+				list.push_back(SYMBOL(alphabet, static_cast<SymbolWeight>(symbolWeights[alphabet])));
+		}
+	}
+
+	// @brief 実際に使われているシンボルを抽出し、重みの昇順、シンボル識別子の昇順に並べる
+	// @note  SYMBOL は (シンボル識別子, 重み) から構築できること
+	//-------------------------------------------------------------
+	template<class SYMBOL>
+	SymbolSummary ExtractSortedSymbolList(const unsigned* symbolWeights, size_t arraySize, SymbolSortBuffer& rBuffer, std::vector<SYMBOL>& /*out*/list)
+	{
+		SymbolSummary summary = SortSymbolKeys(symbolWeights, arraySize, rBuffer);
+		BuildSortedSymbolList(symbolWeights, rBuffer, /*out*/list);
+		return summary;
+	}
+}
+}// end namespace
@@ -1,112 +1,406 @@
-#include <iostream>
-#include <vector>
-#include <random>		// random
-#include <ctime>		// use to make random seed
-#include <algorithm>	// std::equal
-
-#include "MyUtility/PackageMergeAlgorithm.h"
-
-// proto type
-std::vector<unsigned> RandomWeightArray(unsigned maxAlphabet);
-bool				  CheckAllResultEquivalent();
-
-//! @brief main
-int main()
-{
-	constexpr unsigned MAX_ALPHABET = 286;
-	constexpr size_t   LENGTH_LIMIT = 15;
-
-	auto alphabetArray = RandomWeightArray(MAX_ALPHABET);
-		
-	// ȃpbP[W}[WASY
-	{
-		auto codeLength = 
-			MyUtility::PackageMerge::NaturalPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		for (unsigned value : codeLength)
-			std::cout << value << ", ";
-	}
-	std::cout << "\n----------------------------------------------\n";
-
-	// xpbP[W}[WASY
-	{
-		auto codeLength = 
-			MyUtility::PackageMerge::LazyPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		for (unsigned value : codeLength)
-			std::cout << value << ", ";
-	}
-	std::cout << "\n----------------------------------------------\n";
-
-	// EpbP[W}[WASY
-	{
-		auto codeLength = 
-			MyUtility::PackageMerge::BoundaryPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		for (unsigned value : codeLength)
-			std::cout << value << ", ";
-	}
-	getchar();
-	return 0;
-}
-
-//! @brief _ȃAt@xbg̏dݕ\\z
-std::vector<unsigned> RandomWeightArray(unsigned maxAlphabet)
-{
-	std::mt19937 mt(static_cast<unsigned>(time(nullptr)));
-	std::uniform_int_distribution<unsigned> randomFunc(0, 1024);
-
-	std::vector<unsigned> result(maxAlphabet);
-
-	for (size_t i = 0; i < result.size(); ++i)
-		result[i] = randomFunc(mt);
-
-	return result;
-}
-
-//! @brief eXgp
-#if 0
-bool CheckAllResultEquivalent()
-{
-	constexpr unsigned MAX_LOOP = 100;
-	for (unsigned i = 0; i < MAX_LOOP; ++i)
-	{
-		constexpr unsigned MAX_ALPHABET = 286;
-		constexpr size_t   LENGTH_LIMIT = 15;
-
-		auto alphabetArray = RandomWeightArray(MAX_ALPHABET);
-
-		// ȃpbP[W}[WASY
-		auto codeLength_1 =
-			MyUtility::PackageMerge::NaturalPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		// xpbP[W}[WASY
-		auto codeLength_2 =
-			MyUtility::PackageMerge::LazyPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		// EpbP[W}[WASY
-		auto codeLength_3 =
-			MyUtility::PackageMerge::BoundaryPM(alphabetArray.data(), std::size(alphabetArray), LENGTH_LIMIT);
-
-		if (!std::equal(codeLength_1.begin(), codeLength_1.end(), codeLength_2.begin()) ||
-			!std::equal(codeLength_1.begin(), codeLength_1.end(), codeLength_3.begin()))
-		{
-			std::cout << "***error Ȃ񂩈Ⴄۂ:" << i;
-			std::cout << "\n----------------------------------------------\n";
-			for (unsigned value : codeLength_1)
-				std::cout << value << ", ";
-			std::cout << "\n----------------------------------------------\n";
-			for (unsigned value : codeLength_2)
-				std::cout << value << ", ";
-			std::cout << "\n----------------------------------------------\n";
-			for (unsigned value : codeLength_3)
-				std::cout << value << ", ";
-			std::cout << "\n----------------------------------------------\n";
-			return false;
-		}
-	}
-	std::cout << "OK: I܂I" << std::endl;
-	std::cout << "----------------------------------------------\n";
-	return true;
-}
-#endif
\ No newline at end of file
+//-------------------------------------------------------------
+//! @brief	ヒストグラムのファイルから符号長の表をまとめて求めるツール
+//! @author	ｹｰﾄｩｽ=ｶｴﾚｽﾃｨｽ
+//-------------------------------------------------------------
+
+//-------------------------------------------------------------
+// include
+//-------------------------------------------------------------
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>		// std::mt19937_64
+#include <algorithm>	// std::fill
+#include <stdexcept>	// std::runtime_error
+#include <cstdio>		// FILE
+#include <cstdlib>		// strtoull
+
+#if defined(_WIN32)
+#include <io.h>			// _setmode
+#include <fcntl.h>		// _O_BINARY
+#endif
+
+#include "MyUtility/PackageMergeAlgorithm.h"
+#include "MyUtility/PackageMergeBatch.h"
+
+//-------------------------------------------------------------
+// using
+//-------------------------------------------------------------
+using namespace MyUtility;
+
+//-------------------------------------------------------------
+// inner
+//-------------------------------------------------------------
+namespace
+{
+	// note:
+	// ファイルの書式 (すべてリトルエンディアンの 32bit 符号なし整数)
+	//   ヘッダ : マジック ("PMH1" 入力 / "PML1" 出力)
+	//   レコード: シンボル数 n、制限符号長 L、n 個の値 (入力は重み、出力は符号長)
+	// レコードはファイルの終わりまで続く。符号化できないレコードの符号長はすべてゼロになる
+
+	//! 入力のマジック
+	const char HISTOGRAM_MAGIC[4] = { 'P', 'M', 'H', '1' };
+
+	//! 出力のマジック
+	const char LENGTH_MAGIC[4] = { 'P', 'M', 'L', '1' };
+
+	//! 1レコードのシンボル数の上限
+	const size_t MAX_RECORD_SYMBOL = 1 << 26;
+
+	//! 制限符号長の上限
+	const size_t MAX_RECORD_LIMIT = 64;
+
+	// @struct エンジン
+	struct Engine
+	{
+		const char*				 name;
+		PackageMerge::EngineFunc func;
+	};
+
+	// note: auto は制限のないハフマン符号を先に試し、収まらないときだけ境界パッケージマージを使う
+	const Engine ENGINES[] =
+	{
+		{ "natural",	PackageMerge::NaturalPM },
+		{ "lazy",		PackageMerge::LazyPM },
+		{ "boundary",	PackageMerge::BoundaryPM },
+		{ "auto",		PackageMerge::HybridPM },
+	};
+
+	// @struct コマンドライン設定
+	struct Options
+	{
+		std::string				 inputPath;
+		std::string				 outputPath;
+		PackageMerge::EngineFunc engine		   = PackageMerge::HybridPM;
+		size_t					 numThread	   = 0;			//! 0 ならハードウェアのスレッド数
+		size_t					 chunkMegaBytes = 64;		//! 一度に読み込む重みの量
+		size_t					 generateCount = 0;			//! 0 以外なら乱数のヒストグラムを書き出す
+		size_t					 numAlphabet   = 286;		//! --generate のシンボル数
+		size_t					 codeLengthLimit = 15;		//! --generate の制限符号長
+		unsigned long long		 seed		   = 1;			//! --generate のシード
+	};
+
+	// @struct 読み込んだレコードの塊
+	struct Chunk
+	{
+		std::vector<unsigned>				weights;	//! 全レコードの重みを連結したもの
+		std::vector<unsigned>				lengths;	//! 全レコードの符号長を連結したもの
+		std::vector<size_t>					offsets;	//! レコードごとの先頭
+		std::vector<PackageMerge::BatchJob>	jobs;
+	};
+
+	// @brief 使い方の表示
+	//-------------------------------------------------------------
+	void PrintUsage()
+	{
+		std::cerr <<
+			"usage: sample [options] INPUT OUTPUT      ('-' for stdin / stdout)\n"
+			"  reads histograms (\"PMH1\", then records of n, L and n weights; little-endian u32)\n"
+			"  and writes length tables in the same layout (\"PML1\", n, L and n lengths).\n"
+			"  records that cannot be coded get all-zero lengths and make the exit code 2.\n"
+			"  --engine=NAME     natural,lazy,boundary,auto (default auto)\n"
+			"  --threads=N       worker threads including the caller (default: hardware threads)\n"
+			"  --chunk-mb=MB     weights read per round; bounds the memory use (default 64)\n"
+			"  --generate=COUNT  write COUNT random histograms to OUTPUT instead (INPUT is omitted)\n"
+			"  --n=N --L=L --seed=S   shape and seed for --generate (default 286, 15, 1)\n";
+	}
+
+	// @brief コマンドライン解析
+	//-------------------------------------------------------------
+	bool ParseOptions(int argc, char* argv[], Options& /*out*/options)
+	{
+		std::vector<std::string> paths;
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (arg.size() < 2 || arg.compare(0, 2, "--") != 0)
+			{
+				paths.push_back(arg);
+				continue;
+			}
+
+			std::string::size_type eq = arg.find('=');
+			std::string key   = arg.substr(0, eq);
+			std::string value = (eq == std::string::npos) ? std::string() : arg.substr(eq + 1);
+
+			if		(key == "--threads")	options.numThread = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--chunk-mb")	options.chunkMegaBytes = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--generate")	options.generateCount = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--n")			options.numAlphabet = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--L")			options.codeLengthLimit = static_cast<size_t>(strtoull(value.c_str(), nullptr, 0));
+			else if (key == "--seed")		options.seed = strtoull(value.c_str(), nullptr, 0);
+			else if (key == "--engine")
+			{
+				options.engine = nullptr;
+				for (const Engine& engine : ENGINES)
+				{
+					if (value == engine.name)
+						options.engine = engine.func;
+				}
+				if (options.engine == nullptr)
+				{
+					std::cerr << "unknown engine: " << value << "\n";
+					return false;
+				}
+			}
+			else
+			{
+				PrintUsage();
+				return false;
+			}
+		}
+
+		// --generate は出力先だけを取る
+		size_t numPath = options.generateCount ? 1 : 2;
+		if (paths.size() != numPath)
+		{
+			PrintUsage();
+			return false;
+		}
+		if (numPath == 2)
+			options.inputPath = paths[0];
+
+		options.outputPath		= paths.back();
+		options.chunkMegaBytes	= std::max<size_t>(options.chunkMegaBytes, 1);
+		return true;
+	}
+
+	// @brief ファイルを開く ('-' は標準入出力)
+	//-------------------------------------------------------------
+	FILE* OpenFile(const std::string& path, bool isWrite)
+	{
+		if (path == "-")
+		{
+			FILE* fp = isWrite ? stdout : stdin;
+#if defined(_WIN32)
+			_setmode(_fileno(fp), _O_BINARY);
+#endif
+			return fp;
+		}
+		return fopen(path.c_str(), isWrite ? "wb" : "rb");
+	}
+
+	// @brief ファイルを閉じる
+	//-------------------------------------------------------------
+	bool CloseFile(FILE* fp)
+	{
+		if (fp == stdin || fp == stdout)
+			return fflush(fp) == 0;
+
+		return fclose(fp) == 0;
+	}
+
+	// @brief 32bit 値の列を読む
+	// @return 読めた数
+	//-------------------------------------------------------------
+	size_t ReadValues(FILE* fp, unsigned* pValues, size_t count)
+	{
+		// note: 読み込み先をそのまま使い、ホストの並びに直す
+		unsigned char* pBytes  = reinterpret_cast<unsigned char*>(pValues);
+		size_t		   numRead = fread(pBytes, sizeof(unsigned), count, fp);
+		for (size_t i = 0; i < numRead; ++i)
+		{
+			const unsigned char* p = pBytes + i * sizeof(unsigned);
+			pValues[i] = static_cast<unsigned>(p[0]) | (static_cast<unsigned>(p[1]) << 8) | (static_cast<unsigned>(p[2]) << 16) | (static_cast<unsigned>(p[3]) << 24);
+		}
+		return numRead;
+	}
+
+	// @brief 32bit 値の列を書く
+	//-------------------------------------------------------------
+	bool WriteValues(FILE* fp, const unsigned* pValues, size_t count, std::vector<unsigned char>& /*ref*/bytes)
+	{
+		bytes.resize(count * sizeof(unsigned));
+		for (size_t i = 0; i < count; ++i)
+		{
+			bytes[i * 4]	 = static_cast<unsigned char>(pValues[i]);
+			bytes[i * 4 + 1] = static_cast<unsigned char>(pValues[i] >> 8);
+			bytes[i * 4 + 2] = static_cast<unsigned char>(pValues[i] >> 16);
+			bytes[i * 4 + 3] = static_cast<unsigned char>(pValues[i] >> 24);
+		}
+		return count == 0 || fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+	}
+
+	// @brief 乱数のヒストグラムを書き出す
+	//-------------------------------------------------------------
+	int Generate(const Options& options)
+	{
+		FILE* fp = OpenFile(options.outputPath, true);
+		if (fp == nullptr)
+		{
+			std::cerr << "cannot open: " << options.outputPath << "\n";
+			return 1;
+		}
+
+		// note: どの環境でも同じファイルになるよう、乱数は生の出力だけを使う
+		std::mt19937_64				rng(options.seed);
+		std::vector<unsigned>		record(2 + options.numAlphabet);
+		std::vector<unsigned char>	bytes;
+
+		bool isOk = fwrite(HISTOGRAM_MAGIC, 1, sizeof(HISTOGRAM_MAGIC), fp) == sizeof(HISTOGRAM_MAGIC);
+		for (size_t i = 0; isOk && i < options.generateCount; ++i)
+		{
+			record[0] = static_cast<unsigned>(options.numAlphabet);
+			record[1] = static_cast<unsigned>(options.codeLengthLimit);
+			for (size_t s = 0; s < options.numAlphabet; ++s)
+				record[2 + s] = static_cast<unsigned>(rng() % 1025);
+
+			isOk = WriteValues(fp, record.data(), record.size(), bytes);
+		}
+		if (!CloseFile(fp) || !isOk)
+		{
+			std::cerr << "write error: " << options.outputPath << "\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	// @brief レコードを塊の容量まで読み込む
+	// @return 読み込みに失敗したら false (ファイルの終わりは成功)
+	//-------------------------------------------------------------
+	bool ReadChunk(FILE* fp, size_t maxWeights, Chunk& /*out*/chunk)
+	{
+		chunk.weights.clear();
+		chunk.offsets.clear();
+		chunk.jobs.clear();
+
+		// note: 1レコードが容量を超える場合も、そのレコードだけは読む
+		while (chunk.jobs.empty() || chunk.weights.size() < maxWeights)
+		{
+			unsigned header[2];
+			size_t	 numRead = ReadValues(fp, header, 2);
+			if (numRead == 0 && feof(fp))
+				return true;
+
+			if (numRead != 2 || header[0] > MAX_RECORD_SYMBOL || header[1] > MAX_RECORD_LIMIT)
+			{
+				std::cerr << "bad record header\n";
+				return false;
+			}
+
+			size_t offset = chunk.weights.size();
+			chunk.weights.resize(offset + header[0]);
+			if (ReadValues(fp, chunk.weights.data() + offset, header[0]) != header[0])
+			{
+				std::cerr << "truncated record\n";
+				return false;
+			}
+
+			PackageMerge::BatchJob job;
+			job.arraySize		= header[0];
+			job.codeLengthLimit	= header[1];
+			chunk.offsets.push_back(offset);
+			chunk.jobs.push_back(job);
+		}
+		return true;
+	}
+
+	// @brief ヒストグラムのファイルから符号長の表を求める
+	//-------------------------------------------------------------
+	int Process(const Options& options)
+	{
+		FILE* pInput = OpenFile(options.inputPath, false);
+		if (pInput == nullptr)
+		{
+			std::cerr << "cannot open: " << options.inputPath << "\n";
+			return 1;
+		}
+		FILE* pOutput = OpenFile(options.outputPath, true);
+		if (pOutput == nullptr)
+		{
+			CloseFile(pInput);
+			std::cerr << "cannot open: " << options.outputPath << "\n";
+			return 1;
+		}
+
+		int result = 0;
+		try
+		{
+			char magic[4];
+			if (fread(magic, 1, sizeof(magic), pInput) != sizeof(magic) || !std::equal(magic, magic + 4, HISTOGRAM_MAGIC))
+				throw std::runtime_error("not a histogram file");
+
+			if (fwrite(LENGTH_MAGIC, 1, sizeof(LENGTH_MAGIC), pOutput) != sizeof(LENGTH_MAGIC))
+				throw std::runtime_error("write error");
+
+			PackageMerge::BatchExecutor executor(options.numThread);
+			const size_t				maxWeights = (options.chunkMegaBytes << 20) / sizeof(unsigned);
+			Chunk						chunk;
+			std::vector<unsigned char>	bytes;
+			unsigned long long			numRecord  = 0;
+			unsigned long long			numFailure = 0;
+
+			// 塊ごとに 読み込み → 一括計算 → 書き出し を繰り返すため、使うメモリは塊の大きさで決まる
+			for (;;)
+			{
+				if (!ReadChunk(pInput, maxWeights, chunk))
+					throw std::runtime_error("bad input");
+
+				if (chunk.jobs.empty())
+					break;
+
+				// note: 読み込み後は要素が動かないため、ここで出力先を割り当てる
+				chunk.lengths.resize(chunk.weights.size());
+				for (size_t i = 0; i < chunk.jobs.size(); ++i)
+				{
+					chunk.jobs[i].symbolWeights	= chunk.weights.data() + chunk.offsets[i];
+					chunk.jobs[i].pBitLengths	= chunk.lengths.data() + chunk.offsets[i];
+				}
+				// note: 例外を投げたジョブは失敗扱いになり、他のジョブは最後まで処理されている
+				try
+				{
+					executor.Run(chunk.jobs.data(), chunk.jobs.size(), options.engine);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "engine error: " << e.what() << "\n";
+				}
+
+				for (PackageMerge::BatchJob& job : chunk.jobs)
+				{
+					if (!job.succeeded)
+					{
+						std::fill(job.pBitLengths, job.pBitLengths + job.arraySize, 0u);
+						++numFailure;
+					}
+
+					unsigned header[2] = { static_cast<unsigned>(job.arraySize), static_cast<unsigned>(job.codeLengthLimit) };
+					if (!WriteValues(pOutput, header, 2, bytes) || !WriteValues(pOutput, job.pBitLengths, job.arraySize, bytes))
+						throw std::runtime_error("write error");
+				}
+				numRecord += chunk.jobs.size();
+			}
+
+			std::cerr << numRecord << " records, " << numFailure << " impossible\n";
+			if (numFailure)
+				result = 2;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "error: " << e.what() << "\n";
+			result = 1;
+		}
+
+		CloseFile(pInput);
+		if (!CloseFile(pOutput) && result == 0)
+		{
+			std::cerr << "write error: " << options.outputPath << "\n";
+			result = 1;
+		}
+		return result;
+	}
+}
+
+//! @brief main
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+		return 1;
+
+	if (options.generateCount)
+		return Generate(options);
+
+	return Process(options);
+}